@@ -0,0 +1,60 @@
+#include "NBD_calibration.h"
+#include <math.h>
+
+/**
+ * Sizes the arrays for the sensors of the wire, the values of the remaining sensors are kept.
+ *
+ * @param sensors number of sensors
+ */
+void NBD_CalibrationPass::resize(size_t sensors)
+{
+    _raw.resize(sensors, 0);
+    _valid.resize(sensors, 0);
+    _slope.resize(sensors, 1.0f);
+    _offsetRaw.resize(sensors, 0.0f);
+    _rawOut.resize(sensors, 0);
+    _temperature.resize(sensors, 0.0f);
+}
+
+void NBD_CalibrationPass::setCalibration(size_t sensor, const NBD_Calibration &calibration)
+{
+    _slope[sensor] = calibration.slope;
+    _offsetRaw[sensor] = calibration.offset * 128.0f;
+}
+
+void NBD_CalibrationPass::setInput(size_t sensor, int32_t raw, bool valid)
+{
+    _raw[sensor] = raw;
+    _valid[sensor] = valid;
+}
+
+/**
+ * Calibrates and converts a range of sensors. Invalid inputs keep their raw value, their
+ * temperature is meaningless.
+ *
+ * @param first first sensor
+ * @param count number of sensors
+ * @param fahrenheit convert to °F instead of °C
+ */
+void NBD_CalibrationPass::run(size_t first, size_t count, bool fahrenheit)
+{
+    // Same constants as DallasTemperature::rawToCelsius()/rawToFahrenheit(), so an identity
+    // calibration gives the same temperatures
+    const float scale = fahrenheit ? 0.0140625f : 0.0078125f;
+    const float bias = fahrenheit ? 32.0f : 0.0f;
+    const int32_t *__restrict raw = _raw.data() + first;
+    const uint8_t *__restrict valid = _valid.data() + first;
+    const float *__restrict slope = _slope.data() + first;
+    const float *__restrict offsetRaw = _offsetRaw.data() + first;
+    int32_t *__restrict rawOut = _rawOut.data() + first;
+    float *__restrict temperature = _temperature.data() + first;
+    for (size_t i = 0; i < count; i++)
+    {
+        // No branches: copysignf() rounds half away from zero with a bit operation, so the loop vectorizes
+        float corrected = (float)raw[i] * slope[i] + offsetRaw[i];
+        int32_t rounded = (int32_t)(corrected + copysignf(0.5f, corrected));
+        int32_t keep = -(int32_t)(valid[i] != 0);
+        rawOut[i] = (rounded & keep) | (raw[i] & ~keep);
+        temperature[i] = corrected * scale + bias;
+    }
+}
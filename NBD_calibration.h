@@ -0,0 +1,48 @@
+#ifndef NBD_CALIBRATION_H
+#define NBD_CALIBRATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+Linear calibration of one sensor in °C: corrected = slope * measured + offset.
+A default constructed calibration leaves the readings unchanged.
+*/
+struct NBD_Calibration
+{
+    float offset = 0.0f;    //[°C]
+    float slope = 1.0f;
+
+    bool isIdentity() const { return offset == 0.0f && slope == 1.0f; }
+};
+
+/*
+Calibration and unit conversion of the readings of a wire in one pass over contiguous arrays
+(structure of arrays, indexed like the sensors of the wire). The loop has no calls and no
+branches, so it vectorizes where the target has SIMD.
+
+    in[]  raw reading (1/128 °C) and valid flag, filled by the reads of a cycle
+    out[] calibrated raw reading and the temperature in the unit of measure, valid inputs only
+*/
+class NBD_CalibrationPass
+{
+public:
+    void     resize(size_t sensors);
+    size_t   size() const { return _raw.size(); }
+    void     setCalibration(size_t sensor, const NBD_Calibration &calibration);
+    void     setInput(size_t sensor, int32_t raw, bool valid);
+    void     run(size_t first, size_t count, bool fahrenheit);
+
+    int32_t  getRaw(size_t sensor) const { return _rawOut[sensor]; }
+    float    getTemperature(size_t sensor) const { return _temperature[sensor]; }
+
+private:
+    std::vector<int32_t> _raw;          //Input, 1/128 °C
+    std::vector<uint8_t> _valid;        //Input, 0 = no usable reading
+    std::vector<float>   _slope;
+    std::vector<float>   _offsetRaw;    //Offset in 1/128 °C
+    std::vector<int32_t> _rawOut;       //Calibrated, 1/128 °C
+    std::vector<float>   _temperature;  //Calibrated, in the unit of measure
+};
+#endif /* NBD_CALIBRATION_H */
@@ -0,0 +1,338 @@
+#include "NBD_compressed.h"
+
+#define NBD_MAX_SAMPLE_BITS 55 //Longest time code (36) + longest value code (19)
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t z)
+{
+    return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+static void writeBits(NBD_CompressedBlock &b, uint32_t value, uint8_t n)
+{
+    for (int8_t i = n - 1; i >= 0; i--)
+    {
+        uint8_t mask = 0x80 >> (b.bits & 7);
+        if ((value >> i) & 1)
+            b.data[b.bits >> 3] |= mask;
+        else
+            b.data[b.bits >> 3] &= ~mask;
+        b.bits++;
+    }
+}
+
+static uint32_t readBits(const NBD_CompressedBlock &b, uint16_t &pos, uint8_t n)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        value = (value << 1) | ((b.data[pos >> 3] >> (7 - (pos & 7))) & 1);
+        pos++;
+    }
+    return value;
+}
+
+static void writeTimeCode(NBD_CompressedBlock &b, long dod)
+{
+    uint32_t z = zigzag((int32_t)dod);
+    if (dod == 0)
+    {
+        writeBits(b, 0x0, 1);
+    }
+    else if (z < (1UL << 7))
+    {
+        writeBits(b, 0x2, 2);
+        writeBits(b, z, 7);
+    }
+    else if (z < (1UL << 12))
+    {
+        writeBits(b, 0x6, 3);
+        writeBits(b, z, 12);
+    }
+    else if (z < (1UL << 20))
+    {
+        writeBits(b, 0xE, 4);
+        writeBits(b, z, 20);
+    }
+    else
+    {
+        writeBits(b, 0xF, 4);
+        writeBits(b, (uint32_t)dod, 32);
+    }
+}
+
+static long readTimeCode(const NBD_CompressedBlock &b, uint16_t &pos)
+{
+    if (readBits(b, pos, 1) == 0)
+        return 0;
+    if (readBits(b, pos, 1) == 0)
+        return unzigzag(readBits(b, pos, 7));
+    if (readBits(b, pos, 1) == 0)
+        return unzigzag(readBits(b, pos, 12));
+    if (readBits(b, pos, 1) == 0)
+        return unzigzag(readBits(b, pos, 20));
+    return (int32_t)readBits(b, pos, 32);
+}
+
+static void writeValueCode(NBD_CompressedBlock &b, int32_t delta)
+{
+    uint32_t z = zigzag(delta);
+    if (delta == 0)
+    {
+        writeBits(b, 0x0, 1);
+    }
+    else if (z < (1UL << 6))
+    {
+        writeBits(b, 0x2, 2);
+        writeBits(b, z, 6);
+    }
+    else if (z < (1UL << 10))
+    {
+        writeBits(b, 0x6, 3);
+        writeBits(b, z, 10);
+    }
+    else
+    {
+        writeBits(b, 0x7, 3);
+        writeBits(b, (uint16_t)delta, 16);
+    }
+}
+
+static int32_t readValueCode(const NBD_CompressedBlock &b, uint16_t &pos)
+{
+    if (readBits(b, pos, 1) == 0)
+        return 0;
+    if (readBits(b, pos, 1) == 0)
+        return unzigzag(readBits(b, pos, 6));
+    if (readBits(b, pos, 1) == 0)
+        return unzigzag(readBits(b, pos, 10));
+    return (int16_t)readBits(b, pos, 16);
+}
+
+//==============================================================================================
+//                                  NBD_CompressedSeries
+//==============================================================================================
+
+NBD_CompressedSeries::NBD_CompressedSeries()
+{
+    _resolution = 1000;
+    clear();
+}
+
+/**
+ * Allocates the blocks. Calling it again drops the recorded samples.
+ *
+ * @param blocks number of blocks of NBD_COMPRESSED_BLOCK_BYTES each
+ * @param resolutionMillis time resolution of the stored samples, readings closer
+ *        to a steady interval than this cost a single bit for their timestamp
+ */
+void NBD_CompressedSeries::begin(uint16_t blocks, unsigned long resolutionMillis)
+{
+    _blocks.assign(blocks, NBD_CompressedBlock());
+    _blocks.shrink_to_fit();
+    _resolution = (resolutionMillis == 0) ? 1 : resolutionMillis;
+    clear();
+}
+
+/**
+ * Drops the recorded samples, keeping the allocated memory.
+ */
+void NBD_CompressedSeries::clear()
+{
+    _head = 0;
+    _used = 0;
+    _lastTime = 0;
+    _lastTimeDelta = 0;
+    _lastRaw = 0;
+    for (size_t i = 0; i < _blocks.size(); i++)
+    {
+        _blocks[i].count = 0;
+        _blocks[i].bits = 0;
+    }
+}
+
+bool NBD_CompressedSeries::isEnabled() const
+{
+    return !_blocks.empty();
+}
+
+/**
+ * Appends a reading. When the current block is full the oldest block is reused.
+ *
+ * @param time millis() of the reading
+ * @param raw temperature in raw units (1/128 °C)
+ */
+void NBD_CompressedSeries::add(unsigned long time, int32_t raw)
+{
+    if (_blocks.empty())
+        return;
+
+    unsigned long qtime = time / _resolution;
+    NBD_CompressedBlock &block = _blocks[_head];
+    if (_used == 0 || block.count == 0)
+    {
+        startBlock(qtime, (int16_t)raw);
+        return;
+    }
+    if (block.bits + NBD_MAX_SAMPLE_BITS > NBD_COMPRESSED_BLOCK_BYTES * 8)
+    {
+        _head = (_head + 1) % _blocks.size();
+        startBlock(qtime, (int16_t)raw);
+        return;
+    }
+
+    long timeDelta = (long)(qtime - _lastTime);
+    writeTimeCode(block, timeDelta - _lastTimeDelta);
+    writeValueCode(block, (int32_t)raw - _lastRaw);
+    block.count++;
+
+    _lastTime = qtime;
+    _lastTimeDelta = timeDelta;
+    _lastRaw = (int16_t)raw;
+}
+
+unsigned long NBD_CompressedSeries::getResolution() const
+{
+    return _resolution;
+}
+
+uint16_t NBD_CompressedSeries::getBlockCount() const
+{
+    return _used;
+}
+
+/**
+ * Returns a block for export.
+ *
+ * @param i 0 is the oldest block, getBlockCount()-1 the one being written
+ *
+ * @return the block or nullptr if i is out of range
+ */
+const NBD_CompressedBlock *NBD_CompressedSeries::getBlock(uint16_t i) const
+{
+    if (i >= _used)
+        return nullptr;
+    return &_blocks[(_head + _blocks.size() + 1 - _used + i) % _blocks.size()];
+}
+
+uint32_t NBD_CompressedSeries::getSampleCount() const
+{
+    uint32_t n = 0;
+    for (uint16_t i = 0; i < _used; i++)
+    {
+        n += getBlock(i)->count;
+    }
+    return n;
+}
+
+void NBD_CompressedSeries::startBlock(unsigned long qtime, int16_t raw)
+{
+    NBD_CompressedBlock &block = _blocks[_head];
+    block.firstTime = qtime;
+    block.firstRaw = raw;
+    block.count = 1;
+    block.bits = 0;
+    if (_used < _blocks.size())
+        _used++;
+
+    _lastTime = qtime;
+    _lastTimeDelta = 0;
+    _lastRaw = raw;
+}
+
+//==============================================================================================
+//                                  NBD_CompressedReader
+//==============================================================================================
+
+NBD_CompressedReader::NBD_CompressedReader(const NBD_CompressedSeries &series) : _series(series)
+{
+    rewind();
+}
+
+/**
+ * Restarts decoding from the oldest sample.
+ */
+void NBD_CompressedReader::rewind()
+{
+    _block = 0;
+    _sample = 0;
+    _bit = 0;
+    _time = 0;
+    _timeDelta = 0;
+    _raw = 0;
+}
+
+/**
+ * Decodes the next sample.
+ *
+ * @param sample receives the sample, time is millis() truncated to the resolution of the series
+ *
+ * @return false when every sample was read
+ */
+bool NBD_CompressedReader::next(NBD_HistorySample &sample)
+{
+    const NBD_CompressedBlock *block = _series.getBlock(_block);
+    while (block != nullptr && _sample >= block->count)
+    {
+        _block++;
+        _sample = 0;
+        _bit = 0;
+        block = _series.getBlock(_block);
+    }
+    if (block == nullptr)
+        return false;
+
+    if (_sample == 0)
+    {
+        _time = block->firstTime;
+        _timeDelta = 0;
+        _raw = block->firstRaw;
+    }
+    else
+    {
+        _timeDelta += readTimeCode(*block, _bit);
+        _time += _timeDelta;
+        _raw += readValueCode(*block, _bit);
+    }
+    _sample++;
+
+    sample.time = _time * _series.getResolution();
+    sample.raw = _raw;
+    return true;
+}
+
+/**
+ * Decodes one block into a caller provided buffer.
+ *
+ * @param block the block
+ * @param resolutionMillis the resolution of the series the block comes from
+ * @param out the buffer
+ * @param max capacity of the buffer
+ *
+ * @return the number of samples decoded
+ */
+uint16_t NBD_decodeBlock(const NBD_CompressedBlock &block, unsigned long resolutionMillis,
+                         NBD_HistorySample *out, uint16_t max)
+{
+    uint16_t bit = 0;
+    unsigned long time = block.firstTime;
+    long timeDelta = 0;
+    int16_t raw = block.firstRaw;
+    uint16_t n = 0;
+    for (; n < block.count && n < max; n++)
+    {
+        if (n > 0)
+        {
+            timeDelta += readTimeCode(block, bit);
+            time += timeDelta;
+            raw += readValueCode(block, bit);
+        }
+        out[n].time = time * resolutionMillis;
+        out[n].raw = raw;
+    }
+    return n;
+}
@@ -0,0 +1,84 @@
+#ifndef NBD_COMPRESSED_H
+#define NBD_COMPRESSED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "NBD_history.h"
+
+#define NBD_COMPRESSED_BLOCK_BYTES 64  //Payload of one compressed block
+
+/*
+One block of a compressed series. The first sample is stored as is, every following sample as a
+delta-of-delta of its (quantized) time and a delta of its raw value, both in variable length bit codes.
+A block can be decoded on its own, so blocks can be exported or dropped independently.
+*/
+struct NBD_CompressedBlock
+{
+    unsigned long firstTime = 0;  //Quantized time of the first sample (millis() / resolution)
+    int16_t  firstRaw = 0;        //Raw value of the first sample (1/128 °C)
+    uint16_t count = 0;           //Samples in the block
+    uint16_t bits = 0;            //Bits used in data
+    uint8_t  data[NBD_COMPRESSED_BLOCK_BYTES];
+};
+
+/*
+Compressed history of one sensor: a fixed ring of blocks, the oldest block is reused when the newest is full.
+Steady readings at a steady interval cost 2 bits per sample.
+*/
+class NBD_CompressedSeries
+{
+public:
+    NBD_CompressedSeries();
+
+    void     begin(uint16_t blocks, unsigned long resolutionMillis);
+    void     clear();
+    bool     isEnabled() const;
+    void     add(unsigned long time, int32_t raw);
+
+    unsigned long              getResolution() const;
+    uint16_t                   getBlockCount() const;
+    const NBD_CompressedBlock *getBlock(uint16_t i) const; //0 is the oldest block
+    uint32_t                   getSampleCount() const;
+
+private:
+    std::vector<NBD_CompressedBlock> _blocks;
+    uint16_t      _head;        //Block being written
+    uint16_t      _used;        //Blocks holding samples
+    unsigned long _resolution;  //[milliseconds]
+    unsigned long _lastTime;    //Quantized time of the last sample
+    long          _lastTimeDelta;
+    int16_t       _lastRaw;
+
+    void startBlock(unsigned long qtime, int16_t raw);
+};
+
+/*
+Streaming decoder of an NBD_CompressedSeries, oldest sample first. No allocation.
+The series must not be modified while it is being read.
+*/
+class NBD_CompressedReader
+{
+public:
+    NBD_CompressedReader(const NBD_CompressedSeries &series);
+
+    bool next(NBD_HistorySample &sample);
+    void rewind();
+
+private:
+    const NBD_CompressedSeries &_series;
+    uint16_t      _block;
+    uint16_t      _sample;  //Sample index within the block
+    uint16_t      _bit;     //Bit position within the block
+    unsigned long _time;
+    long          _timeDelta;
+    int16_t       _raw;
+};
+
+/*
+Decodes one block on its own, e.g. after it was exported. Same codes as NBD_CompressedReader.
+*/
+uint16_t NBD_decodeBlock(const NBD_CompressedBlock &block, unsigned long resolutionMillis,
+                         NBD_HistorySample *out, uint16_t max);
+
+#endif /* NBD_COMPRESSED_H */
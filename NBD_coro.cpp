@@ -0,0 +1,292 @@
+#include "NBD_coro.h"
+
+#if defined(NBD_HAS_COROUTINES)
+
+/**
+ * Parks the coroutine in the executor resuming it, see NBD_Executor::park(). The library
+ * awaitables can only be awaited by a coroutine that an executor runs (spawn() or runOnce()),
+ * nothing else would ever resume it.
+ *
+ * @param handle the suspended coroutine
+ */
+void NBD_Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    NBD_Executor *executor = NBD_Executor::current();
+    assert(executor != nullptr && "NBD_Awaiter: awaited outside of an NBD_Executor, spawn() the task");
+    _handle = handle;
+    executor->park(this);
+}
+
+NBD_ReadAllAwaiter::NBD_ReadAllAwaiter(NonBlockingDallas *wire)
+{
+    add(wire);
+}
+
+NBD_ReadAllAwaiter::NBD_ReadAllAwaiter(const std::vector<NonBlockingDallas *> &wires)
+{
+    _pending.reserve(wires.size());
+    for (size_t i = 0; i < wires.size(); i++)
+    {
+        add(wires[i]);
+    }
+}
+
+void NBD_ReadAllAwaiter::add(NonBlockingDallas *wire)
+{
+    Pending p;
+    p.wire = wire;
+    p.cycle = wire->getCycleCount();
+    p.requested = false;
+    _pending.push_back(p);
+}
+
+/**
+ * Starts a conversion on the idle wires and drops the wires that completed a cycle since the
+ * awaiter was created. A wire without sensors has nothing to read.
+ *
+ * @return true when every wire completed a cycle
+ */
+bool NBD_ReadAllAwaiter::poll()
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < _pending.size(); i++)
+    {
+        Pending &p = _pending[i];
+        if (p.wire->getSensorsCount() == 0 || p.wire->getCycleCount() != p.cycle)
+            continue;
+        if (!p.requested && !p.wire->isConverting())
+        {
+            p.wire->requestTemperature();
+            p.requested = true;
+        }
+        _pending[kept++] = p;
+    }
+    _pending.resize(kept);
+    return kept == 0;
+}
+
+/**
+ * @param wire the wire of the sensor, nullptr if the handle names no wire
+ * @param handle the sensor
+ */
+NBD_SensorReadAwaiter::NBD_SensorReadAwaiter(NonBlockingDallas *wire, NBD_handle_t handle)
+    : _wire(wire), _handle(handle), _err(NBD_NO_ERROR), _requested(false)
+{
+}
+
+/**
+ * Requests the priority read as soon as the wire accepts it, then waits for its ticket.
+ *
+ * @return true when the read is done or failed
+ */
+bool NBD_SensorReadAwaiter::poll()
+{
+    if (!_wire)
+    {
+        _err = NBD_HANDLE_IS_NOT_VALID;
+        return true;
+    }
+    if (!_requested)
+    {
+        unsigned char index;
+        _err = _wire->getIndexByHandle(_handle, index);
+        if (_err == NBD_NO_ERROR)
+            _err = _wire->requestPriorityReadByIndex(index, _ticket);
+        if (_err == NBD_REQUEST_PENDING)
+            return false; // another priority read runs, retried after the next update()
+        if (_err != NBD_NO_ERROR)
+            return true;
+        _requested = true;
+    }
+    return _wire->isPriorityReadComplete(_ticket);
+}
+
+/**
+ * @return the published reading of the sensor after the priority read
+ */
+NBD_ReadResult NBD_SensorReadAwaiter::await_resume()
+{
+    NBD_ReadResult result;
+    result.err = _err;
+    if (_err != NBD_NO_ERROR)
+        return result;
+    unsigned char index;
+    result.err = _wire->getIndexByHandle(_handle, index); // the sensor may have left at a rescan
+    if (result.err == NBD_NO_ERROR)
+        _wire->getSnapshotByIndex(index, result.reading, result.err);
+    return result;
+}
+
+NBD_SleepAwaiter::NBD_SleepAwaiter(unsigned long ms) : _start(millis()), _ms(ms)
+{
+}
+
+bool NBD_SleepAwaiter::poll()
+{
+    return millis() - _start >= _ms;
+}
+
+unsigned long NBD_SleepAwaiter::getMillisToReady()
+{
+    unsigned long elapsed = millis() - _start;
+    return elapsed >= _ms ? 0 : _ms - elapsed;
+}
+
+NBD_Executor *NBD_Executor::_current = nullptr;
+
+NBD_Executor::NBD_Executor(NonBlockingDallasArray *array) : _array(array), _wire(nullptr)
+{
+}
+
+NBD_Executor::NBD_Executor(NonBlockingDallas *wire) : _array(nullptr), _wire(wire)
+{
+}
+
+/**
+ * Destroys the tasks that did not end, with the coroutines they await.
+ */
+NBD_Executor::~NBD_Executor()
+{
+    _waiting.clear();
+    for (size_t i = 0; i < _tasks.size(); i++)
+    {
+        _tasks[i].destroy();
+    }
+}
+
+/**
+ * Returns the executor resuming coroutines on this thread, the awaiters park there.
+ *
+ * @return the executor or nullptr outside of spawn() and runOnce()
+ */
+NBD_Executor *NBD_Executor::current()
+{
+    return _current;
+}
+
+/**
+ * Keeps a suspended coroutine until its awaiter is ready. Called by the awaiters.
+ *
+ * @param awaiter the awaiter, it lives in the coroutine frame
+ */
+void NBD_Executor::park(NBD_Awaiter *awaiter)
+{
+    _waiting.push_back(awaiter);
+}
+
+/**
+ * Starts a task. It runs until its first suspension before spawn() returns, the executor owns
+ * it and destroys it when it ends.
+ *
+ * @param task the task
+ */
+void NBD_Executor::spawn(NBD_Task<> task)
+{
+    std::coroutine_handle<> handle = task.release();
+    if (!handle)
+        return;
+    _tasks.push_back(handle);
+    NBD_Executor *previous = _current;
+    _current = this;
+    handle.resume();
+    _current = previous;
+    reap();
+}
+
+/**
+ * Runs the state machine once, then resumes every coroutine whose awaited reading arrived.
+ *
+ * @return true while spawned tasks are running
+ */
+bool NBD_Executor::runOnce()
+{
+    NBD_Executor *previous = _current;
+    _current = this;
+    if (_array)
+        _array->update();
+    else if (_wire)
+        _wire->update();
+    resumeReady();
+    _current = previous;
+    reap();
+    return !_tasks.empty();
+}
+
+/**
+ * Runs until every spawned task ended, sleeping between the deadlines of the state machine.
+ */
+void NBD_Executor::run()
+{
+    while (runOnce())
+    {
+        unsigned long ms = getMillisToNextPoll();
+        if (ms == 0)
+            continue;
+#if defined(NBD_STD_THREAD)
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+#else
+        delay(ms);
+#endif
+    }
+}
+
+/**
+ * @return the running tasks spawned on the executor
+ */
+size_t NBD_Executor::getTaskCount()
+{
+    return _tasks.size();
+}
+
+/**
+ * Tells how long runOnce() has nothing to do: the readings only arrive in update(), unless the
+ * wires run in their own tasks, then they are polled every NBD_EXECUTOR_POLL_MILLIS.
+ *
+ * @return milliseconds until runOnce() should be called, at most NBD_EXECUTOR_MAX_SLEEP_MILLIS
+ */
+unsigned long NBD_Executor::getMillisToNextPoll()
+{
+    unsigned long next = NBD_EXECUTOR_MAX_SLEEP_MILLIS;
+    unsigned long ms = NBD_NO_DEADLINE;
+    if (_array)
+        ms = _array->isRunningTasks() ? NBD_EXECUTOR_POLL_MILLIS : _array->getMillisToNextUpdate();
+    else if (_wire)
+        ms = _wire->getMillisToNextUpdate();
+    if (ms < next)
+        next = ms;
+    for (size_t i = 0; i < _waiting.size(); i++)
+    {
+        ms = _waiting[i]->getMillisToReady();
+        if (ms < next)
+            next = ms;
+    }
+    return next;
+}
+
+void NBD_Executor::resumeReady()
+{
+    _polling.swap(_waiting); // resumed coroutines may park again
+    for (size_t i = 0; i < _polling.size(); i++)
+    {
+        NBD_Awaiter *awaiter = _polling[i];
+        if (awaiter->poll())
+            awaiter->_handle.resume();
+        else
+            _waiting.push_back(awaiter);
+    }
+    _polling.clear();
+}
+
+void NBD_Executor::reap()
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < _tasks.size(); i++)
+    {
+        if (_tasks[i].done())
+            _tasks[i].destroy();
+        else
+            _tasks[kept++] = _tasks[i];
+    }
+    _tasks.resize(kept);
+}
+#endif
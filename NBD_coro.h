@@ -0,0 +1,259 @@
+#ifndef NBD_CORO_H
+#define NBD_CORO_H
+
+#include "NonBlockingDallasArray.h"
+
+#if defined(NBD_HAS_COROUTINES)
+#include <assert.h>
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef NBD_EXECUTOR_MAX_SLEEP_MILLIS
+#define NBD_EXECUTOR_MAX_SLEEP_MILLIS 1000 //Longest idle sleep of NBD_Executor::run() [milliseconds]
+#endif
+#define NBD_EXECUTOR_POLL_MILLIS 10        //Idle sleep while the wires run in their own tasks [milliseconds]
+
+/*
+Awaitable API for C++20 builds (e.g. a host gateway built with -std=c++20). It runs on the
+existing state machine: the awaiters only watch the cycle counters and the priority read tickets
+of the wires, NBD_Executor calls update() and resumes the coroutines whose reading arrived, all
+on the calling thread.
+
+    NBD_Task<> logger(NonBlockingDallasArray &array)
+    {
+        for (;;)
+        {
+            co_await array.readAll();
+            ...getSnapshot()...
+        }
+    }
+
+    NBD_Task<> watch(NonBlockingDallasArray &array, NBD_handle_t handle)
+    {
+        NBD_ReadResult r = co_await array.readSensor(handle);
+        ...
+    }
+
+    NBD_Executor executor(&array);
+    executor.spawn(logger(array));
+    executor.spawn(watch(array, handle));
+    executor.run();
+*/
+
+struct NBD_ReadResult
+{
+    ENUM_NBD_ERROR err = NBD_NO_ERROR;  //NBD_HANDLE_IS_NOT_VALID if the sensor is gone
+    NBD_SensorSnapshot reading;         //The published reading of the sensor, valid tells the outcome
+};
+
+struct NBD_PromiseBase
+{
+    std::coroutine_handle<> continuation;   //Coroutine awaiting the task, resumed when it ends
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+        {
+            std::coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T>
+struct NBD_Promise : NBD_PromiseBase
+{
+    T value{};
+    void return_value(T v) { value = std::move(v); }
+};
+
+template <>
+struct NBD_Promise<void> : NBD_PromiseBase
+{
+    void return_void() {}
+};
+
+/*
+Coroutine returning a T. It starts when awaited or spawned on an NBD_Executor and owns its frame.
+*/
+template <typename T = void>
+class NBD_Task
+{
+public:
+    struct promise_type : NBD_Promise<T>
+    {
+        NBD_Task get_return_object() { return NBD_Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    NBD_Task(NBD_Task &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+    NBD_Task &operator=(NBD_Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (_handle)
+                _handle.destroy();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+    ~NBD_Task()
+    {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    bool done() const { return !_handle || _handle.done(); }
+    Handle release() { return std::exchange(_handle, nullptr); }
+
+    bool await_ready() { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        _handle.promise().continuation = caller;
+        return _handle; // runs the task, it resumes the caller when it ends
+    }
+    T await_resume()
+    {
+        if constexpr (!std::is_void<T>::value)
+            return std::move(_handle.promise().value);
+    }
+
+private:
+    explicit NBD_Task(Handle handle) : _handle(handle) {}
+    NBD_Task(const NBD_Task &);
+    NBD_Task &operator=(const NBD_Task &);
+
+    Handle _handle;
+};
+
+/*
+Base of the awaitables of the library. A suspended coroutine is parked in the executor, which
+polls the awaiter after every update() and resumes the coroutine once poll() is true. Awaiting
+one in a coroutine that no executor runs is a programming error caught by an assert.
+*/
+class NBD_Awaiter
+{
+public:
+    virtual ~NBD_Awaiter() {}
+    virtual bool poll() = 0;                                    //True when the awaited event happened
+    virtual unsigned long getMillisToReady() { return NBD_NO_DEADLINE; } //Only for timed awaiters
+
+    bool await_ready() { return poll(); }
+    void await_suspend(std::coroutine_handle<> handle);
+
+private:
+    std::coroutine_handle<> _handle;
+    friend class NBD_Executor;
+};
+
+/*
+Completes after the next full read cycle of every wire: idle wires start a conversion right
+away, wires already converting finish their running one.
+*/
+class NBD_ReadAllAwaiter : public NBD_Awaiter
+{
+public:
+    explicit NBD_ReadAllAwaiter(NonBlockingDallas *wire);
+    explicit NBD_ReadAllAwaiter(const std::vector<NonBlockingDallas *> &wires);
+
+    bool poll() override;
+    void await_resume() {}
+
+private:
+    struct Pending
+    {
+        NonBlockingDallas *wire;
+        uint32_t cycle;     //getCycleCount() when awaited
+        bool requested;     //The conversion was started by the awaiter
+    };
+    std::vector<Pending> _pending;
+
+    void add(NonBlockingDallas *wire);
+};
+
+/*
+Completes when a priority read of the sensor is done, see requestPriorityReadByIndex(). Waits
+its turn if another priority read is pending on the wire.
+*/
+class NBD_SensorReadAwaiter : public NBD_Awaiter
+{
+public:
+    NBD_SensorReadAwaiter(NonBlockingDallas *wire, NBD_handle_t handle);
+
+    bool poll() override;
+    NBD_ReadResult await_resume();
+
+private:
+    NonBlockingDallas  *_wire;
+    NBD_handle_t       _handle;
+    NBD_PriorityTicket _ticket;
+    ENUM_NBD_ERROR     _err;
+    bool               _requested;
+};
+
+class NBD_SleepAwaiter : public NBD_Awaiter
+{
+public:
+    explicit NBD_SleepAwaiter(unsigned long ms);
+
+    bool poll() override;
+    unsigned long getMillisToReady() override;
+    void await_resume() {}
+
+private:
+    unsigned long _start;
+    unsigned long _ms;
+};
+
+//Suspends the calling coroutine for ms milliseconds without blocking the executor
+inline NBD_SleepAwaiter NBD_sleep(unsigned long ms)
+{
+    return NBD_SleepAwaiter(ms);
+}
+
+/*
+Single threaded executor of the coroutines. run() or runOnce() drive the array (or the wire)
+like update() does, so there is nothing else to call in the loop. Between two updates run()
+sleeps until the next deadline of the state machine. Not thread safe: spawn and run on one thread.
+*/
+class NBD_Executor
+{
+public:
+    explicit NBD_Executor(NonBlockingDallasArray *array);
+    explicit NBD_Executor(NonBlockingDallas *wire);
+    ~NBD_Executor();
+
+    void     spawn(NBD_Task<> task);
+    bool     runOnce();
+    void     run();
+    size_t   getTaskCount();
+    unsigned long getMillisToNextPoll();
+
+    static NBD_Executor *current();
+    void     park(NBD_Awaiter *awaiter);
+
+private:
+    NonBlockingDallasArray               *_array;
+    NonBlockingDallas                    *_wire;
+    std::vector<std::coroutine_handle<>> _tasks;     //Spawned tasks, destroyed when they end
+    std::vector<NBD_Awaiter *>           _waiting;   //Awaiters of the suspended coroutines
+    std::vector<NBD_Awaiter *>           _polling;   //Scratch list of runOnce()
+    static NBD_Executor                  *_current;  //Executor resuming coroutines right now
+
+    void resumeReady();
+    void reap();
+    NBD_Executor(const NBD_Executor &);
+    NBD_Executor &operator=(const NBD_Executor &);
+};
+#endif
+#endif /* NBD_CORO_H */
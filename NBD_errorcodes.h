@@ -7,6 +7,16 @@ enum ENUM_NBD_ERROR
     NBD_NO_ERROR =0,               //No error.
     NBD_INDEX_IS_OUT_OF_RANGE,     //Index is out of bound.
     NBD_ADDRESS_IS_NOT_FOUND,      //Device address is not found.
-    NBD_NAME_NOT_FOUND             //Name is not found.
+    NBD_NAME_NOT_FOUND,            //Name is not found.
+    NBD_SENSOR_DISCONNECTED,       //The sensor did not answer.
+    NBD_CRC_ERROR,                 //Scratchpad CRC mismatch.
+    NBD_POWER_ON_RESET,            //The sensor returned the 85 °C power-on value.
+    NBD_SENSOR_QUARANTINED,        //The sensor failed repeatedly and is read with backoff.
+    NBD_REQUEST_PENDING,           //A priority read is already pending on the wire.
+    NBD_HANDLE_IS_NOT_VALID,       //The sensor of the handle is gone or the handle is malformed.
+    NBD_GROUP_NOT_FOUND,           //No group with the name.
+    NBD_NAME_TOO_LONG,             //The name is longer than NBD_NAME_LIMIT.
+    NBD_NAME_TABLE_FULL,           //No memory or no id is left for another name.
+    NBD_FILTER_REJECTED            //The spike filter rejected the reading, the last value is kept.
 };
 #endif
\ No newline at end of file
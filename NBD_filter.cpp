@@ -0,0 +1,125 @@
+#include "NBD_filter.h"
+
+NBD_SignalFilter::NBD_SignalFilter()
+{
+    reset();
+}
+
+/**
+ * Forgets every previous sample. The next sample passes through unchanged.
+ */
+void NBD_SignalFilter::reset()
+{
+    for (uint8_t i = 0; i < NBD_FILTER_MEDIAN_MAX; i++)
+    {
+        _median[i] = 0;
+    }
+    _emaAcc = 0;
+    _last = 0;
+    _medianCount = 0;
+    _medianPos = 0;
+    _emaShift = 0;
+    _rejects = 0;
+    _primed = false;
+}
+
+/**
+ * Runs one raw sample through the enabled filter stages.
+ *
+ * @param cfg the filter settings of the sensor
+ * @param raw the raw sample (1/128 °C), replaced by the filtered value if accepted
+ *
+ * @return false if the sample was rejected as a spike or as a power-on reset value
+ */
+bool NBD_SignalFilter::process(const NBD_FilterConfig &cfg, int32_t &raw)
+{
+    if (!accept(cfg, raw))
+    {
+        return false;
+    }
+    _last = raw;
+
+    uint8_t window = cfg.medianWindow;
+    if (window > NBD_FILTER_MEDIAN_MAX)
+        window = NBD_FILTER_MEDIAN_MAX;
+    if (window > 1)
+    {
+        _median[_medianPos] = raw;
+        _medianPos = (_medianPos + 1) % NBD_FILTER_MEDIAN_MAX;
+        if (_medianCount < NBD_FILTER_MEDIAN_MAX)
+            _medianCount++;
+        raw = median(window);
+    }
+
+    uint8_t shift = (cfg.emaShift > 8) ? 8 : cfg.emaShift;
+    if (shift > 0)
+    {
+        if (!_primed || _emaShift != shift)
+        {
+            _emaAcc = raw * (1L << shift);
+            _emaShift = shift;
+        }
+        else
+        {
+            _emaAcc += raw - (_emaAcc / (1L << shift));
+        }
+        raw = _emaAcc / (1L << shift);
+    }
+    _primed = true;
+    return true;
+}
+
+//==============================================================================================
+//                                  PRIVATE
+//==============================================================================================
+
+bool NBD_SignalFilter::accept(const NBD_FilterConfig &cfg, int32_t raw)
+{
+    bool suspicious = false;
+    int32_t delta = _primed ? raw - _last : 0;
+    if (delta < 0)
+        delta = -delta;
+
+    if (cfg.rejectPowerOnReset && raw == NBD_RAW_POWER_ON_RESET)
+    {
+        suspicious = !_primed || delta > NBD_RAW_RESET_CONFIRM_BAND;
+    }
+    if (cfg.maxStepRaw > 0 && _primed && delta > cfg.maxStepRaw)
+    {
+        suspicious = true;
+    }
+
+    if (suspicious && _rejects < NBD_FILTER_MAX_REJECTS)
+    {
+        _rejects++;
+        return false;
+    }
+    if (suspicious)
+    {
+        // The value persisted: it is a real step, restart the smoothing from here
+        _medianCount = 0;
+        _medianPos = 0;
+        _primed = false;
+    }
+    _rejects = 0;
+    return true;
+}
+
+int32_t NBD_SignalFilter::median(uint8_t window)
+{
+    int32_t sorted[NBD_FILTER_MEDIAN_MAX];
+    uint8_t n = (_medianCount < window) ? _medianCount : window;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        // newest n samples, insertion sort
+        int32_t v = _median[(_medianPos + NBD_FILTER_MEDIAN_MAX - 1 - i) % NBD_FILTER_MEDIAN_MAX];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[n / 2];
+}
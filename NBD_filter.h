@@ -0,0 +1,50 @@
+#ifndef NBD_FILTER_H
+#define NBD_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NBD_FILTER_MEDIAN_MAX       5       //Maximum length of the median window
+#define NBD_FILTER_MAX_REJECTS      3       //After this many consecutive rejects the new level is accepted
+#define NBD_RAW_POWER_ON_RESET      10880   //85.0 °C in DallasTemperature raw units (1/128 °C)
+#define NBD_RAW_RESET_CONFIRM_BAND  256     //2.0 °C, 85 °C is trusted only near the previous reading
+
+/*
+Per-sensor filter settings. All thresholds are in DallasTemperature raw units (1/128 °C),
+so the filter works on integers and does not depend on the unit of measure.
+A default constructed config disables every stage.
+*/
+struct NBD_FilterConfig
+{
+    uint8_t emaShift = 0;               //Exponential moving average with weight 1/2^emaShift (0=off, max 8)
+    uint8_t medianWindow = 0;           //Median of the last N samples (0 or 1=off, max NBD_FILTER_MEDIAN_MAX)
+    int32_t maxStepRaw = 0;             //Largest accepted change between two readings (0=off)
+    bool    rejectPowerOnReset = false; //Drop 85 °C power-on values not confirmed by the previous reading
+};
+
+/*
+Streaming filter state of one sensor. Fixed size, no heap and integer arithmetic only.
+Stages run in this order: 85 °C reset detection, spike rejection, median, EMA.
+*/
+class NBD_SignalFilter
+{
+public:
+    NBD_SignalFilter();
+
+    void reset();
+    bool process(const NBD_FilterConfig &cfg, int32_t &raw); //false if the sample is rejected, otherwise raw is replaced by the filtered value
+
+private:
+    int32_t _median[NBD_FILTER_MEDIAN_MAX]; //Last samples, ring buffer
+    int32_t _emaAcc;                        //EMA accumulator, scaled by 2^emaShift
+    int32_t _last;                          //Last accepted (unfiltered) sample
+    uint8_t _medianCount;
+    uint8_t _medianPos;
+    uint8_t _emaShift;                      //Shift the accumulator was primed with
+    uint8_t _rejects;                       //Consecutive rejected samples
+    bool    _primed;
+
+    bool    accept(const NBD_FilterConfig &cfg, int32_t raw);
+    int32_t median(uint8_t window);
+};
+#endif /* NBD_FILTER_H */
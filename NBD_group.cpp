@@ -0,0 +1,188 @@
+#include "NBD_group.h"
+
+#define NBD_MIN_HEAP 0
+#define NBD_MAX_HEAP 1
+
+NBD_SensorGroup::NBD_SensorGroup()
+{
+    _sum = 0;
+    _valid = 0;
+}
+
+/**
+ * Adds a sensor to the group. Its reading counts from its next update().
+ *
+ * @param handle the handle of the sensor
+ *
+ * @return the index of the member, passed to update()
+ */
+uint16_t NBD_SensorGroup::addMember(NBD_handle_t handle)
+{
+    Member m;
+    m.handle = handle;
+    m.raw = 0;
+    m.valid = false;
+    m.heapPos[NBD_MIN_HEAP] = 0;
+    m.heapPos[NBD_MAX_HEAP] = 0;
+    _members.push_back(m);
+    return _members.size() - 1;
+}
+
+/**
+ * Removes a member and its reading from the aggregates. The last member moves to the index of
+ * the removed one, so the caller must renumber it if it was not the removed one.
+ *
+ * @param member the index returned by addMember()
+ *
+ * @return true if the mean, min, max or valid count changed
+ */
+bool NBD_SensorGroup::removeMember(uint16_t member)
+{
+    bool changed = false;
+    if (_members[member].valid)
+        changed = update(member, 0, false);
+    uint16_t last = _members.size() - 1;
+    if (member != last)
+    {
+        bool valid = _members[last].valid;
+        if (valid)
+            heapErase(last);
+        _members[member] = _members[last];
+        if (valid)
+            heapInsert(member);
+    }
+    _members.pop_back();
+    return changed;
+}
+
+/**
+ * Stores the new reading of a member and updates the aggregates.
+ *
+ * @param member the index returned by addMember()
+ * @param raw the reading [1/128 °C]
+ * @param valid false if the sensor has no valid reading
+ *
+ * @return true if the mean, min, max or valid count changed
+ */
+bool NBD_SensorGroup::update(uint16_t member, int32_t raw, bool valid)
+{
+    int64_t sum = _sum;
+    uint16_t count = _valid;
+    int32_t min = getMinRaw();
+    int32_t max = getMaxRaw();
+
+    Member &m = _members[member];
+    bool wasValid = m.valid;
+    if (wasValid)
+    {
+        _sum -= m.raw;
+        _valid--;
+    }
+    m.raw = raw;
+    m.valid = valid;
+    if (valid)
+    {
+        _sum += raw;
+        _valid++;
+    }
+
+    if (wasValid && !valid)
+        heapErase(member);
+    else if (!wasValid && valid)
+        heapInsert(member);
+    else if (valid)
+        heapFix(member);
+    return sum != _sum || count != _valid || min != getMinRaw() || max != getMaxRaw();
+}
+
+/**
+ * Returns the mean of the valid readings, rounded to the nearest raw unit.
+ *
+ * @return the mean [1/128 °C], 0 if there is no valid reading
+ */
+int32_t NBD_SensorGroup::getMeanRaw() const
+{
+    if (_valid == 0)
+        return 0;
+    int64_t half = (_sum >= 0) ? _valid / 2 : -(int64_t)(_valid / 2);
+    return (int32_t)((_sum + half) / _valid);
+}
+
+bool NBD_SensorGroup::before(int which, uint16_t a, uint16_t b) const
+{
+    return which == NBD_MIN_HEAP ? _members[a].raw < _members[b].raw : _members[a].raw > _members[b].raw;
+}
+
+void NBD_SensorGroup::place(int which, size_t pos, uint16_t member)
+{
+    heap(which)[pos] = member;
+    _members[member].heapPos[which] = pos;
+}
+
+void NBD_SensorGroup::siftUp(int which, size_t pos)
+{
+    std::vector<uint16_t> &h = heap(which);
+    uint16_t member = h[pos];
+    while (pos > 0)
+    {
+        size_t parent = (pos - 1) / 2;
+        if (!before(which, member, h[parent]))
+            break;
+        place(which, pos, h[parent]);
+        pos = parent;
+    }
+    place(which, pos, member);
+}
+
+void NBD_SensorGroup::siftDown(int which, size_t pos)
+{
+    std::vector<uint16_t> &h = heap(which);
+    uint16_t member = h[pos];
+    for (;;)
+    {
+        size_t child = 2 * pos + 1;
+        if (child >= h.size())
+            break;
+        if (child + 1 < h.size() && before(which, h[child + 1], h[child]))
+            child++;
+        if (!before(which, h[child], member))
+            break;
+        place(which, pos, h[child]);
+        pos = child;
+    }
+    place(which, pos, member);
+}
+
+void NBD_SensorGroup::heapInsert(uint16_t member)
+{
+    for (int which = NBD_MIN_HEAP; which <= NBD_MAX_HEAP; which++)
+    {
+        heap(which).push_back(member);
+        siftUp(which, heap(which).size() - 1);
+    }
+}
+
+void NBD_SensorGroup::heapErase(uint16_t member)
+{
+    for (int which = NBD_MIN_HEAP; which <= NBD_MAX_HEAP; which++)
+    {
+        std::vector<uint16_t> &h = heap(which);
+        size_t pos = _members[member].heapPos[which];
+        uint16_t moved = h.back();
+        h.pop_back();
+        if (moved == member)
+            continue; // it was the last entry
+        place(which, pos, moved);
+        siftUp(which, pos);
+        siftDown(which, _members[moved].heapPos[which]);
+    }
+}
+
+void NBD_SensorGroup::heapFix(uint16_t member)
+{
+    for (int which = NBD_MIN_HEAP; which <= NBD_MAX_HEAP; which++)
+    {
+        siftUp(which, _members[member].heapPos[which]);
+        siftDown(which, _members[member].heapPos[which]);
+    }
+}
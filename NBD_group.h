@@ -0,0 +1,66 @@
+#ifndef NBD_GROUP_H
+#define NBD_GROUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "NBD_handle.h"
+
+/*
+Aggregates of a group in the unit of measure of the array.
+*/
+struct NBD_GroupStats
+{
+    float    min = 0;            //Lowest valid temperature
+    float    max = 0;            //Highest valid temperature
+    float    mean = 0;           //Mean of the valid temperatures
+    uint16_t validCount = 0;     //Members with a valid reading
+    uint16_t memberCount = 0;
+};
+
+/*
+Sensors grouped across wires with incrementally maintained aggregates in raw units (1/128 °C).
+A reading updates the sum and the valid count in O(1). Min and max are the roots of two binary
+heaps of the valid members, indexed by member, so a reading or a removal costs O(log n) even
+when the member holding the extremum moves.
+*/
+class NBD_SensorGroup
+{
+public:
+    NBD_SensorGroup();
+
+    uint16_t     addMember(NBD_handle_t handle);         //Returns the member index, the member starts invalid
+    bool         removeMember(uint16_t member);          //The last member takes its index, true if an aggregate changed
+    uint16_t     getMemberCount() const { return _members.size(); }
+    NBD_handle_t getMember(uint16_t member) const { return _members[member].handle; }
+    bool         update(uint16_t member, int32_t raw, bool valid); //true if an aggregate changed
+
+    uint16_t     getValidCount() const { return _valid; }
+    int32_t      getMinRaw() const { return _minHeap.empty() ? 0 : _members[_minHeap[0]].raw; } //0 if getValidCount() is 0
+    int32_t      getMaxRaw() const { return _maxHeap.empty() ? 0 : _members[_maxHeap[0]].raw; }
+    int32_t      getMeanRaw() const;
+
+private:
+    struct Member
+    {
+        NBD_handle_t handle;
+        int32_t raw;
+        bool valid;
+        uint16_t heapPos[2];     //Position in _minHeap and _maxHeap while valid
+    };
+    std::vector<Member> _members;
+    std::vector<uint16_t> _minHeap; //Valid members, the lowest reading first
+    std::vector<uint16_t> _maxHeap; //Valid members, the highest reading first
+    int64_t  _sum;               //Sum of the valid readings
+    uint16_t _valid;             //Number of valid readings
+
+    std::vector<uint16_t> &heap(int which) { return which == 0 ? _minHeap : _maxHeap; }
+    bool before(int which, uint16_t a, uint16_t b) const;
+    void place(int which, size_t pos, uint16_t member);
+    void siftUp(int which, size_t pos);
+    void siftDown(int which, size_t pos);
+    void heapInsert(uint16_t member);
+    void heapErase(uint16_t member);
+    void heapFix(uint16_t member);
+};
+#endif /* NBD_GROUP_H */
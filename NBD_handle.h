@@ -0,0 +1,43 @@
+#ifndef NBD_HANDLE_H
+#define NBD_HANDLE_H
+
+#include <stdint.h>
+
+/*
+Opaque identifier of a sensor: wire slot (bits 24..31), sensor slot (bits 16..23), generation (bits 0..15).
+The wire slot is the position of the wire in NonBlockingDallasArray (0 for a standalone wire).
+A sensor keeps its sensor slot across rescans; when it leaves the wire the generation of its slot
+is bumped, so old handles are recognised as invalid even after the slot is reused.
+*/
+typedef uint32_t NBD_handle_t;
+
+#define NBD_INVALID_HANDLE 0xFFFFFFFFUL
+
+/*
+Global index of a sensor in NonBlockingDallasArray. A single wire holds at most 255 sensors and
+keeps unsigned char indices.
+*/
+typedef uint16_t NBD_index_t;
+
+#define NBD_INDEX_MAX 0xFFFF
+
+inline NBD_handle_t NBD_makeHandle(uint8_t wireSlot, uint8_t sensorSlot, uint16_t generation)
+{
+    return ((uint32_t)wireSlot << 24) | ((uint32_t)sensorSlot << 16) | generation;
+}
+
+inline uint8_t NBD_handleWire(NBD_handle_t handle)
+{
+    return (uint8_t)(handle >> 24);
+}
+
+inline uint8_t NBD_handleSensor(NBD_handle_t handle)
+{
+    return (uint8_t)(handle >> 16);
+}
+
+inline uint16_t NBD_handleGeneration(NBD_handle_t handle)
+{
+    return (uint16_t)handle;
+}
+#endif /* NBD_HANDLE_H */
@@ -0,0 +1,186 @@
+#include "NBD_history.h"
+
+NBD_SensorHistory::NBD_SensorHistory()
+{
+    _head = 0;
+    _count = 0;
+    _tierCount = 0;
+}
+
+/**
+ * Allocates the ring buffers. Calling it again drops the recorded history.
+ *
+ * @param samples number of raw samples kept
+ * @param tiers the rollup tiers, from the finest to the coarsest
+ * @param tierCount number of tiers, at most NBD_HISTORY_MAX_TIERS
+ */
+void NBD_SensorHistory::begin(uint16_t samples, const NBD_HistoryTier *tiers, uint8_t tierCount)
+{
+    _samples.assign(samples, NBD_HistorySample());
+    _samples.shrink_to_fit();
+    _tierCount = (tiers == nullptr) ? 0 : (tierCount > NBD_HISTORY_MAX_TIERS ? NBD_HISTORY_MAX_TIERS : tierCount);
+    for (uint8_t i = 0; i < NBD_HISTORY_MAX_TIERS; i++)
+    {
+        if (i < _tierCount && tiers[i].periodMillis > 0)
+        {
+            _tiers[i].config = tiers[i];
+            _tiers[i].ring.assign(tiers[i].buckets, NBD_HistoryRollup());
+        }
+        else
+        {
+            _tiers[i].config = NBD_HistoryTier{0, 0};
+            _tiers[i].ring.clear();
+        }
+        _tiers[i].ring.shrink_to_fit();
+    }
+    clear();
+}
+
+/**
+ * Drops the recorded samples and rollups, keeping the allocated memory.
+ */
+void NBD_SensorHistory::clear()
+{
+    _head = 0;
+    _count = 0;
+    for (uint8_t i = 0; i < NBD_HISTORY_MAX_TIERS; i++)
+    {
+        _tiers[i].head = 0;
+        _tiers[i].count = 0;
+        _tiers[i].sum = 0;
+        _tiers[i].open.count = 0;
+    }
+}
+
+bool NBD_SensorHistory::isEnabled() const
+{
+    return !_samples.empty() || _tierCount > 0;
+}
+
+/**
+ * Records a valid reading.
+ *
+ * @param time millis() of the reading
+ * @param raw temperature in raw units (1/128 °C)
+ */
+void NBD_SensorHistory::add(unsigned long time, int32_t raw)
+{
+    int16_t value = (int16_t)raw; //DS18B20 range fits in 16 bits
+
+    if (!_samples.empty())
+    {
+        _samples[_head].time = time;
+        _samples[_head].raw = value;
+        _head = (_head + 1) % _samples.size();
+        if (_count < _samples.size())
+            _count++;
+    }
+
+    for (uint8_t i = 0; i < _tierCount; i++)
+    {
+        Tier &tier = _tiers[i];
+        if (tier.config.periodMillis == 0)
+            continue;
+        if (tier.open.count > 0 && time - tier.open.start >= tier.config.periodMillis)
+        {
+            closePeriod(tier);
+        }
+        if (tier.open.count == 0)
+        {
+            tier.open.start = time - (time % tier.config.periodMillis);
+            tier.open.min = value;
+            tier.open.max = value;
+            tier.sum = 0;
+        }
+        if (value < tier.open.min)
+            tier.open.min = value;
+        if (value > tier.open.max)
+            tier.open.max = value;
+        tier.sum += value;
+        tier.open.count++;
+    }
+}
+
+/**
+ * Copies the raw samples recorded between from and to (inclusive) into out, oldest first.
+ *
+ * @param from millis() of the first sample of interest
+ * @param to millis() of the last sample of interest
+ * @param out caller provided buffer
+ * @param max capacity of out
+ *
+ * @return the number of samples copied
+ */
+uint16_t NBD_SensorHistory::getSamples(unsigned long from, unsigned long to, NBD_HistorySample *out, uint16_t max) const
+{
+    uint16_t n = 0;
+    if (_samples.empty() || out == nullptr)
+        return 0;
+    uint16_t first = (_head + _samples.size() - _count) % _samples.size();
+    for (uint16_t i = 0; i < _count && n < max; i++)
+    {
+        const NBD_HistorySample &s = _samples[(first + i) % _samples.size()];
+        if (inRange(s.time, from, to))
+            out[n++] = s;
+    }
+    return n;
+}
+
+/**
+ * Copies the rollups of a tier whose period starts between from and to (inclusive) into out, oldest first.
+ * The period still being accumulated is included as the last element.
+ *
+ * @param tier index of the tier as passed to begin()
+ * @param from millis() of interest
+ * @param to millis() of interest
+ * @param out caller provided buffer
+ * @param max capacity of out
+ *
+ * @return the number of rollups copied
+ */
+uint16_t NBD_SensorHistory::getRollups(uint8_t tier, unsigned long from, unsigned long to, NBD_HistoryRollup *out, uint16_t max) const
+{
+    uint16_t n = 0;
+    if (tier >= _tierCount || out == nullptr)
+        return 0;
+    const Tier &t = _tiers[tier];
+    if (!t.ring.empty())
+    {
+        uint16_t first = (t.head + t.ring.size() - t.count) % t.ring.size();
+        for (uint16_t i = 0; i < t.count && n < max; i++)
+        {
+            const NBD_HistoryRollup &r = t.ring[(first + i) % t.ring.size()];
+            if (inRange(r.start, from, to))
+                out[n++] = r;
+        }
+    }
+    if (t.open.count > 0 && n < max && inRange(t.open.start, from, to))
+    {
+        out[n] = t.open;
+        out[n].mean = (int16_t)(t.sum / t.open.count);
+        n++;
+    }
+    return n;
+}
+
+//==============================================================================================
+//                                  PRIVATE
+//==============================================================================================
+
+bool NBD_SensorHistory::inRange(unsigned long t, unsigned long from, unsigned long to)
+{
+    return (t - from) <= (to - from); //millis() overflow safe
+}
+
+void NBD_SensorHistory::closePeriod(Tier &tier)
+{
+    tier.open.mean = (int16_t)(tier.sum / tier.open.count);
+    if (!tier.ring.empty())
+    {
+        tier.ring[tier.head] = tier.open;
+        tier.head = (tier.head + 1) % tier.ring.size();
+        if (tier.count < tier.ring.size())
+            tier.count++;
+    }
+    tier.open.count = 0;
+}
@@ -0,0 +1,68 @@
+#ifndef NBD_HISTORY_H
+#define NBD_HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define NBD_HISTORY_MAX_TIERS 3     //Maximum number of downsampled tiers
+
+struct NBD_HistorySample
+{
+    unsigned long time; //millis() of the reading
+    int16_t raw;        //Temperature in raw units (1/128 °C)
+};
+
+struct NBD_HistoryRollup
+{
+    unsigned long start; //millis() of the beginning of the period
+    int16_t min;         //Raw units (1/128 °C)
+    int16_t max;
+    int16_t mean;
+    uint32_t count;      //Number of samples in the period, a daily tier read every second has 86400
+};
+
+struct NBD_HistoryTier
+{
+    unsigned long periodMillis; //Length of one rollup period, e.g. 60000 for 1 minute
+    uint16_t buckets;           //Number of periods kept
+};
+
+/*
+History of one sensor: the last N raw samples in a ring buffer plus min/max/mean rollups
+at up to NBD_HISTORY_MAX_TIERS coarser tiers. All memory is allocated by begin(), add() never allocates.
+*/
+class NBD_SensorHistory
+{
+public:
+    NBD_SensorHistory();
+
+    void     begin(uint16_t samples, const NBD_HistoryTier *tiers, uint8_t tierCount);
+    void     clear();
+    bool     isEnabled() const;
+    void     add(unsigned long time, int32_t raw);
+
+    uint16_t getSamples(unsigned long from, unsigned long to, NBD_HistorySample *out, uint16_t max) const;
+    uint16_t getRollups(uint8_t tier, unsigned long from, unsigned long to, NBD_HistoryRollup *out, uint16_t max) const;
+
+private:
+    struct Tier
+    {
+        NBD_HistoryTier config;
+        std::vector<NBD_HistoryRollup> ring;
+        uint16_t head = 0;   //Next slot to write
+        uint16_t count = 0;  //Closed periods in the ring
+        NBD_HistoryRollup open; //Period being accumulated
+        int64_t sum = 0;     //Sum of the samples of the open period
+    };
+
+    std::vector<NBD_HistorySample> _samples;
+    uint16_t _head;
+    uint16_t _count;
+    Tier     _tiers[NBD_HISTORY_MAX_TIERS];
+    uint8_t  _tierCount;
+
+    static bool inRange(unsigned long t, unsigned long from, unsigned long to);
+    static void closePeriod(Tier &tier);
+};
+#endif /* NBD_HISTORY_H */
@@ -0,0 +1,264 @@
+#include "NBD_names.h"
+#include <string.h>
+#include <new>
+
+NBD_NameTable::NBD_NameTable()
+{
+    memset(_static, 0, sizeof(_static));
+    _blocks.push_back(_static);
+    size_t buckets = 1;
+    while (buckets < NBD_NAME_CAPACITY)
+        buckets <<= 1;
+    _buckets.assign(buckets, NBD_NO_NAME);
+    _free = NBD_NO_NAME;
+    _used = 0;
+    chainFree(1, NBD_NAME_CAPACITY);
+}
+
+NBD_NameTable::~NBD_NameTable()
+{
+    for (size_t b = 0; b < _blocks.size(); b++)
+    {
+        for (size_t i = 0; i < NBD_NAME_CAPACITY; i++)
+        {
+            delete[] _blocks[b][i].heapText;
+        }
+        if (b > 0)
+            delete[] _blocks[b];
+    }
+}
+
+/**
+ * @return the table shared by every wire
+ */
+NBD_NameTable &NBD_NameTable::instance()
+{
+    static NBD_NameTable table;
+    return table;
+}
+
+uint32_t NBD_NameTable::hash(const char *name, size_t length)
+{
+    uint32_t h = 2166136261UL; // FNV-1a
+    for (size_t i = 0; i < length; i++)
+    {
+        h ^= (uint8_t)name[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+NBD_NameTable::Entry &NBD_NameTable::entry(NBD_name_t id) const
+{
+    return _blocks[(id - 1) / NBD_NAME_CAPACITY][(id - 1) % NBD_NAME_CAPACITY];
+}
+
+bool NBD_NameTable::valid(NBD_name_t id) const
+{
+    return id != NBD_NO_NAME && id != NBD_NAME_UNKNOWN && (size_t)(id - 1) < _blocks.size() * NBD_NAME_CAPACITY;
+}
+
+NBD_name_t NBD_NameTable::lookup(const char *name, size_t length, uint32_t h)
+{
+    for (NBD_name_t id = _buckets[h & (_buckets.size() - 1)]; id != NBD_NO_NAME; id = entry(id).next)
+    {
+        const Entry &e = entry(id);
+        const char *text = e.heapText ? e.heapText : e.text;
+        if (e.hash == h && e.length == length && memcmp(text, name, length) == 0)
+            return id;
+    }
+    return NBD_NAME_UNKNOWN;
+}
+
+// Puts the ids first..last on the free list, lowest id first
+void NBD_NameTable::chainFree(NBD_name_t first, NBD_name_t last)
+{
+    for (NBD_name_t id = last; id >= first; id--)
+    {
+        entry(id).next = _free;
+        _free = id;
+    }
+}
+
+/**
+ * Adds a block of NBD_NAME_CAPACITY entries and resizes the hash index to the new capacity.
+ *
+ * @return false if the ids are exhausted or the block could not be allocated
+ */
+bool NBD_NameTable::grow()
+{
+    size_t capacity = _blocks.size() * NBD_NAME_CAPACITY;
+    if (capacity + NBD_NAME_CAPACITY >= NBD_NAME_UNKNOWN)
+        return false;
+    Entry *block = new (std::nothrow) Entry[NBD_NAME_CAPACITY];
+    if (!block)
+        return false;
+    memset(block, 0, sizeof(Entry) * NBD_NAME_CAPACITY);
+    _blocks.push_back(block);
+    chainFree(capacity + 1, capacity + NBD_NAME_CAPACITY);
+    capacity += NBD_NAME_CAPACITY;
+    if (_buckets.size() >= capacity)
+        return true;
+    size_t buckets = _buckets.size();
+    while (buckets < capacity)
+        buckets <<= 1;
+    _buckets.assign(buckets, NBD_NO_NAME);
+    for (NBD_name_t id = 1; id <= capacity - NBD_NAME_CAPACITY; id++)
+    {
+        Entry &e = entry(id);
+        if (!e.refs)
+            continue;
+        e.next = _buckets[e.hash & (buckets - 1)];
+        _buckets[e.hash & (buckets - 1)] = id;
+    }
+    return true;
+}
+
+/**
+ * Adds a reference to a name, storing it if nobody uses it yet.
+ *
+ * @param name the text, not necessarily terminated
+ * @param length its length
+ * @param err NBD_NAME_TOO_LONG past NBD_NAME_LIMIT, NBD_NAME_TABLE_FULL if the memory or the ids ran out
+ *
+ * @return the id, NBD_NO_NAME for the empty name or on error
+ */
+NBD_name_t NBD_NameTable::intern(const char *name, size_t length, ENUM_NBD_ERROR &err)
+{
+    err = NBD_NO_ERROR;
+    if (length == 0)
+        return NBD_NO_NAME;
+    if (length > NBD_NAME_LIMIT)
+    {
+        err = NBD_NAME_TOO_LONG;
+        return NBD_NO_NAME;
+    }
+    NBD_LockGuard guard(_lock);
+    uint32_t h = hash(name, length);
+    NBD_name_t id = lookup(name, length, h);
+    if (id != NBD_NAME_UNKNOWN)
+    {
+        entry(id).refs++;
+        return id;
+    }
+    if (_free == NBD_NO_NAME && !grow())
+    {
+        err = NBD_NAME_TABLE_FULL;
+        return NBD_NO_NAME;
+    }
+    id = _free;
+    Entry &e = entry(id);
+    char *text = e.text;
+    if (length > NBD_NAME_MAX_LENGTH)
+    {
+        text = new (std::nothrow) char[length + 1];
+        if (!text)
+        {
+            err = NBD_NAME_TABLE_FULL;
+            return NBD_NO_NAME;
+        }
+    }
+    _free = e.next;
+    memcpy(text, name, length);
+    text[length] = '\0';
+    e.heapText = (text == e.text) ? nullptr : text;
+    e.length = (uint8_t)length;
+    e.hash = h;
+    e.refs = 1;
+    e.next = _buckets[h & (_buckets.size() - 1)];
+    _buckets[h & (_buckets.size() - 1)] = id;
+    _used++;
+    return id;
+}
+
+/**
+ * Looks a name up without adding a reference, to compare it by id.
+ *
+ * @return the id, NBD_NO_NAME for the empty name, NBD_NAME_UNKNOWN if nobody uses the name
+ */
+NBD_name_t NBD_NameTable::find(const char *name, size_t length)
+{
+    if (length == 0)
+        return NBD_NO_NAME;
+    if (length > NBD_NAME_LIMIT)
+        return NBD_NAME_UNKNOWN;
+    NBD_LockGuard guard(_lock);
+    return lookup(name, length, hash(name, length));
+}
+
+void NBD_NameTable::retain(NBD_name_t id)
+{
+    NBD_LockGuard guard(_lock);
+    if (valid(id))
+        entry(id).refs++;
+}
+
+/**
+ * Drops a reference, the last one frees the entry and its heap text.
+ */
+void NBD_NameTable::release(NBD_name_t id)
+{
+    NBD_LockGuard guard(_lock);
+    if (!valid(id) || entry(id).refs == 0)
+        return;
+    Entry &e = entry(id);
+    if (--e.refs)
+        return;
+    NBD_name_t *link = &_buckets[e.hash & (_buckets.size() - 1)];
+    while (*link != id)
+        link = &entry(*link).next;
+    *link = e.next;
+    delete[] e.heapText;
+    e.heapText = nullptr;
+    e.next = _free;
+    _free = id;
+    _used--;
+}
+
+/**
+ * @return the terminated text of the name, "" for NBD_NO_NAME
+ */
+const char *NBD_NameTable::c_str(NBD_name_t id) const
+{
+    NBD_LockGuard guard(_lock);
+    if (!valid(id))
+        return "";
+    const Entry &e = entry(id);
+    return e.heapText ? e.heapText : e.text;
+}
+
+uint8_t NBD_NameTable::length(NBD_name_t id) const
+{
+    NBD_LockGuard guard(_lock);
+    if (!valid(id))
+        return 0;
+    return entry(id).length;
+}
+
+/**
+ * @return entries in use, to size NBD_NAME_CAPACITY
+ */
+uint16_t NBD_NameTable::getUsedCount()
+{
+    NBD_LockGuard guard(_lock);
+    return _used;
+}
+
+/**
+ * Replaces the name. On error the previous name is kept.
+ *
+ * @param name the text, not necessarily terminated
+ * @param length its length, 0 clears the name
+ * @param err NBD_NAME_TOO_LONG or NBD_NAME_TABLE_FULL, see NBD_NameTable::intern()
+ *
+ * @return true on success
+ */
+bool NBD_Name::set(const char *name, size_t length, ENUM_NBD_ERROR &err)
+{
+    NBD_name_t id = NBD_NameTable::instance().intern(name, length, err);
+    if (err != NBD_NO_ERROR)
+        return false;
+    NBD_NameTable::instance().release(_id);
+    _id = id;
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef NBD_NAMES_H
+#define NBD_NAMES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "NBD_errorcodes.h"
+#include "NBD_platform.h"
+#include <vector>
+
+#ifndef NBD_NAME_MAX_LENGTH
+#define NBD_NAME_MAX_LENGTH 31      //Longest name stored inline, longer ones get a heap copy [characters]
+#endif
+#ifndef NBD_NAME_CAPACITY
+#define NBD_NAME_CAPACITY   64      //Names in static storage, the table then grows by blocks of this size
+#endif
+#define NBD_NAME_LIMIT      255     //Longest sensor or wire name [characters]
+
+typedef uint16_t NBD_name_t;
+#define NBD_NO_NAME         0       //Id of the empty name
+#define NBD_NAME_UNKNOWN    0xFFFF  //Returned by find() for a name nobody uses
+
+/*
+Intern table of the sensor and wire names of the library. The first NBD_NAME_CAPACITY names
+live in static storage, then the table grows by heap blocks of the same size, so only
+installations with many names allocate. Equal names share one reference counted entry, found
+through a hash index, so names compare by id. Names longer than NBD_NAME_MAX_LENGTH get a heap
+copy of their text. Entries and texts are not moved while referenced: the pointers returned by
+c_str() stay valid until the name is released.
+*/
+class NBD_NameTable
+{
+public:
+    static NBD_NameTable &instance();
+
+    NBD_name_t  intern(const char *name, size_t length, ENUM_NBD_ERROR &err); //Adds a reference
+    NBD_name_t  find(const char *name, size_t length);                        //No reference, NBD_NAME_UNKNOWN if not interned
+    void        retain(NBD_name_t id);
+    void        release(NBD_name_t id);
+    const char *c_str(NBD_name_t id) const;
+    uint8_t     length(NBD_name_t id) const;
+    uint16_t    getUsedCount();
+
+private:
+    struct Entry
+    {
+        uint32_t   hash;
+        uint16_t   refs;                    //0 = free
+        NBD_name_t next;                    //Next entry of the hash bucket, or next free entry
+        uint8_t    length;
+        char       *heapText;               //Text longer than NBD_NAME_MAX_LENGTH, nullptr otherwise
+        char       text[NBD_NAME_MAX_LENGTH + 1];
+    };
+    Entry       _static[NBD_NAME_CAPACITY];
+    std::vector<Entry *> _blocks;           //Id n is entry (n - 1) % NBD_NAME_CAPACITY of block (n - 1) / NBD_NAME_CAPACITY
+    std::vector<NBD_name_t> _buckets;       //Hash index, first entry of each bucket, power of two sized
+    NBD_name_t  _free;                      //First free entry, NBD_NO_NAME if the table must grow
+    uint16_t    _used;
+    mutable NBD_Mutex _lock;
+
+    NBD_NameTable();
+    ~NBD_NameTable();
+    NBD_NameTable(const NBD_NameTable &);
+    NBD_NameTable &operator=(const NBD_NameTable &);
+    static uint32_t hash(const char *name, size_t length);
+    Entry          &entry(NBD_name_t id) const;
+    bool            valid(NBD_name_t id) const;
+    NBD_name_t      lookup(const char *name, size_t length, uint32_t h);
+    bool            grow();
+    void            chainFree(NBD_name_t first, NBD_name_t last);
+};
+
+/*
+Reference to an interned name, copied and destroyed like a value.
+*/
+class NBD_Name
+{
+public:
+    NBD_Name() : _id(NBD_NO_NAME) {}
+    NBD_Name(const NBD_Name &other) : _id(other._id) { NBD_NameTable::instance().retain(_id); }
+    NBD_Name(NBD_Name &&other) : _id(other._id) { other._id = NBD_NO_NAME; }
+    ~NBD_Name() { NBD_NameTable::instance().release(_id); }
+    NBD_Name &operator=(NBD_Name other)
+    {
+        NBD_name_t id = _id;
+        _id = other._id;
+        other._id = id;
+        return *this;
+    }
+
+    bool        set(const char *name, size_t length, ENUM_NBD_ERROR &err);
+    NBD_name_t  id() const { return _id; }
+    bool        empty() const { return _id == NBD_NO_NAME; }
+    const char *c_str() const { return NBD_NameTable::instance().c_str(_id); }
+    uint8_t     length() const { return NBD_NameTable::instance().length(_id); }
+
+private:
+    NBD_name_t _id;
+};
+#endif /* NBD_NAMES_H */
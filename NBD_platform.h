@@ -0,0 +1,78 @@
+#ifndef NBD_PLATFORM_H
+#define NBD_PLATFORM_H
+
+/*
+Threading primitives of the supported platforms:
+ - ESP32: FreeRTOS tasks and recursive mutexes
+ - host builds (Linux/macOS, e.g. with an Arduino emulation layer): std::thread and std::recursive_mutex
+ - everything else: single threaded, the lock is a no-op and the task mode is not available
+*/
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#define NBD_HAS_TASKS 1
+#define NBD_FREERTOS  1
+#elif defined(__linux__) || defined(__APPLE__)
+#include <thread>
+#include <mutex>
+#define NBD_HAS_TASKS  1
+#define NBD_STD_THREAD 1
+#define NBD_HOST       1
+#endif
+
+#if defined(__linux__) && !defined(ESP_PLATFORM)
+#define NBD_HAS_EPOLL 1 //Pollable file descriptor of NonBlockingDallasArray
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define NBD_HAS_COROUTINES 1 //C++20 awaitable API, see NBD_coro.h
+#endif
+#endif
+
+#define NBD_TASK_STACK_SIZE 4096 //FreeRTOS stack of a wire task [bytes]
+#define NBD_TASK_PRIORITY   1
+
+class NBD_Mutex
+{
+public:
+#if defined(NBD_FREERTOS)
+    NBD_Mutex() { _handle = xSemaphoreCreateRecursiveMutex(); }
+    ~NBD_Mutex() { vSemaphoreDelete(_handle); }
+    void lock() { xSemaphoreTakeRecursive(_handle, portMAX_DELAY); }
+    void unlock() { xSemaphoreGiveRecursive(_handle); }
+private:
+    SemaphoreHandle_t _handle;
+#elif defined(NBD_STD_THREAD)
+    void lock() { _mutex.lock(); }
+    void unlock() { _mutex.unlock(); }
+private:
+    std::recursive_mutex _mutex;
+#else
+    void lock() {}
+    void unlock() {}
+#endif
+};
+
+//Lets other tasks run while spinning on a condition
+inline void NBD_relax()
+{
+#if defined(NBD_FREERTOS)
+    taskYIELD();
+#elif defined(NBD_STD_THREAD)
+    std::this_thread::yield();
+#endif
+}
+
+class NBD_LockGuard
+{
+public:
+    NBD_LockGuard(NBD_Mutex &mutex) : _mutex(mutex) { _mutex.lock(); }
+    ~NBD_LockGuard() { _mutex.unlock(); }
+private:
+    NBD_Mutex &_mutex;
+    NBD_LockGuard(const NBD_LockGuard &);
+    NBD_LockGuard &operator=(const NBD_LockGuard &);
+};
+#endif /* NBD_PLATFORM_H */
@@ -0,0 +1,99 @@
+#include "NBD_queue.h"
+
+/**
+ * Allocates the queue.
+ *
+ * @param capacity number of readings, rounded up to a power of two, at most NBD_QUEUE_MAX_CAPACITY
+ */
+NBD_ReadingQueue::NBD_ReadingQueue(uint16_t capacity) : _head(0), _tail(0), _overflows(0)
+{
+    uint32_t size = 1;
+    while (size < capacity && size < NBD_QUEUE_MAX_CAPACITY)
+    {
+        size <<= 1;
+    }
+    _buffer.resize(size);
+    _buffer.shrink_to_fit();
+    _mask = size - 1;
+}
+
+/**
+ * Appends a reading. Must be called from a single producer.
+ *
+ * @param reading the reading
+ *
+ * @return false if the queue is full, the reading is dropped and counted
+ */
+bool NBD_ReadingQueue::push(const NBD_Reading &reading)
+{
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) > _mask)
+    {
+        _overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _buffer[tail & _mask] = reading;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Takes the oldest reading. Must be called from a single consumer.
+ *
+ * @param reading receives the reading
+ *
+ * @return false if the queue is empty
+ */
+bool NBD_ReadingQueue::pop(NBD_Reading &reading)
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    reading = _buffer[head & _mask];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Takes up to max readings at once. Must be called from a single consumer.
+ *
+ * @param out caller provided buffer
+ * @param max capacity of out
+ *
+ * @return the number of readings taken
+ */
+uint16_t NBD_ReadingQueue::pop(NBD_Reading *out, uint16_t max)
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t available = _tail.load(std::memory_order_acquire) - head;
+    uint16_t n = (available < max) ? (uint16_t)available : max;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        out[i] = _buffer[(head + i) & _mask];
+    }
+    _head.store(head + n, std::memory_order_release);
+    return n;
+}
+
+/**
+ * Returns the number of readings waiting. Only a snapshot when the other side is running.
+ */
+uint16_t NBD_ReadingQueue::size() const
+{
+    return (uint16_t)(_tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire));
+}
+
+uint16_t NBD_ReadingQueue::capacity() const
+{
+    return (uint16_t)(_mask + 1);
+}
+
+/**
+ * Returns the number of readings dropped because the queue was full.
+ */
+uint32_t NBD_ReadingQueue::getOverflowCount() const
+{
+    return _overflows.load(std::memory_order_relaxed);
+}
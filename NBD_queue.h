@@ -0,0 +1,45 @@
+#ifndef NBD_QUEUE_H
+#define NBD_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include "NBD_handle.h"
+
+#define NBD_QUEUE_MAX_CAPACITY 32768 //Largest power of two a uint16_t capacity can report
+
+struct NBD_Reading
+{
+    NBD_handle_t handle = NBD_INVALID_HANDLE; //Sensor that produced the reading
+    int32_t raw = 0;                          //Temperature in raw units (1/128 °C)
+    unsigned long time = 0;                   //millis() of the reading
+    bool valid = false;
+};
+
+/*
+Fixed size lock-free single-producer/single-consumer queue of readings.
+The producer is the task calling update(), the consumer may run on another task or core.
+When the queue is full the new reading is dropped and counted as an overflow.
+*/
+class NBD_ReadingQueue
+{
+public:
+    NBD_ReadingQueue(uint16_t capacity);
+
+    bool     push(const NBD_Reading &reading); //Producer side
+    bool     pop(NBD_Reading &reading);        //Consumer side
+    uint16_t pop(NBD_Reading *out, uint16_t max);
+
+    uint16_t size() const;
+    uint16_t capacity() const;
+    uint32_t getOverflowCount() const;
+
+private:
+    std::vector<NBD_Reading> _buffer;
+    uint32_t                 _mask;
+    std::atomic<uint32_t>    _head;      //Next slot to read, written by the consumer
+    std::atomic<uint32_t>    _tail;      //Next slot to write, written by the producer
+    std::atomic<uint32_t>    _overflows;
+};
+#endif /* NBD_QUEUE_H */
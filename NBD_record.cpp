@@ -0,0 +1,598 @@
+#include "NBD_record.h"
+#include <string.h>
+#if defined(NBD_HOST)
+#include <stdio.h>
+#endif
+
+//==============================================================================================
+//                                  RECORDING
+//==============================================================================================
+
+/**
+ * @param inner the transport doing the real bus work
+ * @param out receives the recording, it must stay valid while recording
+ */
+NBD_RecordingTransport::NBD_RecordingTransport(NBD_Transport *inner, Print *out)
+    : _inner(inner), _out(out), _recording(true), _headerWritten(false), _converting(false),
+      _deviceCount(-1), _parasite(-1), _lastMillis(0), _records(0)
+{
+}
+
+/**
+ * Pauses or resumes the recording, the calls are passed to the real transport anyway.
+ * Resume before a rescan, the device list is only recorded by rescans.
+ *
+ * @param recording false to pause
+ */
+void NBD_RecordingTransport::setRecording(bool recording)
+{
+    _recording = recording;
+}
+
+uint32_t NBD_RecordingTransport::getRecordCount()
+{
+    return _records;
+}
+
+void NBD_RecordingTransport::writeHeader()
+{
+    uint8_t header[6] = {
+        (uint8_t)NBD_RECORD_MAGIC, (uint8_t)(NBD_RECORD_MAGIC >> 8),
+        (uint8_t)(NBD_RECORD_MAGIC >> 16), (uint8_t)(NBD_RECORD_MAGIC >> 24),
+        (uint8_t)NBD_RECORD_VERSION, (uint8_t)(NBD_RECORD_VERSION >> 8)};
+    _out->write(header, sizeof(header));
+    _headerWritten = true;
+    _lastMillis = millis();
+}
+
+void NBD_RecordingTransport::writeVarint(uint32_t value)
+{
+    uint8_t buf[5];
+    uint8_t n = 0;
+    while (value >= 0x80)
+    {
+        buf[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (uint8_t)value;
+    _out->write(buf, n);
+}
+
+void NBD_RecordingTransport::writeRecord(uint8_t type)
+{
+    if (!_headerWritten)
+        writeHeader();
+    unsigned long now = millis();
+    _out->write(type);
+    writeVarint(now - _lastMillis);
+    _lastMillis = now;
+    _records++;
+}
+
+/**
+ * Writes the position of the device in the recorded device list, or the whole address if the
+ * device is not in it.
+ */
+void NBD_RecordingTransport::writeDevice(const uint8_t *address)
+{
+    for (size_t i = 0; i + 8 <= _devices.size() && i / 8 < NBD_RECORD_NO_INDEX; i += 8)
+    {
+        if (memcmp(&_devices[i], address, 8) == 0)
+        {
+            _out->write((uint8_t)(i / 8));
+            return;
+        }
+    }
+    _out->write((uint8_t)NBD_RECORD_NO_INDEX);
+    _out->write(address, 8);
+}
+
+void NBD_RecordingTransport::begin()
+{
+    _inner->begin();
+    _converting = false;
+    if (!_recording)
+        return;
+    writeRecord(NBD_REC_BEGIN);
+    _deviceCount = -1;
+    _parasite = -1;
+    _devices.clear();
+}
+
+uint8_t NBD_RecordingTransport::getDeviceCount()
+{
+    uint8_t count = _inner->getDeviceCount();
+    if (_recording && count != _deviceCount) // asked at every getSensorsCount(), only changes are kept
+    {
+        writeRecord(NBD_REC_DEVICE_COUNT);
+        _out->write(count);
+        _deviceCount = count;
+    }
+    return count;
+}
+
+bool NBD_RecordingTransport::getAddress(uint8_t *address, uint8_t index)
+{
+    bool found = _inner->getAddress(address, index);
+    if (!_recording)
+        return found;
+    writeRecord(NBD_REC_ADDRESS);
+    _out->write(index);
+    _out->write((uint8_t)found);
+    if (found)
+    {
+        _out->write(address, 8);
+        if (_devices.size() < (size_t)(index + 1) * 8)
+            _devices.resize((size_t)(index + 1) * 8, 0);
+        memcpy(&_devices[(size_t)index * 8], address, 8);
+    }
+    return found;
+}
+
+void NBD_RecordingTransport::setResolution(uint8_t bits)
+{
+    _inner->setResolution(bits);
+    if (!_recording)
+        return;
+    writeRecord(NBD_REC_RESOLUTION);
+    _out->write(bits);
+}
+
+bool NBD_RecordingTransport::isParasitePowerMode()
+{
+    bool parasite = _inner->isParasitePowerMode();
+    if (_recording && (int8_t)parasite != _parasite)
+    {
+        writeRecord(NBD_REC_PARASITE);
+        _out->write((uint8_t)parasite);
+        _parasite = parasite;
+    }
+    return parasite;
+}
+
+void NBD_RecordingTransport::requestTemperatures()
+{
+    _inner->requestTemperatures();
+    _converting = true;
+    if (_recording)
+        writeRecord(NBD_REC_REQUEST_ALL);
+}
+
+void NBD_RecordingTransport::requestTemperatureByAddress(const uint8_t *address)
+{
+    _inner->requestTemperatureByAddress(address);
+    _converting = true;
+    if (!_recording)
+        return;
+    writeRecord(NBD_REC_REQUEST_ONE);
+    writeDevice(address);
+}
+
+bool NBD_RecordingTransport::isConversionComplete()
+{
+    bool complete = _inner->isConversionComplete();
+    if (complete)
+        endConversion();
+    return complete;
+}
+
+bool NBD_RecordingTransport::drivesBus()
+{
+    return _inner->drivesBus();
+}
+
+int32_t NBD_RecordingTransport::getTempRaw(const uint8_t *address)
+{
+    endConversion();
+    unsigned long start = micros();
+    int32_t raw = _inner->getTempRaw(address);
+    unsigned long busMicros = micros() - start;
+    if (!_recording)
+        return raw;
+    writeRecord(NBD_REC_READ);
+    writeDevice(address);
+    _out->write((uint8_t)(raw == DEVICE_DISCONNECTED_RAW ? NBD_READ_NO_DEVICE : NBD_READ_OK));
+    writeVarint(((uint32_t)raw << 1) ^ (uint32_t)(raw >> 31));
+    writeVarint(busMicros);
+    return raw;
+}
+
+uint16_t NBD_RecordingTransport::millisToWaitForConversion(uint8_t bits)
+{
+    uint16_t wait = _inner->millisToWaitForConversion(bits);
+    if (!_recording)
+        return wait;
+    writeRecord(NBD_REC_CONVERSION_WAIT);
+    _out->write(bits);
+    writeVarint(wait);
+    return wait;
+}
+
+int32_t NBD_RecordingTransport::readTemp(const uint8_t *address, const NBD_ReadOptions &options, NBD_ReadStatus &status)
+{
+    endConversion();
+    unsigned long start = micros();
+    int32_t raw = _inner->readTemp(address, options, status);
+    unsigned long busMicros = micros() - start;
+    if (!_recording)
+        return raw;
+    writeRecord(NBD_REC_READ);
+    writeDevice(address);
+    _out->write((uint8_t)status);
+    writeVarint(((uint32_t)raw << 1) ^ (uint32_t)(raw >> 31));
+    writeVarint(busMicros);
+    return raw;
+}
+
+/**
+ * Records the completion of the running conversion: at the first poll reporting it complete, or
+ * at the first read when the wire times the conversion instead of polling (parasite power).
+ */
+void NBD_RecordingTransport::endConversion()
+{
+    if (!_converting)
+        return;
+    _converting = false;
+    if (_recording)
+        writeRecord(NBD_REC_COMPLETE);
+}
+
+//==============================================================================================
+//                                  REPLAY
+//==============================================================================================
+
+NBD_ReplayTransport::NBD_ReplayTransport() : _emulateBusTime(false)
+{
+    memset(_conversionWait, 0, sizeof(_conversionWait));
+    rewind();
+}
+
+/**
+ * Restarts the playback from the first recorded device list and conversion.
+ */
+void NBD_ReplayTransport::rewind()
+{
+    _scan = 0;
+    _conversion = 0;
+    _current = nullptr;
+    _served = 0;
+    _requestMillis = 0;
+    _begun = false;
+    _misses = 0;
+}
+
+/**
+ * Spends the recorded bus time of every read (busy wait), so the timing of update() matches
+ * the recorded bus. Off by default: the reads are served at memory speed.
+ *
+ * @param emulate true to spend the bus time
+ */
+void NBD_ReplayTransport::setEmulateBusTime(bool emulate)
+{
+    _emulateBusTime = emulate;
+}
+
+/**
+ * Tells if the recording is played: the last recorded conversion was requested and, if it was
+ * recorded as complete, its reads were served, so the wire published the last recorded cycle.
+ *
+ * @return true at the end of the recording
+ */
+bool NBD_ReplayTransport::isFinished()
+{
+    if (_conversion < _conversions.size())
+        return false;
+    return !_current || _current->durationMillis == NBD_NO_COMPLETION || _served >= _current->reads.size();
+}
+
+uint32_t NBD_ReplayTransport::getMissCount()
+{
+    return _misses;
+}
+
+size_t NBD_ReplayTransport::getConversionCount()
+{
+    return _conversions.size();
+}
+
+static bool readVarint(const uint8_t *data, size_t size, size_t &pos, uint32_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        if (pos >= size)
+            return false;
+        uint8_t b = data[pos++];
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Parses a recording of NBD_RecordingTransport. A truncated last record (e.g. the device was
+ * reset while recording) is ignored.
+ *
+ * @param data the recording
+ * @param size its size in bytes
+ *
+ * @return false if it is not a recording of a supported version
+ */
+bool NBD_ReplayTransport::load(const uint8_t *data, size_t size)
+{
+    _scans.clear();
+    _conversions.clear();
+    memset(_conversionWait, 0, sizeof(_conversionWait));
+    rewind();
+    if (size < 6)
+        return false;
+    uint32_t magic = (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+    if (magic != NBD_RECORD_MAGIC || (data[4] | data[5] << 8) != NBD_RECORD_VERSION)
+        return false;
+
+    size_t pos = 6;
+    uint32_t now = 0;
+    uint32_t requestTime = 0;
+    _scans.emplace_back(); // devices seen before the first begin()
+    _scans.back().parasite = false;
+    auto device = [&](uint8_t *address) -> bool
+    {
+        if (pos >= size)
+            return false;
+        uint8_t index = data[pos++];
+        if (index == NBD_RECORD_NO_INDEX)
+        {
+            if (pos + 8 > size)
+                return false;
+            memcpy(address, &data[pos], 8);
+            pos += 8;
+            return true;
+        }
+        const Scan &scan = _scans.back();
+        if (index < scan.devices.size())
+            memcpy(address, scan.devices[index].address, 8);
+        else
+            memset(address, 0, 8);
+        return true;
+    };
+    while (pos < size)
+    {
+        uint8_t type = data[pos++];
+        uint32_t delta;
+        if (!readVarint(data, size, pos, delta))
+            break;
+        now += delta;
+        bool ok = true;
+        switch (type)
+        {
+        case NBD_REC_BEGIN:
+            if (_scans.size() > 1 || !_scans.back().devices.empty())
+                _scans.emplace_back();
+            _scans.back().parasite = false;
+            break;
+        case NBD_REC_DEVICE_COUNT:
+            ok = pos < size;
+            if (ok)
+            {
+                Device none;
+                memset(&none, 0, sizeof(none));
+                _scans.back().devices.resize(data[pos++], none);
+            }
+            break;
+        case NBD_REC_ADDRESS:
+            ok = pos + 2 <= size;
+            if (ok)
+            {
+                uint8_t index = data[pos++];
+                bool found = data[pos++];
+                ok = !found || pos + 8 <= size;
+                if (ok)
+                {
+                    std::vector<Device> &devices = _scans.back().devices;
+                    if (devices.size() <= index)
+                    {
+                        Device none;
+                        memset(&none, 0, sizeof(none));
+                        devices.resize(index + 1, none);
+                    }
+                    devices[index].found = found;
+                    if (found)
+                    {
+                        memcpy(devices[index].address, &data[pos], 8);
+                        pos += 8;
+                    }
+                }
+            }
+            break;
+        case NBD_REC_PARASITE:
+            ok = pos < size;
+            if (ok)
+                _scans.back().parasite = data[pos++] != 0;
+            break;
+        case NBD_REC_RESOLUTION:
+            ok = pos < size;
+            pos++;
+            break;
+        case NBD_REC_REQUEST_ONE:
+        {
+            DeviceAddress address;
+            ok = device(address);
+        }
+            // fall through
+        case NBD_REC_REQUEST_ALL:
+            if (ok)
+            {
+                _conversions.emplace_back();
+                _conversions.back().durationMillis = NBD_NO_COMPLETION;
+                requestTime = now;
+            }
+            break;
+        case NBD_REC_COMPLETE:
+            if (!_conversions.empty())
+                _conversions.back().durationMillis = now - requestTime;
+            break;
+        case NBD_REC_READ:
+        {
+            Read read;
+            uint32_t zigzag;
+            ok = device(read.address) && pos < size;
+            if (ok)
+            {
+                read.status = (NBD_ReadStatus)data[pos++];
+                ok = readVarint(data, size, pos, zigzag) && readVarint(data, size, pos, read.busMicros);
+                read.raw = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            }
+            if (ok && !_conversions.empty())
+                _conversions.back().reads.push_back(read);
+            break;
+        }
+        case NBD_REC_CONVERSION_WAIT:
+        {
+            uint32_t wait;
+            ok = pos < size;
+            if (ok)
+            {
+                uint8_t bits = data[pos++];
+                ok = readVarint(data, size, pos, wait);
+                if (ok && bits < 13)
+                    _conversionWait[bits] = (uint16_t)wait;
+            }
+            break;
+        }
+        default:
+            ok = false; // unknown record, its length is unknown too
+            break;
+        }
+        if (!ok || pos > size)
+            break;
+    }
+    if (_scans.size() > 1 && _scans.front().devices.empty())
+        _scans.erase(_scans.begin());
+    return true;
+}
+
+#if defined(NBD_HOST)
+/**
+ * Loads a recording copied from the device, see load().
+ *
+ * @param path the file
+ *
+ * @return false if the file cannot be read or is not a recording
+ */
+bool NBD_ReplayTransport::loadFile(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    std::vector<uint8_t> data;
+    uint8_t buf[512];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    return load(data.data(), data.size());
+}
+#endif
+
+void NBD_ReplayTransport::begin()
+{
+    if (_begun && _scan + 1 < _scans.size())
+        _scan++;
+    _begun = true;
+    _current = nullptr;
+}
+
+uint8_t NBD_ReplayTransport::getDeviceCount()
+{
+    return _scan < _scans.size() ? (uint8_t)_scans[_scan].devices.size() : 0;
+}
+
+bool NBD_ReplayTransport::getAddress(uint8_t *address, uint8_t index)
+{
+    if (_scan >= _scans.size() || index >= _scans[_scan].devices.size() || !_scans[_scan].devices[index].found)
+        return false;
+    memcpy(address, _scans[_scan].devices[index].address, 8);
+    return true;
+}
+
+void NBD_ReplayTransport::setResolution(uint8_t bits)
+{
+    (void)bits;
+}
+
+bool NBD_ReplayTransport::isParasitePowerMode()
+{
+    return _scan < _scans.size() && _scans[_scan].parasite;
+}
+
+/**
+ * Starts the next recorded conversion. When the recording is over the last conversion is
+ * served again.
+ */
+void NBD_ReplayTransport::requestTemperatures()
+{
+    if (_conversion < _conversions.size())
+        _current = &_conversions[_conversion++];
+    _served = 0;
+    _requestMillis = millis();
+}
+
+void NBD_ReplayTransport::requestTemperatureByAddress(const uint8_t *address)
+{
+    (void)address;
+    requestTemperatures();
+}
+
+bool NBD_ReplayTransport::isConversionComplete()
+{
+    if (!_current || _current->durationMillis == NBD_NO_COMPLETION)
+        return false;
+    return millis() - _requestMillis >= _current->durationMillis;
+}
+
+int32_t NBD_ReplayTransport::getTempRaw(const uint8_t *address)
+{
+    NBD_ReadStatus status;
+    NBD_ReadOptions options;
+    return readTemp(address, options, status);
+}
+
+uint16_t NBD_ReplayTransport::millisToWaitForConversion(uint8_t bits)
+{
+    if (bits < 13 && _conversionWait[bits] != 0)
+        return _conversionWait[bits];
+    return NBD_Transport::millisToWaitForConversion(bits);
+}
+
+/**
+ * Serves the recorded read of the device in the current conversion.
+ */
+int32_t NBD_ReplayTransport::readTemp(const uint8_t *address, const NBD_ReadOptions &options, NBD_ReadStatus &status)
+{
+    (void)options;
+    if (_current)
+    {
+        for (size_t i = 0; i < _current->reads.size(); i++)
+        {
+            const Read &read = _current->reads[i];
+            if (memcmp(read.address, address, 8) != 0)
+                continue;
+            if (_emulateBusTime)
+            {
+                unsigned long start = micros();
+                while (micros() - start < read.busMicros)
+                {
+                }
+            }
+            _served++;
+            status = read.status;
+            return read.raw;
+        }
+    }
+    _misses++;
+    status = NBD_READ_NO_DEVICE;
+    return DEVICE_DISCONNECTED_RAW;
+}
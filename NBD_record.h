@@ -0,0 +1,153 @@
+#ifndef NBD_RECORD_H
+#define NBD_RECORD_H
+
+#include <Arduino.h>
+#include "NBD_transport.h"
+#include "NBD_platform.h"
+#include <vector>
+
+#define NBD_RECORD_MAGIC    0x52444E42UL //"NBDR" little endian, first field of a recording
+#define NBD_RECORD_VERSION  1
+#define NBD_RECORD_NO_INDEX 0xFF         //Address not in the device list, the 8 address bytes follow
+#define NBD_NO_COMPLETION   0xFFFFFFFFUL //The recorded conversion was never reported complete
+
+/*
+Record types of a bus recording. Every record is the type byte, the milliseconds since the
+previous record (varint) and the payload.
+*/
+enum NBD_RecordType : uint8_t
+{
+    NBD_REC_BEGIN = 1,          //-
+    NBD_REC_DEVICE_COUNT,       //count (1), written when it changes
+    NBD_REC_ADDRESS,            //index (1), found (1), address (8) if found
+    NBD_REC_PARASITE,           //parasite (1), written when it changes
+    NBD_REC_RESOLUTION,         //bits (1)
+    NBD_REC_REQUEST_ALL,        //-
+    NBD_REC_REQUEST_ONE,        //device (1 or 9, see NBD_RECORD_NO_INDEX)
+    NBD_REC_COMPLETE,           //- first poll reporting the conversion as complete
+    NBD_REC_READ,               //device (1 or 9), status (1), raw (zigzag varint), bus time [us] (varint)
+    NBD_REC_CONVERSION_WAIT,    //bits (1), milliseconds (varint)
+};
+
+/*
+Transport decorator that logs the device level traffic of NonBlockingDallas to a Print (a File,
+Serial...) while passing every call to the real transport: the device list, the conversion
+requests and their completion, every scratchpad read with its outcome and bus time, with the
+original timing. NBD_ReplayTransport plays the recording back. Use one recorder per wire.
+
+    NBD_DallasTransport bus(&dallas, &oneWire);
+    File f = SPIFFS.open("/wire1.nbdr", "w");
+    NBD_RecordingTransport recorder(&bus, &f);
+    NonBlockingDallas wire(&recorder, 4);
+*/
+class NBD_RecordingTransport : public NBD_Transport
+{
+public:
+    NBD_RecordingTransport(NBD_Transport *inner, Print *out);
+
+    void     begin() override;
+    uint8_t  getDeviceCount() override;
+    bool     getAddress(uint8_t *address, uint8_t index) override;
+    void     setResolution(uint8_t bits) override;
+    bool     isParasitePowerMode() override;
+    void     requestTemperatures() override;
+    void     requestTemperatureByAddress(const uint8_t *address) override;
+    bool     isConversionComplete() override;
+    int32_t  getTempRaw(const uint8_t *address) override;
+    uint16_t millisToWaitForConversion(uint8_t bits) override;
+    int32_t  readTemp(const uint8_t *address, const NBD_ReadOptions &options, NBD_ReadStatus &status) override;
+    bool     drivesBus() override;
+
+    void     setRecording(bool recording);
+    uint32_t getRecordCount();
+
+private:
+    NBD_Transport *_inner;
+    Print         *_out;
+    bool          _recording;
+    bool          _headerWritten;
+    bool          _converting;      //Requested and not yet reported complete
+    int16_t       _deviceCount;     //Last recorded, -1 = none since the last begin()
+    int8_t        _parasite;        //Last recorded, -1 = none since the last begin()
+    unsigned long _lastMillis;
+    uint32_t      _records;
+    std::vector<uint8_t> _devices;  //Recorded device list (8 bytes each), for the compact device field
+
+    void writeHeader();
+    void writeRecord(uint8_t type);
+    void writeVarint(uint32_t value);
+    void writeDevice(const uint8_t *address);
+    void endConversion();
+};
+
+/*
+Transport playing back an NBD_RecordingTransport recording, for deterministic regression tests
+and benchmarks of the library on a host. It models the recorded bus rather than checking the
+call order: every begin() brings the next recorded device list, every conversion request the
+next recorded conversion, which completes after its recorded duration and serves the recorded
+scratchpad reads. Optionally the recorded bus time of the reads is spent too.
+*/
+class NBD_ReplayTransport : public NBD_Transport
+{
+public:
+    NBD_ReplayTransport();
+
+    bool     load(const uint8_t *data, size_t size);
+#if defined(NBD_HOST)
+    bool     loadFile(const char *path);
+#endif
+    void     setEmulateBusTime(bool emulate);
+    void     rewind();
+    bool     isFinished();              //Every recorded conversion was requested and its reads served
+    uint32_t getMissCount();            //Reads of devices the recorded conversion did not read
+    size_t   getConversionCount();
+
+    void     begin() override;
+    uint8_t  getDeviceCount() override;
+    bool     getAddress(uint8_t *address, uint8_t index) override;
+    void     setResolution(uint8_t bits) override;
+    bool     isParasitePowerMode() override;
+    void     requestTemperatures() override;
+    void     requestTemperatureByAddress(const uint8_t *address) override;
+    bool     isConversionComplete() override;
+    int32_t  getTempRaw(const uint8_t *address) override;
+    uint16_t millisToWaitForConversion(uint8_t bits) override;
+    int32_t  readTemp(const uint8_t *address, const NBD_ReadOptions &options, NBD_ReadStatus &status) override;
+    bool     drivesBus() override { return false; } //The recorded completion is polled
+
+private:
+    struct Device
+    {
+        DeviceAddress address;
+        bool found;
+    };
+    struct Scan
+    {
+        std::vector<Device> devices;
+        bool parasite;
+    };
+    struct Read
+    {
+        DeviceAddress address;
+        NBD_ReadStatus status;
+        int32_t raw;
+        uint32_t busMicros;
+    };
+    struct Conversion
+    {
+        uint32_t durationMillis;        //NBD_NO_COMPLETION if it was never reported complete
+        std::vector<Read> reads;
+    };
+    std::vector<Scan>       _scans;
+    std::vector<Conversion> _conversions;
+    uint16_t                _conversionWait[13];    //Recorded millisToWaitForConversion by bits, 0 = not recorded
+    size_t                  _scan;                  //Current device list
+    size_t                  _conversion;            //Next conversion to serve
+    const Conversion        *_current;              //Conversion being served, nullptr before the first request
+    size_t                  _served;                //Reads served from _current
+    unsigned long           _requestMillis;
+    bool                    _emulateBusTime;
+    bool                    _begun;
+    uint32_t                _misses;
+};
+#endif /* NBD_RECORD_H */
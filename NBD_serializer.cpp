@@ -0,0 +1,274 @@
+#include "NBD_serializer.h"
+#include <stdio.h>
+#include <string.h>
+
+//"40.187.127.121.162.0.3.131", same format as addressToString()
+static size_t putAddress(char *p, const uint8_t *address)
+{
+    size_t n = 0;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        n += sprintf(p + n, (i < 7) ? "%u." : "%u", address[i]);
+    }
+    return n;
+}
+
+//Fixed two decimals without printf float support
+static size_t putValue(char *p, float value)
+{
+    long v = (long)(value * 100.0f + (value < 0 ? -0.5f : 0.5f));
+    const char *sign = (v < 0) ? "-" : "";
+    if (v < 0)
+        v = -v;
+    return sprintf(p, "%s%ld.%02ld", sign, v / 100, v % 100);
+}
+
+static size_t cborHead(uint8_t *p, uint8_t major, uint32_t value)
+{
+    major <<= 5;
+    if (value < 24)
+    {
+        p[0] = major | value;
+        return 1;
+    }
+    if (value <= 0xFF)
+    {
+        p[0] = major | 24;
+        p[1] = value;
+        return 2;
+    }
+    if (value <= 0xFFFF)
+    {
+        p[0] = major | 25;
+        p[1] = value >> 8;
+        p[2] = value;
+        return 3;
+    }
+    p[0] = major | 26;
+    p[1] = value >> 24;
+    p[2] = value >> 16;
+    p[3] = value >> 8;
+    p[4] = value;
+    return 5;
+}
+
+static size_t cborText(uint8_t *p, const char *text)
+{
+    size_t len = strlen(text);
+    size_t n = cborHead(p, 3, len);
+    memcpy(p + n, text, len);
+    return n + len;
+}
+
+static size_t cborInt(uint8_t *p, int32_t value)
+{
+    if (value < 0)
+        return cborHead(p, 1, (uint32_t)(-1 - value));
+    return cborHead(p, 0, (uint32_t)value);
+}
+
+static size_t cborFloat(uint8_t *p, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    p[0] = 0xFA;
+    p[1] = bits >> 24;
+    p[2] = bits >> 16;
+    p[3] = bits >> 8;
+    p[4] = bits;
+    return 5;
+}
+
+/**
+ * @param format the output format
+ * @param measurement measurement name of the line protocol, see setMeasurement()
+ */
+NBD_Serializer::NBD_Serializer(NBD_SerialFormat format, const char *measurement)
+{
+    _format = format;
+    _measurement = "temperature";
+    setMeasurement(measurement);
+    begin(nullptr, 0, 'C');
+}
+
+/**
+ * Sets the measurement name of the line protocol. The string is not copied.
+ *
+ * @param measurement the name, at most NBD_SERIALIZER_MAX_MEASUREMENT characters
+ *
+ * @return false if the name is empty or too long, the previous name is kept
+ */
+bool NBD_Serializer::setMeasurement(const char *measurement)
+{
+    if (measurement == nullptr || measurement[0] == '\0' || strlen(measurement) > NBD_SERIALIZER_MAX_MEASUREMENT)
+        return false;
+    _measurement = measurement;
+    return true;
+}
+
+/**
+ * Starts a new document.
+ *
+ * @param readings the readings, they must not change until done() returns true
+ * @param count number of readings
+ * @param unit 'C' or 'F', the unit of the values
+ */
+void NBD_Serializer::begin(const NBD_SensorSnapshot *readings, unsigned int count, char unit)
+{
+    _readings = readings;
+    _count = (readings == nullptr) ? 0 : count;
+    _unit = unit;
+    _piece = 0;
+    _offset = 0;
+    render();
+}
+
+/**
+ * Copies the next part of the document into buf.
+ *
+ * @param buf the buffer
+ * @param len capacity of the buffer
+ *
+ * @return the number of bytes written, 0 when the document is complete
+ */
+size_t NBD_Serializer::read(uint8_t *buf, size_t len)
+{
+    size_t written = 0;
+    while (written < len && !done())
+    {
+        if (_offset == _pieceLen)
+        {
+            _piece++;
+            _offset = 0;
+            render();
+            continue;
+        }
+        size_t n = _pieceLen - _offset;
+        if (n > len - written)
+            n = len - written;
+        memcpy(buf + written, _scratch + _offset, n);
+        _offset += n;
+        written += n;
+    }
+    return written;
+}
+
+/**
+ * Pushes the rest of the document to a sink, one sensor at a time.
+ *
+ * @param sink called with every chunk, may return false to pause
+ * @param ctx passed to the sink
+ *
+ * @return true when the document is complete, false if the sink paused it (call again to resume)
+ */
+bool NBD_Serializer::write(NBD_SerializerSink sink, void *ctx)
+{
+    while (!done())
+    {
+        if (_offset < _pieceLen)
+        {
+            if (!sink(_scratch + _offset, _pieceLen - _offset, ctx))
+                return false;
+            _offset = _pieceLen;
+        }
+        _piece++;
+        _offset = 0;
+        render();
+    }
+    return true;
+}
+
+bool NBD_Serializer::done() const
+{
+    return _piece > _count + 1;
+}
+
+//==============================================================================================
+//                                  PRIVATE
+//==============================================================================================
+
+void NBD_Serializer::render()
+{
+    _pieceLen = 0;
+    if (done())
+        return;
+    switch (_format)
+    {
+    case NBD_FORMAT_JSON:
+        _pieceLen = renderJson(_scratch);
+        break;
+    case NBD_FORMAT_CBOR:
+        _pieceLen = renderCbor(_scratch);
+        break;
+    case NBD_FORMAT_LINE:
+        _pieceLen = renderLine(_scratch);
+        break;
+    }
+}
+
+size_t NBD_Serializer::renderJson(uint8_t *p)
+{
+    char *c = (char *)p;
+    if (_piece == 0)
+        return sprintf(c, "{\"unit\":\"%c\",\"sensors\":[", _unit);
+    if (_piece == _count + 1)
+        return sprintf(c, "]}");
+
+    const NBD_SensorSnapshot &r = _readings[_piece - 1];
+    size_t n = sprintf(c, "%s{\"addr\":\"", (_piece > 1) ? "," : "");
+    n += putAddress(c + n, r.address);
+    n += sprintf(c + n, "\",\"value\":");
+    n += putValue(c + n, r.temperature);
+    n += sprintf(c + n, ",\"raw\":%ld,\"valid\":%s,\"time\":%lu}", (long)r.raw, r.valid ? "true" : "false",
+                 (unsigned long)r.lastTimeOfValidTemp);
+    return n;
+}
+
+size_t NBD_Serializer::renderCbor(uint8_t *p)
+{
+    size_t n = 0;
+    if (_piece == 0)
+    {
+        char unit[2] = {_unit, 0};
+        n += cborHead(p + n, 5, 2);
+        n += cborText(p + n, "unit");
+        n += cborText(p + n, unit);
+        n += cborText(p + n, "sensors");
+        n += cborHead(p + n, 4, _count);
+        return n;
+    }
+    if (_piece == _count + 1)
+        return 0;
+
+    const NBD_SensorSnapshot &r = _readings[_piece - 1];
+    n += cborHead(p + n, 5, 5);
+    n += cborText(p + n, "addr");
+    n += cborHead(p + n, 2, 8);
+    memcpy(p + n, r.address, 8);
+    n += 8;
+    n += cborText(p + n, "value");
+    n += cborFloat(p + n, r.temperature);
+    n += cborText(p + n, "raw");
+    n += cborInt(p + n, r.raw);
+    n += cborText(p + n, "valid");
+    p[n++] = r.valid ? 0xF5 : 0xF4;
+    n += cborText(p + n, "time");
+    n += cborHead(p + n, 0, (uint32_t)r.lastTimeOfValidTemp);
+    return n;
+}
+
+size_t NBD_Serializer::renderLine(uint8_t *p)
+{
+    if (_piece == 0 || _piece == _count + 1)
+        return 0;
+
+    char *c = (char *)p;
+    const NBD_SensorSnapshot &r = _readings[_piece - 1];
+    size_t n = sprintf(c, "%s,addr=", _measurement); //fits, see setMeasurement()
+    n += putAddress(c + n, r.address);
+    n += sprintf(c + n, ",unit=%c value=", _unit);
+    n += putValue(c + n, r.temperature);
+    n += sprintf(c + n, ",raw=%ldi,valid=%s,time=%lui\n", (long)r.raw, r.valid ? "true" : "false",
+                 (unsigned long)r.lastTimeOfValidTemp);
+    return n;
+}
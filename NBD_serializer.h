@@ -0,0 +1,56 @@
+#ifndef NBD_SERIALIZER_H
+#define NBD_SERIALIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "NBD_snapshot.h"
+
+#ifndef NBD_SERIALIZER_MAX_MEASUREMENT
+#define NBD_SERIALIZER_MAX_MEASUREMENT 48 //Longest measurement name of the line protocol [characters]
+#endif
+#define NBD_SERIALIZER_SCRATCH (128 + NBD_SERIALIZER_MAX_MEASUREMENT) //Largest rendered piece (one sensor) [bytes]
+
+enum NBD_SerialFormat
+{
+    NBD_FORMAT_JSON,    //{"unit":"C","sensors":[{"addr":"40.187...","value":21.50,"raw":2752,"valid":true,"time":1234},...]}
+    NBD_FORMAT_CBOR,    //Same structure as JSON, RFC 8949, addr as an 8 byte string, value as float32
+    NBD_FORMAT_LINE     //InfluxDB line protocol, one line per sensor: temperature,addr=40.187...,unit=C value=21.50,raw=2752i,valid=true,time=1234i
+};
+
+//Receives the output chunk by chunk, returns false to pause the output
+typedef bool (*NBD_SerializerSink)(const uint8_t *data, size_t len, void *ctx);
+
+/*
+Serializes readings (e.g. filled by copyReadings()) without heap allocation. The output can be taken
+in pieces of any size with read() or pushed to a sink with write(); both resume where the previous
+call stopped, so the document can be larger than the send buffer.
+The readings must not change until the output is done.
+*/
+class NBD_Serializer
+{
+public:
+    NBD_Serializer(NBD_SerialFormat format, const char *measurement = "temperature");
+
+    bool   setMeasurement(const char *measurement);
+    void   begin(const NBD_SensorSnapshot *readings, unsigned int count, char unit);
+    size_t read(uint8_t *buf, size_t len);
+    bool   write(NBD_SerializerSink sink, void *ctx);
+    bool   done() const;
+
+private:
+    NBD_SerialFormat          _format;
+    const char               *_measurement;
+    const NBD_SensorSnapshot *_readings;
+    unsigned int              _count;
+    char                      _unit;
+    unsigned int              _piece;       //0 header, 1..count sensors, count+1 footer
+    size_t                    _offset;      //Bytes of the current piece already output
+    size_t                    _pieceLen;
+    uint8_t                   _scratch[NBD_SERIALIZER_SCRATCH];
+
+    void   render();
+    size_t renderJson(uint8_t *p);
+    size_t renderCbor(uint8_t *p);
+    size_t renderLine(uint8_t *p);
+};
+#endif /* NBD_SERIALIZER_H */
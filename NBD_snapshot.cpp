@@ -0,0 +1,138 @@
+#include "NBD_snapshot.h"
+#include "NBD_platform.h"
+
+NBD_SnapshotTable::NBD_SnapshotTable() : _sequence(0), _capacity(0), _entries(nullptr)
+{
+    _count = 0;
+}
+
+NBD_SnapshotTable::~NBD_SnapshotTable()
+{
+    delete[] _entries.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < _retired.size(); i++)
+    {
+        delete[] _retired[i];
+    }
+}
+
+/**
+ * Starts a publication. Readers retry until endWrite() is called. The storage grows to hold
+ * count entries, at least doubling so a growing wire reallocates only a few times.
+ *
+ * @param count number of entries about to be written
+ *
+ * @return the entries of the table, at least count
+ */
+NBD_SensorSnapshot *NBD_SnapshotTable::beginWrite(uint8_t count)
+{
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint8_t capacity = _capacity.load(std::memory_order_relaxed);
+    if (count > capacity)
+    {
+        unsigned int grown = capacity * 2u;
+        if (grown > 255)
+            grown = 255;
+        if (grown < count)
+            grown = count;
+        NBD_SensorSnapshot *previous = _entries.load(std::memory_order_relaxed);
+        if (previous)
+            _retired.push_back(previous);
+        _entries.store(new NBD_SensorSnapshot[grown], std::memory_order_relaxed);
+        _capacity.store((uint8_t)grown, std::memory_order_relaxed);
+    }
+    return _entries.load(std::memory_order_relaxed);
+}
+
+/**
+ * Ends a publication.
+ *
+ * @param count number of valid entries
+ */
+void NBD_SnapshotTable::endWrite(uint8_t count)
+{
+    uint8_t capacity = _capacity.load(std::memory_order_relaxed);
+    _count = (count > capacity) ? capacity : count;
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * Copies a consistent table into a caller provided buffer.
+ *
+ * @param out the buffer
+ * @param max capacity of the buffer
+ * @param sequence receives the sequence of the copied table if not nullptr
+ *
+ * @return the number of entries copied
+ */
+uint8_t NBD_SnapshotTable::read(NBD_SensorSnapshot *out, uint8_t max, uint32_t *sequence) const
+{
+    uint32_t seq;
+    uint8_t n;
+    do
+    {
+        seq = waitStable();
+        const NBD_SensorSnapshot *entries = _entries.load(std::memory_order_relaxed);
+        n = (_count < max) ? _count : max;
+        for (uint8_t i = 0; i < n; i++)
+        {
+            out[i] = entries[i];
+        }
+    } while (!unchanged(seq));
+    if (sequence != nullptr)
+        *sequence = seq;
+    return n;
+}
+
+/**
+ * Copies a consistent entry.
+ *
+ * @param index position in the table
+ * @param out receives the entry
+ *
+ * @return false if the index is out of range
+ */
+bool NBD_SnapshotTable::readOne(uint8_t index, NBD_SensorSnapshot &out) const
+{
+    uint32_t seq;
+    bool found;
+    do
+    {
+        seq = waitStable();
+        found = index < _count;
+        if (found)
+            out = _entries.load(std::memory_order_relaxed)[index];
+    } while (!unchanged(seq));
+    return found;
+}
+
+uint32_t NBD_SnapshotTable::getSequence() const
+{
+    return waitStable();
+}
+
+uint8_t NBD_SnapshotTable::capacity() const
+{
+    return _capacity.load(std::memory_order_relaxed);
+}
+
+//==============================================================================================
+//                                  PRIVATE
+//==============================================================================================
+
+uint32_t NBD_SnapshotTable::waitStable() const
+{
+    uint32_t seq = _sequence.load(std::memory_order_acquire);
+    while (seq & 1)
+    {
+        NBD_relax();
+        seq = _sequence.load(std::memory_order_acquire);
+    }
+    return seq;
+}
+
+bool NBD_SnapshotTable::unchanged(uint32_t sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return _sequence.load(std::memory_order_relaxed) == sequence;
+}
@@ -0,0 +1,54 @@
+#ifndef NBD_SNAPSHOT_H
+#define NBD_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include "NBD_handle.h"
+
+struct NBD_SensorSnapshot
+{
+    NBD_handle_t handle = NBD_INVALID_HANDLE;
+    int32_t raw = 0;                        //Temperature in raw units (1/128 °C)
+    float temperature = 0;                  //Temperature in the unit of measure of the wire
+    bool valid = false;                     //Validity of the last reading
+    unsigned long lastTimeOfValidTemp = 0;  //millis() of the last valid reading
+    uint8_t address[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+};
+
+/*
+Table of the sensors of a wire published by the bus driver at the end of every read cycle.
+A sequence lock lets readers on other tasks or cores copy a consistent table without ever
+blocking the writer; a reader only retries when it overlapped a publication.
+There must be a single writer.
+The table grows with the sensors of the wire. A reader may still be copying from the previous
+storage while it grows, so replaced storage is only freed with the table.
+*/
+class NBD_SnapshotTable
+{
+public:
+    NBD_SnapshotTable();
+    ~NBD_SnapshotTable();
+
+    NBD_SensorSnapshot *beginWrite(uint8_t count); //Returns at least count entries to fill
+    void     endWrite(uint8_t count);
+
+    uint8_t  read(NBD_SensorSnapshot *out, uint8_t max, uint32_t *sequence = nullptr) const;
+    bool     readOne(uint8_t index, NBD_SensorSnapshot &out) const;
+    uint32_t getSequence() const;            //Even, changes at every publication
+    uint8_t  capacity() const;
+
+private:
+    std::atomic<uint32_t>             _sequence; //Odd while a publication is in progress
+    uint8_t                           _count;
+    std::atomic<uint8_t>              _capacity;
+    std::atomic<NBD_SensorSnapshot *> _entries;
+    std::vector<NBD_SensorSnapshot *> _retired;  //Replaced storage, see the class comment
+
+    uint32_t waitStable() const;
+    bool     unchanged(uint32_t sequence) const;
+    NBD_SnapshotTable(const NBD_SnapshotTable &);
+    NBD_SnapshotTable &operator=(const NBD_SnapshotTable &);
+};
+#endif /* NBD_SNAPSHOT_H */
@@ -0,0 +1,235 @@
+#ifndef NBD_STATICARRAY_H
+#define NBD_STATICARRAY_H
+
+#include "NonBlockingDallas.h"
+
+/*
+Compile-time variant of NonBlockingDallasArray for fixed wiring. The wires are template
+arguments, their OneWire, DallasTemperature and NonBlockingDallas objects are members of the
+array (declare the array as a global object for static storage), pins are checked for
+duplicates by the compiler and the per-wire loops are unrolled by template recursion.
+
+    NonBlockingDallasStaticArray<NBD_Wire<4, 8>, NBD_Wire<5, 16>> sensors("boiler", "floor");
+    sensors.begin(NonBlockingDallas::resolution_12, NonBlockingDallas::unit_C, 1500);
+    sensors.update();
+    sensors.wire<1>().getTempByIndex(0, err);
+
+Only C++11 is needed.
+*/
+
+/*
+One wire of NonBlockingDallasStaticArray: the GPIO pin and the number of sensors the storage is
+reserved for.
+*/
+template <uint8_t Pin, uint8_t MaxSensors = ONE_WIRE_MAX_DEV>
+struct NBD_Wire
+{
+    static_assert(MaxSensors > 0, "NBD_Wire: MaxSensors must be at least 1");
+    static const uint8_t pin = Pin;
+    static const uint8_t maxSensors = MaxSensors;
+
+    OneWire             oneWire;
+    DallasTemperature   dallas;
+    NBD_DallasTransport transport;
+    NonBlockingDallas   wire;
+
+    explicit NBD_Wire(const char *name)
+        : oneWire(Pin), dallas(&oneWire), transport(&dallas, &oneWire), wire(&transport, Pin)
+    {
+        wire.setWireName(name);
+        wire.reserveSensors(MaxSensors);
+    }
+};
+
+//Compile-time duplicate pin check
+template <uint8_t Pin, uint8_t... Others>
+struct NBD_pinNotIn;
+
+template <uint8_t Pin>
+struct NBD_pinNotIn<Pin>
+{
+    static const bool value = true;
+};
+
+template <uint8_t Pin, uint8_t First, uint8_t... Others>
+struct NBD_pinNotIn<Pin, First, Others...>
+{
+    static const bool value = (Pin != First) && NBD_pinNotIn<Pin, Others...>::value;
+};
+
+template <uint8_t... Pins>
+struct NBD_pinsUnique;
+
+template <>
+struct NBD_pinsUnique<>
+{
+    static const bool value = true;
+};
+
+template <uint8_t First, uint8_t... Others>
+struct NBD_pinsUnique<First, Others...>
+{
+    static const bool value = NBD_pinNotIn<First, Others...>::value && NBD_pinsUnique<Others...>::value;
+};
+
+//Recursive storage of the wires, every loop over it is unrolled at compile time
+template <typename... Wires>
+struct NBD_WireList;
+
+template <>
+struct NBD_WireList<>
+{
+    NBD_WireList() {}
+    template <typename F>
+    void forEach(F &) {}
+};
+
+template <typename Head, typename... Tail>
+struct NBD_WireList<Head, Tail...>
+{
+    Head head;
+    NBD_WireList<Tail...> tail;
+
+    template <typename... Names>
+    explicit NBD_WireList(const char *name, Names... names) : head(name), tail(names...) {}
+
+    template <typename F>
+    void forEach(F &f)
+    {
+        f(head.wire);
+        tail.forEach(f);
+    }
+};
+
+template <size_t I, typename List>
+struct NBD_WireAt;
+
+template <typename Head, typename... Tail>
+struct NBD_WireAt<0, NBD_WireList<Head, Tail...>>
+{
+    static NonBlockingDallas &get(NBD_WireList<Head, Tail...> &list) { return list.head.wire; }
+};
+
+template <size_t I, typename Head, typename... Tail>
+struct NBD_WireAt<I, NBD_WireList<Head, Tail...>>
+{
+    static NonBlockingDallas &get(NBD_WireList<Head, Tail...> &list)
+    {
+        return NBD_WireAt<I - 1, NBD_WireList<Tail...>>::get(list.tail);
+    }
+};
+
+template <typename... Wires>
+class NonBlockingDallasStaticArray
+{
+    static_assert(sizeof...(Wires) > 0, "NonBlockingDallasStaticArray: at least one wire is needed");
+    static_assert(sizeof...(Wires) <= 255, "NonBlockingDallasStaticArray: the wire slot is 8 bits");
+    static_assert(NBD_pinsUnique<Wires::pin...>::value, "NonBlockingDallasStaticArray: two wires use the same pin");
+
+public:
+    static const uint8_t wireCount = sizeof...(Wires);
+
+    template <typename... Names>
+    explicit NonBlockingDallasStaticArray(Names... names) : _list(names...)
+    {
+        static_assert(sizeof...(Names) == sizeof...(Wires), "NonBlockingDallasStaticArray: one name per wire");
+        Slotter slotter = {_table, 0};
+        _list.forEach(slotter);
+    }
+
+    void begin(NonBlockingDallas::NBD_resolution res, NonBlockingDallas::NBD_unitsOfMeasure uom, unsigned long tempInterval)
+    {
+        Beginner beginner = {res, uom, tempInterval};
+        _list.forEach(beginner);
+    }
+
+    void update()
+    {
+        Updater updater;
+        _list.forEach(updater);
+    }
+
+    void requestTemperature()
+    {
+        Requester requester;
+        _list.forEach(requester);
+    }
+
+    void rescanWire()
+    {
+        Rescanner rescanner;
+        _list.forEach(rescanner);
+    }
+
+    NBD_index_t getSensorsCount()
+    {
+        Counter counter = {0};
+        _list.forEach(counter);
+        return counter.total > NBD_INDEX_MAX ? NBD_INDEX_MAX : (NBD_index_t)counter.total;
+    }
+
+    //Wire selected at compile time
+    template <size_t I>
+    NonBlockingDallas &wire()
+    {
+        static_assert(I < sizeof...(Wires), "NonBlockingDallasStaticArray: wire index out of range");
+        return NBD_WireAt<I, NBD_WireList<Wires...>>::get(_list);
+    }
+
+    //Wire selected at run time, nullptr if out of range
+    NonBlockingDallas *getWire(uint8_t index)
+    {
+        return index < sizeof...(Wires) ? _table[index] : nullptr;
+    }
+
+    float getTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err)
+    {
+        if (NBD_handleWire(handle) >= sizeof...(Wires))
+        {
+            err = NBD_HANDLE_IS_NOT_VALID;
+            return DEVICE_DISCONNECTED_C;
+        }
+        return _table[NBD_handleWire(handle)]->getTempByHandle(handle, err);
+    }
+
+private:
+    NBD_WireList<Wires...> _list;
+    NonBlockingDallas *_table[sizeof...(Wires)]; //Wire by slot, for handles and run time access
+
+    struct Slotter
+    {
+        NonBlockingDallas **table;
+        uint8_t slot;
+        void operator()(NonBlockingDallas &w)
+        {
+            w.setWireSlot(slot);
+            table[slot++] = &w;
+        }
+    };
+    struct Beginner
+    {
+        NonBlockingDallas::NBD_resolution res;
+        NonBlockingDallas::NBD_unitsOfMeasure uom;
+        unsigned long tempInterval;
+        void operator()(NonBlockingDallas &w) { w.begin(res, uom, tempInterval); }
+    };
+    struct Updater
+    {
+        void operator()(NonBlockingDallas &w) { w.update(); }
+    };
+    struct Requester
+    {
+        void operator()(NonBlockingDallas &w) { w.requestTemperature(); }
+    };
+    struct Rescanner
+    {
+        void operator()(NonBlockingDallas &w) { w.rescanWire(); }
+    };
+    struct Counter
+    {
+        uint32_t total;
+        void operator()(NonBlockingDallas &w) { total += w.getSensorsCount(); }
+    };
+};
+
+#endif /* NBD_STATICARRAY_H */
@@ -0,0 +1,201 @@
+#include "NBD_timerwheel.h"
+
+#define NBD_WHEEL_SLOTS (1 << NBD_WHEEL_SLOT_BITS)
+
+NBD_TimerWheel::NBD_TimerWheel()
+{
+    for (uint16_t i = 0; i < NBD_WHEEL_SLOTS; i++)
+    {
+        _heads[i] = NBD_WHEEL_NONE;
+    }
+    _tick = 0;
+    _armed = 0;
+    _started = false;
+    _earliest = 0;
+    _earliestKnown = false;
+}
+
+/**
+ * Creates a timer.
+ *
+ * @return the id of the timer or NBD_WHEEL_NONE if there are too many
+ */
+uint16_t NBD_TimerWheel::add()
+{
+    if (_entries.size() >= NBD_WHEEL_NONE)
+        return NBD_WHEEL_NONE;
+    Entry e;
+    e.deadline = 0;
+    e.prev = NBD_WHEEL_NONE;
+    e.next = NBD_WHEEL_NONE;
+    e.slot = 0;
+    e.armed = false;
+    _entries.push_back(e);
+    return _entries.size() - 1;
+}
+
+/**
+ * Arms a timer, an armed timer is moved to its new deadline.
+ *
+ * @param id the timer
+ * @param now millis()
+ * @param delay time to the deadline [milliseconds]
+ */
+void NBD_TimerWheel::arm(uint16_t id, unsigned long now, unsigned long delay)
+{
+    if (!_started)
+    {
+        _tick = now >> NBD_WHEEL_TICK_SHIFT;
+        _started = true;
+    }
+    if (_entries[id].armed)
+        unlink(id);
+    Entry &e = _entries[id];
+    e.deadline = now + delay;
+    // A deadline before the last processed tick goes to the current slot, it is due at the next expire()
+    unsigned long tick = e.deadline >> NBD_WHEEL_TICK_SHIFT;
+    if ((long)(tick - _tick) < 0)
+        tick = _tick;
+    uint16_t slot = tick & (NBD_WHEEL_SLOTS - 1);
+    e.slot = slot;
+    e.prev = NBD_WHEEL_NONE;
+    e.next = _heads[slot];
+    if (e.next != NBD_WHEEL_NONE)
+        _entries[e.next].prev = id;
+    _heads[slot] = id;
+    e.armed = true;
+    _armed++;
+    if (_armed == 1)
+    {
+        _earliest = e.deadline;
+        _earliestKnown = true;
+    }
+    else if (_earliestKnown && (long)(e.deadline - _earliest) < 0)
+        _earliest = e.deadline;
+}
+
+/**
+ * Disarms a timer.
+ *
+ * @param id the timer
+ */
+void NBD_TimerWheel::disarm(uint16_t id)
+{
+    if (_entries[id].armed)
+        unlink(id);
+}
+
+void NBD_TimerWheel::unlink(uint16_t id)
+{
+    Entry &e = _entries[id];
+    if (e.prev != NBD_WHEEL_NONE)
+        _entries[e.prev].next = e.next;
+    else
+        _heads[e.slot] = e.next;
+    if (e.next != NBD_WHEEL_NONE)
+        _entries[e.next].prev = e.prev;
+    e.prev = NBD_WHEEL_NONE;
+    e.next = NBD_WHEEL_NONE;
+    e.armed = false;
+    _armed--;
+    if (e.deadline == _earliest)
+        _earliestKnown = false; // found again by the next getMillisToNextExpiry()
+}
+
+/**
+ * Collects and disarms the timers whose deadline passed. Timers of later rounds in the visited
+ * slots are skipped. If out fills up, the next call continues where this one stopped.
+ *
+ * @param now millis()
+ * @param out receives the ids of the expired timers
+ * @param max capacity of out
+ *
+ * @return the number of expired timers
+ */
+uint16_t NBD_TimerWheel::expire(unsigned long now, uint16_t *out, uint16_t max)
+{
+    if (!_started || _armed == 0)
+    {
+        _tick = now >> NBD_WHEEL_TICK_SHIFT;
+        return 0;
+    }
+    unsigned long nowTick = now >> NBD_WHEEL_TICK_SHIFT;
+    unsigned long ticks = nowTick - _tick;
+    if (ticks >= NBD_WHEEL_SLOTS)
+        ticks = NBD_WHEEL_SLOTS - 1; // every slot is visited once
+    uint16_t n = 0;
+    for (unsigned long t = 0; t <= ticks; t++)
+    {
+        uint16_t slot = (nowTick - ticks + t) & (NBD_WHEEL_SLOTS - 1);
+        uint16_t id = _heads[slot];
+        while (id != NBD_WHEEL_NONE)
+        {
+            uint16_t next = _entries[id].next;
+            if ((long)(now - _entries[id].deadline) >= 0)
+            {
+                if (n == max)
+                {
+                    _tick = nowTick - ticks + t; // resume from this slot
+                    return n;
+                }
+                unlink(id);
+                out[n++] = id;
+            }
+            id = next;
+        }
+    }
+    _tick = nowTick;
+    return n;
+}
+
+/**
+ * Tells when expire() has something to do at the earliest. The earliest deadline is cached, it
+ * is only searched again after the timer holding it was disarmed or expired.
+ *
+ * @param now millis()
+ *
+ * @return milliseconds to the earliest armed deadline, 0xFFFFFFFF if no timer is armed
+ */
+unsigned long NBD_TimerWheel::getMillisToNextExpiry(unsigned long now) const
+{
+    if (_armed == 0)
+        return 0xFFFFFFFFUL;
+    if (!_earliestKnown)
+        findEarliest();
+    return ((long)(_earliest - now) > 0) ? _earliest - now : 0;
+}
+
+/**
+ * Walks the slots from the last processed tick: the first slot holding a timer of the current
+ * round holds the earliest deadline. Only when every timer is in a later round are all of them
+ * compared.
+ */
+void NBD_TimerWheel::findEarliest() const
+{
+    bool found = false;
+    for (unsigned long t = 0; t < NBD_WHEEL_SLOTS && !found; t++)
+    {
+        for (uint16_t id = _heads[(_tick + t) & (NBD_WHEEL_SLOTS - 1)]; id != NBD_WHEEL_NONE; id = _entries[id].next)
+        {
+            const Entry &e = _entries[id];
+            if ((long)((e.deadline >> NBD_WHEEL_TICK_SHIFT) - _tick) >= NBD_WHEEL_SLOTS)
+                continue; // a later round
+            if (!found || (long)(e.deadline - _earliest) < 0)
+                _earliest = e.deadline;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        // Every timer is in a later round
+        for (size_t id = 0; id < _entries.size(); id++)
+        {
+            if (_entries[id].armed && (!found || (long)(_entries[id].deadline - _earliest) < 0))
+            {
+                _earliest = _entries[id].deadline;
+                found = true;
+            }
+        }
+    }
+    _earliestKnown = found;
+}
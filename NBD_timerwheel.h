@@ -0,0 +1,55 @@
+#ifndef NBD_TIMERWHEEL_H
+#define NBD_TIMERWHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#ifndef NBD_WHEEL_SLOT_BITS
+#define NBD_WHEEL_SLOT_BITS     6       //64 slots
+#endif
+#ifndef NBD_WHEEL_TICK_SHIFT
+#define NBD_WHEEL_TICK_SHIFT    7       //128 ms per tick
+#endif
+#define NBD_WHEEL_NONE          0xFFFF
+
+/*
+Hashed timer wheel on millis(). A timer lives in the slot of its deadline tick, so arming and
+disarming are O(1) and expire() only walks the slots of the ticks elapsed since the last call.
+Both the slot count and the tick are powers of two, so the slots stay continuous when millis()
+wraps around. The earliest deadline is cached for getMillisToNextExpiry(), so an idle loop
+sleeps until the next timer instead of waking up at every tick.
+*/
+class NBD_TimerWheel
+{
+public:
+    NBD_TimerWheel();
+
+    uint16_t add();                                                 //New disarmed timer, NBD_WHEEL_NONE if full
+    void     arm(uint16_t id, unsigned long now, unsigned long delay); //Fires at now + delay, re-arms if armed
+    void     disarm(uint16_t id);
+    bool     isArmed(uint16_t id) const { return _entries[id].armed; }
+    uint16_t expire(unsigned long now, uint16_t *out, uint16_t max); //Disarms and returns the timers due
+    unsigned long getMillisToNextExpiry(unsigned long now) const;   //0xFFFFFFFF if nothing is armed
+
+private:
+    struct Entry
+    {
+        unsigned long deadline;
+        uint16_t prev;
+        uint16_t next;
+        uint16_t slot;
+        bool armed;
+    };
+    std::vector<Entry>    _entries;
+    uint16_t              _heads[1 << NBD_WHEEL_SLOT_BITS];
+    unsigned long         _tick;        //Last tick expire() went through
+    uint16_t              _armed;       //Number of armed timers
+    bool                  _started;
+    mutable unsigned long _earliest;    //Earliest armed deadline, valid if _earliestKnown
+    mutable bool          _earliestKnown;
+
+    void unlink(uint16_t id);
+    void findEarliest() const;
+};
+#endif /* NBD_TIMERWHEEL_H */
@@ -0,0 +1,147 @@
+#include "NBD_trace.h"
+
+/**
+ * Allocates the buffer. Tracing starts enabled.
+ *
+ * @param capacity number of events, rounded up to a power of two, at most NBD_TRACE_MAX_CAPACITY
+ */
+NBD_TraceBuffer::NBD_TraceBuffer(uint16_t capacity) : _next(0), _enabled(true)
+{
+    uint32_t size = 1;
+    while (size < capacity && size < NBD_TRACE_MAX_CAPACITY)
+    {
+        size <<= 1;
+    }
+    _buffer.resize(size);
+    _buffer.shrink_to_fit();
+    _mask = size - 1;
+}
+
+/**
+ * Stores an event with the current micros(). Safe to call from any task.
+ *
+ * @param event NBD_TraceEvent
+ * @param wire wire slot, NBD_TRACE_NO_WIRE if the event does not belong to a wire
+ * @param arg see NBD_TraceEvent
+ */
+void NBD_TraceBuffer::record(uint8_t event, uint8_t wire, uint16_t arg)
+{
+    if (!_enabled.load(std::memory_order_relaxed))
+        return;
+    NBD_TraceRecord &r = _buffer[_next.fetch_add(1, std::memory_order_relaxed) & _mask];
+    r.micros = micros();
+    r.event = event;
+    r.wire = wire;
+    r.arg = arg;
+}
+
+/**
+ * Stores a marker of the sketch, e.g. at the start of loop() to see where its time goes.
+ *
+ * @param arg free value, shown by the decoder
+ */
+void NBD_TraceBuffer::mark(uint16_t arg)
+{
+    record(NBD_TRACE_MARK, NBD_TRACE_NO_WIRE, arg);
+}
+
+void NBD_TraceBuffer::setEnabled(bool enabled)
+{
+    _enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool NBD_TraceBuffer::isEnabled() const
+{
+    return _enabled.load(std::memory_order_relaxed);
+}
+
+void NBD_TraceBuffer::clear()
+{
+    _next.store(0, std::memory_order_relaxed);
+}
+
+uint16_t NBD_TraceBuffer::size() const
+{
+    uint32_t next = _next.load(std::memory_order_relaxed);
+    return next > _mask ? (uint16_t)(_mask + 1) : (uint16_t)next;
+}
+
+uint16_t NBD_TraceBuffer::capacity() const
+{
+    return (uint16_t)(_mask + 1);
+}
+
+/**
+ * @return events lost because the buffer was full
+ */
+uint32_t NBD_TraceBuffer::getOverwrittenCount() const
+{
+    uint32_t next = _next.load(std::memory_order_relaxed);
+    return next > _mask ? next - _mask - 1 : 0;
+}
+
+/**
+ * Copies the stored events, oldest first. Disable the tracing while copying to get a
+ * consistent picture.
+ *
+ * @param out destination
+ * @param max capacity of out
+ *
+ * @return number of events copied
+ */
+uint16_t NBD_TraceBuffer::copy(NBD_TraceRecord *out, uint16_t max) const
+{
+    uint32_t next = _next.load(std::memory_order_acquire);
+    uint16_t n = size();
+    if (n > max)
+        n = max;
+    uint32_t first = next - n;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        out[i] = _buffer[(first + i) & _mask];
+    }
+    return n;
+}
+
+static size_t writeLE(Print &out, uint32_t value, uint8_t bytes)
+{
+    uint8_t b[4];
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        b[i] = (uint8_t)(value >> (8 * i));
+    }
+    return out.write(b, bytes);
+}
+
+/**
+ * Writes the binary image of the buffer, for extras/nbd_trace_decode.py. Little endian:
+ * magic (4), version (2), record size (2), event count (4), overwritten events (4), then the
+ * events oldest first: micros (4), event (1), wire (1), arg (2).
+ * Tracing is paused while dumping.
+ *
+ * @param out e.g. Serial or an open File
+ *
+ * @return bytes written
+ */
+size_t NBD_TraceBuffer::dump(Print &out)
+{
+    bool enabled = _enabled.exchange(false);
+    uint32_t next = _next.load(std::memory_order_acquire);
+    uint16_t n = size();
+    size_t written = 0;
+    written += writeLE(out, NBD_TRACE_MAGIC, 4);
+    written += writeLE(out, NBD_TRACE_VERSION, 2);
+    written += writeLE(out, sizeof(NBD_TraceRecord), 2);
+    written += writeLE(out, n, 4);
+    written += writeLE(out, getOverwrittenCount(), 4);
+    for (uint32_t i = next - n; i != next; i++)
+    {
+        const NBD_TraceRecord &r = _buffer[i & _mask];
+        written += writeLE(out, r.micros, 4);
+        written += writeLE(out, r.event, 1);
+        written += writeLE(out, r.wire, 1);
+        written += writeLE(out, r.arg, 2);
+    }
+    _enabled.store(enabled);
+    return written;
+}
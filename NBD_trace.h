@@ -0,0 +1,107 @@
+#ifndef NBD_TRACE_H
+#define NBD_TRACE_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#define NBD_TRACE_MAGIC    0x5444424EUL //"NBDT" little endian, first field of a dump
+#define NBD_TRACE_VERSION  1
+#define NBD_TRACE_NO_WIRE  0xFF         //Wire field of the events of NonBlockingDallasArray
+#define NBD_TRACE_ALL      0xFFFF       //Argument of a conversion started on every sensor of the wire
+#define NBD_TRACE_MAX_CAPACITY 32768    //Largest power of two a uint16_t capacity can report
+
+enum NBD_TraceEvent : uint8_t
+{
+    NBD_TRACE_CONVERSION_START = 1, //arg: sensor index or NBD_TRACE_ALL
+    NBD_TRACE_CONVERSION_END,       //arg: as the start
+    NBD_TRACE_READ_START,           //arg: sensor index
+    NBD_TRACE_READ_END,             //arg: sensor index
+    NBD_TRACE_CRC_ERROR,            //arg: sensor index
+    NBD_TRACE_RESCAN_START,         //arg: 0
+    NBD_TRACE_RESCAN_END,           //arg: sensors found
+    NBD_TRACE_CALLBACK_START,       //arg: NBD_TraceCallback
+    NBD_TRACE_CALLBACK_END,         //arg: NBD_TraceCallback
+    NBD_TRACE_MARK,                 //arg: free, see NBD_TraceBuffer::mark()
+};
+
+enum NBD_TraceCallback : uint16_t
+{
+    NBD_TRACE_CB_INTERVAL_ELAPSED = 0,
+    NBD_TRACE_CB_TEMPERATURE_CHANGE,
+    NBD_TRACE_CB_PRIORITY_READ_COMPLETE,
+    NBD_TRACE_CB_GROUP_CHANGE,
+    NBD_TRACE_CB_SENSOR_STALE,
+    NBD_TRACE_CB_SENSOR_RECOVERED,
+};
+
+struct NBD_TraceRecord
+{
+    uint32_t micros;    //micros() of the event
+    uint8_t  event;     //NBD_TraceEvent
+    uint8_t  wire;      //Wire slot, NBD_TRACE_NO_WIRE for the array
+    uint16_t arg;       //See NBD_TraceEvent
+};
+
+/*
+Fixed size in-RAM ring buffer of binary trace events, for timing analysis on a live unit.
+Recording an event costs a micros() call and an 8 byte store: unlike the debug prints it
+hardly changes the timing it measures. When the buffer is full the oldest events are
+overwritten. Any task may record, the slot is claimed with an atomic increment.
+
+dump() writes the binary image, extras/nbd_trace_decode.py turns it into a Chrome trace /
+Perfetto JSON (one track per wire).
+*/
+class NBD_TraceBuffer
+{
+public:
+    NBD_TraceBuffer(uint16_t capacity);
+
+    void     record(uint8_t event, uint8_t wire, uint16_t arg);
+    void     mark(uint16_t arg);
+    void     setEnabled(bool enabled);
+    bool     isEnabled() const;
+    void     clear();
+
+    uint16_t size() const;
+    uint16_t capacity() const;
+    uint32_t getOverwrittenCount() const;
+    uint16_t copy(NBD_TraceRecord *out, uint16_t max) const;
+    size_t   dump(Print &out);
+
+private:
+    std::vector<NBD_TraceRecord> _buffer;
+    uint32_t                     _mask;
+    std::atomic<uint32_t>        _next;     //Events recorded since the last clear()
+    std::atomic<bool>            _enabled;
+};
+
+/*
+Records a start event at construction and the matching end event when it goes out of scope.
+Does nothing when the buffer is null.
+*/
+class NBD_TraceScope
+{
+public:
+    NBD_TraceScope(NBD_TraceBuffer *trace, uint8_t startEvent, uint8_t wire, uint16_t arg)
+        : _trace(trace), _event(startEvent + 1), _wire(wire), _arg(arg)
+    {
+        if (_trace)
+            _trace->record(startEvent, wire, arg);
+    }
+    ~NBD_TraceScope()
+    {
+        if (_trace)
+            _trace->record(_event, _wire, _arg);
+    }
+
+private:
+    NBD_TraceBuffer *_trace;
+    uint8_t          _event;
+    uint8_t          _wire;
+    uint16_t         _arg;
+    NBD_TraceScope(const NBD_TraceScope &);
+    NBD_TraceScope &operator=(const NBD_TraceScope &);
+};
+#endif /* NBD_TRACE_H */
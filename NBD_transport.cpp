@@ -0,0 +1,292 @@
+#include "NBD_transport.h"
+
+/**
+ * Conversion time of a DS18B20 at the given resolution.
+ *
+ * @param bits resolution, 9 to 12
+ *
+ * @return the worst case conversion time [milliseconds]
+ */
+uint16_t NBD_Transport::millisToWaitForConversion(uint8_t bits)
+{
+    switch (bits)
+    {
+    case 9:
+        return 94;
+    case 10:
+        return 188;
+    case 11:
+        return 375;
+    default:
+        return 750;
+    }
+}
+
+/**
+ * Starts the conversion of a single device with an addressed Convert T. Without the 1-Wire
+ * primitives every device of the bus converts.
+ *
+ * @param address the device
+ */
+void NBD_Transport::requestTemperatureByAddress(const uint8_t *address)
+{
+    if (!hasPrimitives() || !reset())
+    {
+        requestTemperatures();
+        return;
+    }
+    select(address);
+    write(0x44, isParasitePowerMode()); // Convert T, keeps the strong pull-up on in parasite mode
+}
+
+static bool isAllZeros(const uint8_t *data, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++)
+    {
+        if (data[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the temperature of a device after a conversion, with the fast paths of the options:
+ * Skip ROM instead of the 64 bit Match ROM on single device buses, a 2 byte partial read when the
+ * CRC is not checked, and retries only when a read fails. A partial read of 0xFFFF or 0x0000 is
+ * confirmed by a full read with CRC, an all zero scratchpad is a bus stuck low.
+ *
+ * @param address the device
+ * @param options read options
+ * @param status receives the outcome of the read
+ *
+ * @return the temperature in raw units (1/128 °C), DEVICE_DISCONNECTED_RAW on failure
+ */
+int32_t NBD_Transport::readTemp(const uint8_t *address, const NBD_ReadOptions &options, NBD_ReadStatus &status)
+{
+    if (!hasPrimitives())
+    {
+        int32_t raw = getTempRaw(address);
+        status = (raw == DEVICE_DISCONNECTED_RAW) ? NBD_READ_NO_DEVICE : NBD_READ_OK;
+        return raw;
+    }
+
+    // the DS18S20 needs COUNT_REMAIN and COUNT_PER_C for its extended resolution
+    bool full = options.verifyCrc || address[0] == 0x10;
+    uint8_t scratchpad[9];
+    status = NBD_READ_NO_DEVICE;
+    for (uint8_t attempt = 0; attempt <= options.retries; attempt++)
+    {
+        if (!reset())
+        {
+            status = NBD_READ_NO_DEVICE;
+            continue;
+        }
+        if (options.skipRom)
+            skip();
+        else
+            select(address);
+        write(0xBE); // Read Scratchpad
+        readBytes(scratchpad, full ? 9 : 2);
+        bool verifyCrc = options.verifyCrc;
+        if (!full)
+        {
+            reset(); // end the read after the temperature bytes
+            bool ones = scratchpad[0] == 0xFF && scratchpad[1] == 0xFF;
+            bool zeros = scratchpad[0] == 0 && scratchpad[1] == 0;
+            if (!ones && !zeros)
+            {
+                status = NBD_READ_OK;
+                return scratchpadToRaw(address, scratchpad, options.resolution);
+            }
+            // 0xFFFF is -0.0625 °C or a device that did not answer, 0x0000 is 0 °C or a bus stuck
+            // low: the CRC of the full scratchpad tells them apart
+            if (!reset())
+            {
+                status = NBD_READ_NO_DEVICE;
+                continue;
+            }
+            if (options.skipRom)
+                skip();
+            else
+                select(address);
+            write(0xBE);
+            readBytes(scratchpad, 9);
+            verifyCrc = true;
+        }
+        if (isAllZeros(scratchpad, 9) ||
+            (scratchpad[0] == 0xFF && scratchpad[1] == 0xFF && scratchpad[8] == 0xFF))
+        {
+            status = NBD_READ_NO_DEVICE; // bus stuck low (its CRC is 0 too) or nobody pulled it low
+            continue;
+        }
+        if (verifyCrc && crc8(scratchpad, 8) != scratchpad[8])
+        {
+            status = NBD_READ_CRC_ERROR;
+            continue;
+        }
+        status = NBD_READ_OK;
+        return scratchpadToRaw(address, scratchpad, options.resolution);
+    }
+    return DEVICE_DISCONNECTED_RAW;
+}
+
+uint8_t NBD_Transport::crc8(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--)
+    {
+        uint8_t in = *data++;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            uint8_t mix = (crc ^ in) & 0x01;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+            in >>= 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * Converts the temperature bytes of a scratchpad into DallasTemperature raw units (1/128 °C).
+ *
+ * @param address the device, its family code selects the format
+ * @param scratchpad 2 bytes, 9 for the DS18S20
+ * @param resolution resolution of the device, undefined low bits are cleared
+ *
+ * @return the temperature in raw units
+ */
+int32_t NBD_Transport::scratchpadToRaw(const uint8_t *address, const uint8_t *scratchpad, uint8_t resolution)
+{
+    int16_t value = (int16_t)(((uint16_t)scratchpad[1] << 8) | scratchpad[0]);
+    if (address[0] == 0x10)
+    {
+        // DS18S20: 0.5 °C steps extended with COUNT_REMAIN (byte 6) and COUNT_PER_C (byte 7)
+        int32_t raw = ((int32_t)(value & 0xFFFE) << 6) - 32;
+        if (scratchpad[7] != 0)
+            raw += ((int32_t)(scratchpad[7] - scratchpad[6]) << 7) / scratchpad[7];
+        return raw;
+    }
+    if (resolution >= 9 && resolution < 12)
+        value &= ~((1 << (12 - resolution)) - 1);
+    return (int32_t)value * 8; // 1/16 °C to 1/128 °C
+}
+
+void NBD_Transport::readBytes(uint8_t *buf, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        buf[i] = read();
+    }
+}
+
+//==============================================================================================
+//                                  NBD_DallasTransport
+//==============================================================================================
+
+NBD_DallasTransport::NBD_DallasTransport(DallasTemperature *dallasTemp, OneWire *oneWire)
+{
+    _dallasTemp = dallasTemp;
+    _oneWire = oneWire;
+}
+
+void NBD_DallasTransport::begin()
+{
+    _dallasTemp->begin();
+    _dallasTemp->setWaitForConversion(false); // Avoid blocking the CPU waiting for the sensors conversion
+}
+
+uint8_t NBD_DallasTransport::getDeviceCount()
+{
+    return _dallasTemp->getDeviceCount();
+}
+
+bool NBD_DallasTransport::getAddress(uint8_t *address, uint8_t index)
+{
+    return _dallasTemp->getAddress(address, index);
+}
+
+void NBD_DallasTransport::setResolution(uint8_t bits)
+{
+    _dallasTemp->setResolution(bits);
+}
+
+bool NBD_DallasTransport::isParasitePowerMode()
+{
+    return _dallasTemp->isParasitePowerMode();
+}
+
+void NBD_DallasTransport::requestTemperatures()
+{
+    _dallasTemp->requestTemperatures();
+}
+
+void NBD_DallasTransport::requestTemperatureByAddress(const uint8_t *address)
+{
+    _dallasTemp->requestTemperaturesByAddress(address);
+}
+
+bool NBD_DallasTransport::isConversionComplete()
+{
+    return _dallasTemp->isConversionComplete();
+}
+
+int32_t NBD_DallasTransport::getTempRaw(const uint8_t *address)
+{
+    return _dallasTemp->getTemp(address);
+}
+
+uint16_t NBD_DallasTransport::millisToWaitForConversion(uint8_t bits)
+{
+    return DallasTemperature::millisToWaitForConversion(bits);
+}
+
+bool NBD_DallasTransport::hasPrimitives()
+{
+    return _oneWire != nullptr;
+}
+
+bool NBD_DallasTransport::reset()
+{
+    return _oneWire != nullptr && _oneWire->reset();
+}
+
+void NBD_DallasTransport::select(const uint8_t *address)
+{
+    if (_oneWire)
+        _oneWire->select(address);
+}
+
+void NBD_DallasTransport::skip()
+{
+    if (_oneWire)
+        _oneWire->skip();
+}
+
+void NBD_DallasTransport::write(uint8_t value, bool power)
+{
+    if (_oneWire)
+        _oneWire->write(value, power);
+}
+
+uint8_t NBD_DallasTransport::read()
+{
+    return (_oneWire != nullptr) ? _oneWire->read() : 0xFF;
+}
+
+void NBD_DallasTransport::resetSearch()
+{
+    if (_oneWire)
+        _oneWire->reset_search();
+}
+
+bool NBD_DallasTransport::search(uint8_t *address)
+{
+    return _oneWire != nullptr && _oneWire->search(address);
+}
+
+DallasTemperature *NBD_DallasTransport::getDallasTemperature()
+{
+    return _dallasTemp;
+}
@@ -0,0 +1,101 @@
+#ifndef NBD_TRANSPORT_H
+#define NBD_TRANSPORT_H
+
+#include <DallasTemperature.h>
+
+struct NBD_ReadOptions
+{
+    bool    skipRom = false;    //Address the only device of the bus with Skip ROM instead of Match ROM
+    bool    verifyCrc = true;   //Read the 9 byte scratchpad and check its CRC, otherwise read the 2 temperature bytes only
+    uint8_t retries = 0;        //Extra attempts after a CRC error or a missing presence pulse
+    uint8_t resolution = 12;    //Resolution of the devices, undefined low bits are cleared
+};
+
+enum NBD_ReadStatus
+{
+    NBD_READ_OK = 0,
+    NBD_READ_NO_DEVICE,         //No presence pulse or the device did not answer
+    NBD_READ_CRC_ERROR          //Scratchpad CRC mismatch on every attempt
+};
+
+/*
+Bus transport behind NonBlockingDallas. The state machine only talks to this interface, so the
+bit-banged OneWire/DallasTemperature path (NBD_DallasTransport) can be replaced by other 1-Wire
+masters (UART, DS2482, RMT), by a kernel driver or by a simulator.
+
+The device level methods are required. The 1-Wire primitives are optional: a transport that
+cannot expose the raw bus returns false from reset(), and the features built on them fall back
+to the device level methods.
+*/
+class NBD_Transport
+{
+public:
+    virtual ~NBD_Transport() {}
+
+    //Device level
+    virtual void     begin() = 0;                                      //Scans the bus
+    virtual uint8_t  getDeviceCount() = 0;
+    virtual bool     getAddress(uint8_t *address, uint8_t index) = 0;
+    virtual void     setResolution(uint8_t bits) = 0;                  //All devices
+    virtual bool     isParasitePowerMode() = 0;
+    virtual void     requestTemperatures() = 0;                        //Convert T on all devices, does not wait
+    virtual void     requestTemperatureByAddress(const uint8_t *address); //Convert T on one device, does not wait
+    virtual bool     isConversionComplete() = 0;                       //Conversion status poll
+    virtual int32_t  getTempRaw(const uint8_t *address) = 0;           //1/128 °C, DEVICE_DISCONNECTED_RAW on failure
+    virtual uint16_t millisToWaitForConversion(uint8_t bits);
+    virtual bool     drivesBus() { return true; }                      //false if another master (kernel, recording) runs the conversions
+
+    //Scratchpad read with the fast paths of NBD_ReadOptions, falls back to getTempRaw() without primitives
+    virtual int32_t  readTemp(const uint8_t *address, const NBD_ReadOptions &options, NBD_ReadStatus &status);
+
+    //1-Wire primitives
+    virtual bool     hasPrimitives() { return false; }
+    virtual bool     reset() { return false; }                         //true if a presence pulse was seen
+    virtual void     select(const uint8_t *address) { (void)address; } //Match ROM
+    virtual void     skip() {}                                         //Skip ROM
+    virtual void     write(uint8_t value, bool power = false) { (void)value; (void)power; }
+    virtual uint8_t  read() { return 0xFF; }
+    virtual void     readBytes(uint8_t *buf, uint16_t len);
+    virtual void     resetSearch() {}
+    virtual bool     search(uint8_t *address) { (void)address; return false; } //One search step, false when done
+
+    static uint8_t   crc8(const uint8_t *data, uint8_t len);  //Maxim 1-Wire CRC
+    static int32_t   scratchpadToRaw(const uint8_t *address, const uint8_t *scratchpad, uint8_t resolution);
+};
+
+/*
+The original path: DallasTemperature on top of the bit-banged OneWire library.
+Pass the OneWire object too to make the 1-Wire primitives available.
+*/
+class NBD_DallasTransport : public NBD_Transport
+{
+public:
+    NBD_DallasTransport(DallasTemperature *dallasTemp, OneWire *oneWire = nullptr);
+
+    void     begin() override;
+    uint8_t  getDeviceCount() override;
+    bool     getAddress(uint8_t *address, uint8_t index) override;
+    void     setResolution(uint8_t bits) override;
+    bool     isParasitePowerMode() override;
+    void     requestTemperatures() override;
+    void     requestTemperatureByAddress(const uint8_t *address) override;
+    bool     isConversionComplete() override;
+    int32_t  getTempRaw(const uint8_t *address) override;
+    uint16_t millisToWaitForConversion(uint8_t bits) override;
+
+    bool     hasPrimitives() override;
+    bool     reset() override;
+    void     select(const uint8_t *address) override;
+    void     skip() override;
+    void     write(uint8_t value, bool power = false) override;
+    uint8_t  read() override;
+    void     resetSearch() override;
+    bool     search(uint8_t *address) override;
+
+    DallasTemperature *getDallasTemperature();
+
+private:
+    DallasTemperature *_dallasTemp;
+    OneWire           *_oneWire;
+};
+#endif /* NBD_TRANSPORT_H */
@@ -0,0 +1,272 @@
+#include "NBD_w1sysfs.h"
+
+#if defined(__linux__) && !defined(ESP_PLATFORM)
+
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+//Families of the thermometers handled by the w1_therm kernel driver
+static bool isThermometer(uint8_t family)
+{
+    return family == 0x28 || family == 0x10 || family == 0x22 || family == 0x3B || family == 0x42;
+}
+
+NBD_W1SysfsTransport::NBD_W1SysfsTransport(const char *devicesPath, const char *busMaster)
+    : _complete(false)
+{
+    _root = devicesPath;
+    _master = (busMaster != nullptr) ? busMaster : "";
+    _requested = false;
+    _stop = false;
+}
+
+NBD_W1SysfsTransport::~NBD_W1SysfsTransport()
+{
+    stopWorker();
+}
+
+/**
+ * Converts a w1 sysfs id into a DeviceAddress. The id holds the family code and the 48 bit
+ * serial number most significant byte first, the ROM has it least significant byte first.
+ *
+ * @param id e.g. "28-0316a279d8ff"
+ * @param address receives the ROM, with its CRC
+ *
+ * @return false if id is not a device id
+ */
+bool NBD_W1SysfsTransport::idToAddress(const char *id, uint8_t *address)
+{
+    if (strlen(id) != 15 || id[2] != '-')
+        return false;
+    char hex[3] = {0, 0, 0};
+    char *end;
+    hex[0] = id[0];
+    hex[1] = id[1];
+    address[0] = (uint8_t)strtoul(hex, &end, 16);
+    if (*end != 0)
+        return false;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        hex[0] = id[3 + 2 * i];
+        hex[1] = id[4 + 2 * i];
+        address[6 - i] = (uint8_t)strtoul(hex, &end, 16);
+        if (*end != 0)
+            return false;
+    }
+    address[7] = crc8(address, 7);
+    return true;
+}
+
+/**
+ * Scans the devices directory and starts the worker thread.
+ */
+void NBD_W1SysfsTransport::begin()
+{
+    stopWorker();
+    _devices.clear();
+
+    DIR *dir = opendir(_root.c_str());
+    if (dir == nullptr)
+        return;
+    bool autoMaster = _master.empty();
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        Device device;
+        if (idToAddress(entry->d_name, device.address) && isThermometer(device.address[0]))
+        {
+            device.path = _root + "/" + entry->d_name;
+            device.raw = DEVICE_DISCONNECTED_RAW;
+            _devices.push_back(device);
+        }
+        else if (autoMaster && strncmp(entry->d_name, "w1_bus_master", 13) == 0)
+        {
+            _master = entry->d_name;
+            autoMaster = false;
+        }
+    }
+    closedir(dir);
+
+    // readdir() order is arbitrary, keep the indices stable across scans
+    std::sort(_devices.begin(), _devices.end(), [](const Device &a, const Device &b)
+              { return memcmp(a.address, b.address, sizeof(DeviceAddress)) < 0; });
+
+    _stop = false;
+    _requested = false;
+    _complete = false;
+    _worker = std::thread(&NBD_W1SysfsTransport::workerLoop, this);
+}
+
+uint8_t NBD_W1SysfsTransport::getDeviceCount()
+{
+    return (uint8_t)std::min<size_t>(_devices.size(), 255);
+}
+
+bool NBD_W1SysfsTransport::getAddress(uint8_t *address, uint8_t index)
+{
+    if (index >= _devices.size())
+        return false;
+    memcpy(address, _devices[index].address, sizeof(DeviceAddress));
+    return true;
+}
+
+/**
+ * Sets the resolution through the resolution attribute of w1_therm (kernel 5.10 and later).
+ */
+void NBD_W1SysfsTransport::setResolution(uint8_t bits)
+{
+    char value[4];
+    snprintf(value, sizeof(value), "%u", bits);
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        writeFile(_devices[i].path + "/resolution", value);
+    }
+}
+
+/**
+ * Reads the ext_power attribute of w1_therm, 0 means parasite powered.
+ */
+bool NBD_W1SysfsTransport::isParasitePowerMode()
+{
+    std::string content;
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        if (readFile(_devices[i].path + "/ext_power", content) && atoi(content.c_str()) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Hands the conversion over to the worker thread and returns immediately.
+ */
+void NBD_W1SysfsTransport::requestTemperatures()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _complete = false;
+    _requested = true;
+    _wake.notify_one();
+}
+
+bool NBD_W1SysfsTransport::isConversionComplete()
+{
+    return _complete;
+}
+
+int32_t NBD_W1SysfsTransport::getTempRaw(const uint8_t *address)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        if (memcmp(_devices[i].address, address, sizeof(DeviceAddress)) == 0)
+            return _devices[i].raw;
+    }
+    return DEVICE_DISCONNECTED_RAW;
+}
+
+//==============================================================================================
+//                                  PRIVATE
+//==============================================================================================
+
+void NBD_W1SysfsTransport::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _wake.wait(lock, [this]()
+                   { return _requested || _stop; });
+        if (_stop)
+            return;
+        _requested = false;
+        lock.unlock();
+        convertAndRead();
+        lock.lock();
+        _complete = !_requested;
+    }
+}
+
+void NBD_W1SysfsTransport::convertAndRead()
+{
+    // With therm_bulk_read all sensors convert at once and the reads below return the results,
+    // otherwise every read converts its own sensor
+    if (!_master.empty())
+    {
+        std::string bulk = _root + "/" + _master + "/therm_bulk_read";
+        if (writeFile(bulk, "trigger\n"))
+        {
+            std::string state;
+            while (readFile(bulk, state) && atoi(state.c_str()) == -1)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+    for (size_t i = 0; i < _devices.size(); i++)
+    {
+        int32_t raw = readDevice(_devices[i]);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _devices[i].raw = raw;
+    }
+}
+
+int32_t NBD_W1SysfsTransport::readDevice(const Device &device)
+{
+    std::string content;
+    long milli;
+    if (readFile(device.path + "/temperature", content) && !content.empty())
+    {
+        milli = atol(content.c_str());
+    }
+    else if (readFile(device.path + "/w1_slave", content))
+    {
+        // "xx xx ... : crc=xx YES\nxx xx ... t=21375\n"
+        size_t t = content.find("t=");
+        if (content.find("YES") == std::string::npos || t == std::string::npos)
+            return DEVICE_DISCONNECTED_RAW;
+        milli = atol(content.c_str() + t + 2);
+    }
+    else
+    {
+        return DEVICE_DISCONNECTED_RAW;
+    }
+    // millidegrees to 1/128 °C, rounded
+    return (int32_t)((milli * 128 + (milli < 0 ? -500 : 500)) / 1000);
+}
+
+void NBD_W1SysfsTransport::stopWorker()
+{
+    if (!_worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _wake.notify_one();
+    }
+    _worker.join();
+}
+
+bool NBD_W1SysfsTransport::readFile(const std::string &path, std::string &content)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+        return false;
+    std::stringstream ss;
+    ss << file.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+bool NBD_W1SysfsTransport::writeFile(const std::string &path, const char *content)
+{
+    std::ofstream file(path.c_str());
+    if (!file)
+        return false;
+    file << content;
+    return (bool)file;
+}
+
+#endif
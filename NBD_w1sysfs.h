@@ -0,0 +1,70 @@
+#ifndef NBD_W1SYSFS_H
+#define NBD_W1SYSFS_H
+
+#if defined(__linux__) && !defined(ESP_PLATFORM)
+
+#include "NBD_transport.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NBD_W1_DEVICES_PATH "/sys/bus/w1/devices"
+
+/*
+Transport for Linux hosts with the w1 kernel driver (e.g. w1-gpio on a single board computer).
+Sensors are found in the w1 sysfs tree (28-xxxxxxxxxxxx, plus the other Maxim thermometer
+families) and their ids are mapped onto DeviceAddress, so names and NonBlockingDallasArray work
+unchanged. Conversions are started with therm_bulk_read of the bus master when the kernel
+has it; the file I/O, which blocks for the conversion time, runs on a worker thread so update()
+never blocks. The root directory can point to a fake tree for testing.
+*/
+class NBD_W1SysfsTransport : public NBD_Transport
+{
+public:
+    NBD_W1SysfsTransport(const char *devicesPath = NBD_W1_DEVICES_PATH, const char *busMaster = nullptr);
+    ~NBD_W1SysfsTransport();
+
+    void     begin() override;
+    uint8_t  getDeviceCount() override;
+    bool     getAddress(uint8_t *address, uint8_t index) override;
+    void     setResolution(uint8_t bits) override;
+    bool     isParasitePowerMode() override;
+    void     requestTemperatures() override;
+    bool     isConversionComplete() override;
+    int32_t  getTempRaw(const uint8_t *address) override;
+    bool     drivesBus() override { return false; } //The kernel feeds parasite sensors
+
+    static bool idToAddress(const char *id, uint8_t *address); //"28-0316a279d8ff" to DeviceAddress
+
+private:
+    struct Device
+    {
+        DeviceAddress address;
+        std::string   path;         //Directory of the device
+        int32_t       raw;          //Last value read by the worker
+    };
+
+    std::string         _root;
+    std::string         _master;    //Bus master directory, empty if there is none
+    std::vector<Device> _devices;
+    std::mutex          _mutex;     //Protects _devices[].raw and the request flags
+    std::condition_variable _wake;
+    std::thread         _worker;
+    bool                _requested;
+    bool                _stop;
+    std::atomic<bool>   _complete;
+
+    void    workerLoop();
+    void    convertAndRead();
+    int32_t readDevice(const Device &device);
+    void    stopWorker();
+    static bool readFile(const std::string &path, std::string &content);
+    static bool writeFile(const std::string &path, const char *content);
+};
+
+#endif
+#endif /* NBD_W1SYSFS_H */
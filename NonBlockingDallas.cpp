@@ -21,46 +21,46 @@
 // SOFTWARE.
 
 #include "NonBlockingDallas.h"
+#include "NBD_coro.h"
 #include <algorithm>
 #include <wstring.h>
 
 NonBlockingDallas::NonBlockingDallas(DallasTemperature *dallasTemp, unsigned char pin)
+    : _dallasTransport(dallasTemp)
 {
-    _gpiopin = pin;
-    _dallasTemp = dallasTemp;
-    _lastReadingMillis = 0;
-    _startConversionMillis = 0;
-    _conversionMillis = 0;
-    _currentState = notFound;
-    cb_onIntervalElapsed = NULL;
-    cb_onTemperatureChange = NULL;
-    _pathofsensornames = "";
-    _wireName = String("GPIO"); // Set default wire name
-    _wireName += String(_gpiopin);
+    _bus = &_dallasTransport;
+    init(pin, "");
 }
 
 NonBlockingDallas::NonBlockingDallas(DallasTemperature *dallasTemp, unsigned char pin, String pathofsensornames)
+    : _dallasTransport(dallasTemp)
 {
-    _gpiopin = pin;
-    _dallasTemp = dallasTemp;
-    _lastReadingMillis = 0;
-    _startConversionMillis = 0;
-    _conversionMillis = 0;
-    _currentState = notFound;
-    cb_onIntervalElapsed = NULL;
-    cb_onTemperatureChange = NULL;
-    _wireName =  String("GPIO"); // Set default wire name
-    _wireName += String(_gpiopin);
-    _pathofsensornames = pathofsensornames;
+    _bus = &_dallasTransport;
+    init(pin, pathofsensornames);
+}
+
+NonBlockingDallas::NonBlockingDallas(NBD_Transport *transport, unsigned char pin)
+    : _dallasTransport(nullptr)
+{
+    _bus = transport;
+    init(pin, "");
+}
+
+NonBlockingDallas::NonBlockingDallas(NBD_Transport *transport, unsigned char pin, String pathofsensornames)
+    : _dallasTransport(nullptr)
+{
+    _bus = transport;
+    init(pin, pathofsensornames);
 }
 
 void NonBlockingDallas::begin(NBD_resolution res, NBD_unitsOfMeasure uom, unsigned long tempInterval)
 {
+    NBD_LockGuard guard(_lock);
     _res = res;
     _tempInterval = tempInterval;
     _unitsOM = uom;
     _currentState = notFound;
-    _conversionMillis = DallasTemperature::millisToWaitForConversion(_res);
+    _conversionMillis = _bus->millisToWaitForConversion(_res);
     rescanWire();
 
     if ((_tempInterval < _conversionMillis) || (_tempInterval > 4294967295UL))
@@ -78,7 +78,7 @@ void NonBlockingDallas::begin(NBD_resolution res, NBD_unitsOfMeasure uom, unsign
     if (getSensorsCount() > 0)
     {
         _DS18B20_PP(F("DS18B20: parasite power is "));
-        if (_dallasTemp->isParasitePowerMode())
+        if (_parasite)
         {
             _DS18B20_PP(F("ON"));
         }
@@ -95,7 +95,46 @@ void NonBlockingDallas::begin(NBD_resolution res, NBD_unitsOfMeasure uom, unsign
 //                                  PRIVATE
 //==============================================================================================
 
-
+void NonBlockingDallas::init(unsigned char pin, String pathofsensornames)
+{
+    _gpiopin = pin;
+    _lastReadingMillis = 0;
+    _startConversionMillis = 0;
+    _conversionMillis = 0;
+    _cycles = 0;
+    _nameErrors = 0;
+    _lastNameError = NBD_NO_ERROR;
+    _currentState = notFound;
+    _historySamples = 0;
+    _historyTierCount = 0;
+    _compressedBlocks = 0;
+    _compressedResolution = 1000;
+    _readingQueue = nullptr;
+    _wireSlot = 0;
+    _publishNotify = nullptr;
+    _publishNotifyCtx = nullptr;
+    _indexNotify = nullptr;
+    _indexNotifyCtx = nullptr;
+    _observer = nullptr;
+    _trace = nullptr;
+    _calibrationChanged = true;
+    _quarantineAfter = 0;
+    _maxBackoffCycles = 32;
+    cb_onIntervalElapsed = NULL;
+    cb_onTemperatureChange = NULL;
+    cb_onPriorityReadComplete = NULL;
+    _parasite = false;
+    _parasiteMaxParallel = NBD_PARASITE_MAX_PARALLEL;
+    _reservedSensors = 0;
+    _serialIndex = 0;
+    _priorityPending = false;
+    _priorityRequested = 0;
+    _priorityCompleted = 0;
+    String wirename = String("GPIO") + String(_gpiopin); // Set default wire name
+    ENUM_NBD_ERROR err;
+    setWireName(wirename, err);
+    _pathofsensornames = pathofsensornames;
+}
 
 void NonBlockingDallas::waitNextReading()
 {
@@ -105,22 +144,108 @@ void NonBlockingDallas::waitNextReading()
     requestTemperature();
 }
 
+/**
+ * Tells if the running conversion is over. In parasite mode the bus must stay high for the whole
+ * conversion, polling would drop the strong pull-up, so the conversion time is waited instead.
+ * Transports that do not drive the bus themselves (kernel driver, replay) are always polled.
+ */
+bool NonBlockingDallas::conversionDone()
+{
+    if (timedConversion())
+        return millis() - _startConversionMillis >= _bus->millisToWaitForConversion(_res);
+    return _bus->isConversionComplete();
+}
+
+bool NonBlockingDallas::timedConversion()
+{
+    return _parasite && _bus->drivesBus();
+}
+
+/**
+ * Tells if the sensors must convert one by one: a weak pull-up cannot feed many parasite
+ * sensors converting at once.
+ */
+bool NonBlockingDallas::serializeConversions()
+{
+    return timedConversion() && _parasiteMaxParallel > 0 && _sdv.size() > _parasiteMaxParallel;
+}
+
 void NonBlockingDallas::waitConversionAndRead()
 {
-    if (!_dallasTemp->isConversionComplete())
+    if (!conversionDone())
         return;
 
+    trace(NBD_TRACE_CONVERSION_END, NBD_TRACE_ALL);
     // Save the actual sensor conversion time to precisely calculate the next reading time
     _conversionMillis = millis() - _startConversionMillis;
     Serial.println("Conversion takes:" + String(_conversionMillis) + " ms");
     readSensors();
 }
 
+void NonBlockingDallas::waitPriorityConversion()
+{
+    if (!conversionDone())
+        return;
+
+    int index = -1;
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        if (sameAddress(_sdv[i].sensorAddress, _priorityAddress))
+            index = i;
+    }
+    trace(NBD_TRACE_CONVERSION_END, (uint16_t)index);
+    if (index >= 0)
+        readTemperatures(index, true);
+    completePriorityRead(index);
+    publishSnapshot();
+    _currentState = waitingNextReading; // the periodic schedule goes on unchanged
+}
+
+void NonBlockingDallas::completePriorityRead(int deviceIndex)
+{
+    _priorityPending = false;
+    _priorityCompleted = _priorityRequested;
+    if (!cb_onPriorityReadComplete)
+        return;
+    NBD_TraceScope scope(_trace, NBD_TRACE_CALLBACK_START, _wireSlot, NBD_TRACE_CB_PRIORITY_READ_COMPLETE);
+    if (deviceIndex < 0)
+    {
+        (*cb_onPriorityReadComplete)((_unitsOM == unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F,
+                                     false, getWireName(), getGPIO(), deviceIndex);
+        return;
+    }
+    (*cb_onPriorityReadComplete)(_sdv.at(deviceIndex).temperature, _sdv.at(deviceIndex).valid,
+                                 getWireName(), getGPIO(), deviceIndex);
+}
+
 void NonBlockingDallas::readSensors()
 {
+    // A priority read that came in during the conversion is served first
+    int first = -1;
+    if (_priorityPending)
+    {
+        for (size_t i = 0; i < _sdv.size(); i++)
+        {
+            if (sameAddress(_sdv[i].sensorAddress, _priorityAddress))
+                first = i;
+        }
+        if (first >= 0)
+            readTemperatures(first, true);
+        completePriorityRead(first);
+    }
+
+    // Read the whole wire, then calibrate and convert it in one pass, then store and notify
     for (int i = 0; i < getSensorsCount(); i++)
     {
-        readTemperatures(i);
+        if (i != first)
+            acquireReading(i);
+    }
+    convertReadings(0, _sdv.size());
+    for (int i = 0; i < getSensorsCount(); i++)
+    {
+        if (i == first)
+            continue;
+        storeReading(i);
 #ifdef DEBUG_DS18B20
         ENUM_NBD_ERROR err;
         _DS18B20_PP(F("Sensor ("));
@@ -159,266 +284,1517 @@ void NonBlockingDallas::readSensors()
 #endif
     }
 
-    _lastReadingMillis = millis();
-    _currentState = waitingNextReading;
+    finishCycle();
 }
 
-void NonBlockingDallas::readTemperatures(int deviceIndex)
+void NonBlockingDallas::waitSerialConversion()
 {
-    float temp = (_unitsOM==unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
-    bool validReadout = false;
-    switch (_unitsOM)
-    {
-    case unit_C:
-        temp = _dallasTemp->getTempC(_sdv.at(deviceIndex).sensorAddress);
-        validReadout = (temp != DEVICE_DISCONNECTED_C); //-127.0
-        break;
-    case unit_F:
-        temp = _dallasTemp->getTempF(_sdv.at(deviceIndex).sensorAddress);
-        validReadout = (temp != DEVICE_DISCONNECTED_F); //-196.6
-        break;
-    }
-    if (_sdv.at(deviceIndex).temperature != temp && validReadout)
+    if (!conversionDone())
+        return;
+
+    if (_serialIndex < _sdv.size())
     {
-        if (cb_onTemperatureChange)
-            (*cb_onTemperatureChange)(temp, validReadout, _wireName, getGPIO(), deviceIndex);
+        trace(NBD_TRACE_CONVERSION_END, _serialIndex);
+        bool priority = _priorityPending && sameAddress(_sdv[_serialIndex].sensorAddress, _priorityAddress);
+        readTemperatures(_serialIndex, priority);
+        if (priority)
+            completePriorityRead(_serialIndex);
+        _serialIndex++;
     }
-
-    if (validReadout)
+    if (_serialIndex < _sdv.size())
     {
-        _sdv.at(deviceIndex).lastTimeOfValidTemp = millis();
+        _startConversionMillis = millis();
+        trace(NBD_TRACE_CONVERSION_START, _serialIndex);
+        _bus->requestTemperatureByAddress(_sdv[_serialIndex].sensorAddress);
+        return;
     }
-    _sdv.at(deviceIndex).temperature = temp;
-    _sdv.at(deviceIndex).valid=validReadout;
-
-    if (cb_onIntervalElapsed)
-        (*cb_onIntervalElapsed)(temp, validReadout, _wireName, getGPIO(), deviceIndex);
+    if (_priorityPending)
+        completePriorityRead(-1); // the sensor was not on the wire anymore
+    finishCycle();
 }
 
-//==============================================================================================
-//                                  PUBLIC
-//==============================================================================================
-
-void NonBlockingDallas::update()
+void NonBlockingDallas::notifyIndexChanged()
 {
-    switch (_currentState)
-    {
-    case notFound:
-
-        break;
-    case waitingNextReading:
-        waitNextReading();
-        break;
-    case waitingConversionAndRead:
-        waitConversionAndRead();
-        break;
-    }
+    if (_indexNotify)
+        (*_indexNotify)(_indexNotifyCtx);
 }
 
-void NonBlockingDallas::requestTemperature()
+void NonBlockingDallas::finishCycle()
 {
-    _currentState = waitingConversionAndRead;
-    _startConversionMillis = millis();
-    _dallasTemp->requestTemperatures(); // Requests a temperature conversion for all the sensors on the bus
-
-    _DS18B20_PL(F("DS18B20: requested new reading."));
+    publishSnapshot();
+    _lastReadingMillis = millis();
+    _cycles++;
+    _currentState = waitingNextReading;
 }
 
-void NonBlockingDallas::rescanWire()
+bool NonBlockingDallas::skipQuarantined(SensorData &sd)
 {
-    _dallasTemp->begin();
-    _dallasTemp->setWaitForConversion(false); // Avoid blocking the CPU waiting for the sensors conversion
-    _currentState = notFound;
-    
-    DeviceAddress newaddress;
-    _sdv.clear();
-
-    _currentState = waitingNextReading;
-    _dallasTemp->setResolution((uint8_t)_res);
+    if (!sd.health.quarantined || sd.health.cyclesToSkip == 0)
+        return false;
+    sd.health.cyclesToSkip--;
+    return true;
+}
 
-    _DS18B20_PL(String(__FUNCTION__)+" sensors count:"+String(getSensorsCount()));
-    
-    for (int i = 0; i < getSensorsCount(); i++)
-    {  
-        _sdv.emplace_back();
-        if (_dallasTemp->getAddress(&newaddress[0], i))
+void NonBlockingDallas::updateHealth(SensorData &sd, ENUM_NBD_ERROR error)
+{
+    NBD_SensorHealth &h = sd.health;
+    h.reads++;
+    h.lastError = error;
+    if (error == NBD_FILTER_REJECTED)
+    {
+        // a real step change is rejected a few times before the filter follows it
+        h.rejects++;
+        return;
+    }
+    if (error == NBD_NO_ERROR)
+    {
+        if (h.quarantined)
         {
-            for (size_t a = 0; a < 8; a++)
-            {
-                _sdv.at(i).sensorAddress[a] = newaddress[a];
-            }
-            if(_pathofsensornames!= "")
-            {
-            ENUM_NBD_ERROR err = NBD_NO_ERROR;
-            setSensorNameByAddress(_sdv.at(i).sensorAddress,
-                                   _sjsonp.getValueByKeyFromFile(_pathofsensornames,
-                                                                 addressToString(_sdv.at(i).sensorAddress)),
-                                   err);
-            if(err!=NBD_NO_ERROR)
-            {
-             _DS18B20_PL(String(__FUNCTION__)+F(" Error setting sensor name by address. NBD error code:")+String(err));
-            }
-            }
+            _DS18B20_PL(String(__FUNCTION__) + F(" sensor recovered: ") + addressToString(sd.sensorAddress));
         }
+        h.consecutiveFailures = 0;
+        h.quarantined = false;
+        h.backoffCycles = 0;
+        h.cyclesToSkip = 0;
+        return;
     }
-    _sdv.shrink_to_fit();
-}
+    h.failures++;
+    if (error == NBD_CRC_ERROR)
+        h.crcErrors++;
+    if (h.consecutiveFailures < 0xFFFF)
+        h.consecutiveFailures++;
 
-ENUM_NBD_ERROR NonBlockingDallas::getAddressByIndex(unsigned char index, DeviceAddress &address)
-{
-    if (index >= getSensorsCount())
+    if (_quarantineAfter == 0 || h.consecutiveFailures < _quarantineAfter)
+        return;
+    // exponential backoff: 1, 2, 4 ... _maxBackoffCycles cycles between attempts
+    if (!h.quarantined)
     {
-        return NBD_INDEX_IS_OUT_OF_RANGE;
+        _DS18B20_PL(String(__FUNCTION__) + F(" sensor quarantined: ") + addressToString(sd.sensorAddress));
+        h.quarantined = true;
+        h.backoffCycles = 1;
     }
-    for (size_t i = 0; i < 8; i++)
+    else if (h.backoffCycles < _maxBackoffCycles)
     {
-        address[i] = _sdv.at(index).sensorAddress[i];
+        h.backoffCycles = (h.backoffCycles * 2 > _maxBackoffCycles) ? _maxBackoffCycles : h.backoffCycles * 2;
     }
-    return NBD_NO_ERROR;
+    h.cyclesToSkip = h.backoffCycles;
 }
 
-const unsigned char NonBlockingDallas::getSensorsCount()
+void NonBlockingDallas::publishSnapshot()
 {
-    return _dallasTemp->getDeviceCount();
+    uint8_t count = (uint8_t)_sdv.size();
+    NBD_SensorSnapshot *entries = _snapshot.beginWrite(count);
+    _snapshot.endWrite(fillReadings(entries, count));
+    if (_observer)
+        _observer->onPublished(_wireSlot);
+    if (_publishNotify)
+        (*_publishNotify)(_publishNotifyCtx);
 }
 
-float NonBlockingDallas::getTempByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+uint8_t NonBlockingDallas::fillReadings(NBD_SensorSnapshot *out, uint8_t max)
 {
-    if (index >= getSensorsCount())
+    uint8_t n = (_sdv.size() < max) ? _sdv.size() : max;
+    for (uint8_t i = 0; i < n; i++)
     {
-        err = NBD_INDEX_IS_OUT_OF_RANGE;
-        return (_unitsOM==unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+        const SensorData &sd = _sdv[i];
+        out[i].handle = handleOf(i);
+        out[i].raw = sd.rawTemperature;
+        out[i].temperature = sd.temperature;
+        out[i].valid = sd.valid;
+        out[i].lastTimeOfValidTemp = sd.lastTimeOfValidTemp;
+        memcpy(out[i].address, sd.sensorAddress, sizeof(DeviceAddress));
     }
-    err=NBD_NO_ERROR;
-    return _sdv.at(index).temperature;
+    return n;
 }
 
-unsigned char NonBlockingDallas::getGPIO()
+/**
+ * Reads, converts and stores the reading of one sensor.
+ *
+ * @param force read a quarantined sensor too, for the explicit priority reads
+ */
+void NonBlockingDallas::readTemperatures(int deviceIndex, bool force)
 {
-    return _gpiopin;
+    if (!acquireReading(deviceIndex, force))
+        return;
+    convertReadings(deviceIndex, 1);
+    storeReading(deviceIndex);
 }
 
-
-float NonBlockingDallas::getTempByName(String name, ENUM_NBD_ERROR &err)
+/**
+ * Reads the scratchpad of a sensor and runs its filter. The outcome waits in the calibration
+ * pass until convertReadings() and storeReading().
+ *
+ * @param force read the sensor even if it is quarantined
+ *
+ * @return false if the sensor is quarantined and was not read
+ */
+bool NonBlockingDallas::acquireReading(int deviceIndex, bool force)
 {
-    auto compareNames = [&](const SensorData &sd)
-    { return sd.sensorName == name; };
-    auto it = std::find_if(_sdv.begin(), _sdv.end(), compareNames);
-    if (it == _sdv.end())
+    SensorData &sd = _sdv.at(deviceIndex);
+    if (!force && skipQuarantined(sd))
+        return false;
+    if (_calibrationChanged)
     {
-        err = NBD_NAME_NOT_FOUND;
-        return (_unitsOM==unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+        _calibration.resize(_sdv.size());
+        for (size_t i = 0; i < _sdv.size(); i++)
+        {
+            _calibration.setCalibration(i, _sdv[i].calibration);
+        }
+        _calibrationChanged = false;
     }
-    err=NBD_NO_ERROR;
-    return it->temperature;
-}
+    NBD_TraceScope scope(_trace, NBD_TRACE_READ_START, _wireSlot, (uint16_t)deviceIndex);
+    NBD_ReadStatus status;
+    _readOptions.skipRom = (_sdv.size() == 1); // nobody else can answer
+    _readOptions.resolution = (uint8_t)_res;
+    int32_t raw = _bus->readTemp(sd.sensorAddress, _readOptions, status);
+    int32_t measured = raw; // the filter replaces raw with its output
+    bool validReadout = (status == NBD_READ_OK && raw != DEVICE_DISCONNECTED_RAW);
+    bool rejected = validReadout && !sd.filter.process(sd.filterConfig, raw);
 
-unsigned long NonBlockingDallas::getLastTimeOfValidTempByName(const String name, ENUM_NBD_ERROR &err)
-{
-    auto compareNames = [&](const SensorData &sd)
-    { return sd.sensorName == name; };
-    auto it = std::find_if(_sdv.begin(), _sdv.end(), compareNames);
-    if (it == _sdv.end())
+    ENUM_NBD_ERROR error = NBD_NO_ERROR;
+    if (status == NBD_READ_CRC_ERROR)
     {
-        err = NBD_NAME_NOT_FOUND;
-        return (_unitsOM==unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+        error = NBD_CRC_ERROR;
+        trace(NBD_TRACE_CRC_ERROR, (uint16_t)deviceIndex);
     }
-    err=NBD_NO_ERROR;
-    return it->lastTimeOfValidTemp;
-}
+    else if (!validReadout)
+        error = NBD_SENSOR_DISCONNECTED;
+    else if (rejected)
+        error = (measured == NBD_RAW_POWER_ON_RESET) ? NBD_POWER_ON_RESET : NBD_FILTER_REJECTED;
+    if (validReadout && measured == NBD_RAW_POWER_ON_RESET)
+        sd.health.powerOnResets++;
+    updateHealth(sd, error);
 
-unsigned long NonBlockingDallas::getLastTimeOfValidTempByIndex(unsigned char index, ENUM_NBD_ERROR &err)
-{
-    if (index >= getSensorsCount())
+    if (rejected)
     {
-        err = NBD_INDEX_IS_OUT_OF_RANGE;
-        return 0UL;
+        // Spike or power-on reset value: keep the last stored value, report the readout as invalid
+        _DS18B20_PL(String(__FUNCTION__) + F(" filter rejected sample of sensor ") + String(deviceIndex));
+        sd.pending = NBD_PENDING_REJECTED;
     }
-    err=NBD_NO_ERROR;
-    return _sdv.at(index).lastTimeOfValidTemp;
+    else
+        sd.pending = validReadout ? NBD_PENDING_VALID : NBD_PENDING_INVALID;
+    _calibration.setInput(deviceIndex, raw, sd.pending == NBD_PENDING_VALID);
+    return true;
 }
 
-bool NonBlockingDallas::setSensorNameByIndex(unsigned char index, String name, ENUM_NBD_ERROR &err)
+/**
+ * Applies the calibration and the unit of measure to the acquired readings of a range of
+ * sensors, in one pass.
+ */
+void NonBlockingDallas::convertReadings(int first, int count)
 {
-    if (index >= getSensorsCount())
-    {
-        err = NBD_INDEX_IS_OUT_OF_RANGE;
-        return false;
-    }
-     err=NBD_NO_ERROR;
-    _sdv.at(index).sensorName = name;
-    return true;
+    _calibration.run(first, count, _unitsOM == unit_F);
 }
 
-unsigned char NonBlockingDallas::getIndexBySensorName(String name, ENUM_NBD_ERROR &err)
+/**
+ * Stores the converted reading of a sensor and notifies it.
+ */
+void NonBlockingDallas::storeReading(int deviceIndex)
 {
-    auto compareNames = [&](const SensorData &sd)
-    { return sd.sensorName == name; };
-    auto it = std::find_if(_sdv.begin(), _sdv.end(), compareNames);
-    if (it == _sdv.end())
+    SensorData &sd = _sdv.at(deviceIndex);
+    if (sd.pending == NBD_PENDING_NONE)
+        return; // quarantined, not read in this cycle
+    bool validReadout = (sd.pending == NBD_PENDING_VALID);
+    bool rejected = (sd.pending == NBD_PENDING_REJECTED);
+    sd.pending = NBD_PENDING_NONE;
+    float temp = _calibration.getTemperature(deviceIndex);
+    if (rejected)
+        temp = sd.temperature;
+    else if (!validReadout)
+        temp = (_unitsOM == unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+    int32_t raw = _calibration.getRaw(deviceIndex);
+
+    if (sd.temperature != temp && validReadout)
     {
-        err = NBD_NAME_NOT_FOUND;
-        return 0;
+        if (cb_onTemperatureChange)
+        {
+            NBD_TraceScope cbScope(_trace, NBD_TRACE_CALLBACK_START, _wireSlot, NBD_TRACE_CB_TEMPERATURE_CHANGE);
+            (*cb_onTemperatureChange)(temp, validReadout, getWireName(), getGPIO(), deviceIndex);
+        }
     }
-    err=NBD_NO_ERROR;
-    return (unsigned char)std::distance(_sdv.begin(), it);
-}
 
-ENUM_NBD_ERROR NonBlockingDallas::getIndexBySensorName(String name, unsigned char &index)
-{
-    auto compareNames = [&](const SensorData &sd)
-    { return sd.sensorName == name; };
-    auto it = std::find_if(_sdv.begin(), _sdv.end(), compareNames);
-    if (it == _sdv.end())
+    if (validReadout)
     {
-        return NBD_NAME_NOT_FOUND;
+        sd.lastTimeOfValidTemp = millis();
+        sd.history.add(sd.lastTimeOfValidTemp, raw);
+        sd.compressed.add(sd.lastTimeOfValidTemp, raw);
     }
-    index = std::distance(_sdv.begin(), it);
-    return NBD_NO_ERROR;
-}
+    if (!rejected)
+    {
+        sd.rawTemperature = raw;
+        sd.temperature = temp;
+    }
+    sd.valid = validReadout;
 
-String NonBlockingDallas::getSensorNameByIndex(unsigned char index, ENUM_NBD_ERROR &err)
-{
-    if (index >= getSensorsCount())
+    if (_readingQueue)
     {
-        err = NBD_INDEX_IS_OUT_OF_RANGE;
-        return String("");
+        NBD_Reading reading;
+        reading.handle = handleOf(deviceIndex);
+        reading.raw = sd.rawTemperature;
+        reading.time = millis();
+        reading.valid = validReadout;
+        _readingQueue->push(reading);
     }
-    err=NBD_NO_ERROR;
-    return _sdv.at(index).sensorName;
-}
+    if (_observer)
+        _observer->onReading(handleOf(deviceIndex), sd.rawTemperature, validReadout);
 
-bool NonBlockingDallas::setSensorNameByAddress(const DeviceAddress addr, String name, ENUM_NBD_ERROR &err)
-{
-    bool found;
-    int i = 0;
-    for ( i ; i < getSensorsCount(); i++)
+    if (cb_onIntervalElapsed)
     {
-        found=true;
-        for (auto t = 0; t < 8; t++)
-        {
-            if (_sdv.at(i).sensorAddress[t] != addr[t])
-            {
-                found = false;
-                break;
-            }
-        }
-        if (found)
-        {
-            _sdv.at(i).sensorName=name;
-            err=NBD_NO_ERROR;
-            return true;
-        }
+        NBD_TraceScope cbScope(_trace, NBD_TRACE_CALLBACK_START, _wireSlot, NBD_TRACE_CB_INTERVAL_ELAPSED);
+        (*cb_onIntervalElapsed)(temp, validReadout, getWireName(), getGPIO(), deviceIndex);
     }
-    err = NBD_ADDRESS_IS_NOT_FOUND;
-    return false;
 }
 
+//==============================================================================================
+//                                  PUBLIC
+//==============================================================================================
 
-void NonBlockingDallas::setPathOfSensorNames(String path)
+void NonBlockingDallas::update()
 {
-    _pathofsensornames = path;
-}
+    NBD_LockGuard guard(_lock);
+    switch (_currentState)
+    {
+    case notFound:
+
+        break;
+    case waitingNextReading:
+        waitNextReading();
+        break;
+    case waitingConversionAndRead:
+        waitConversionAndRead();
+        break;
+    case waitingPriorityConversion:
+        waitPriorityConversion();
+        break;
+    case waitingSerialConversion:
+        waitSerialConversion();
+        break;
+    }
+}
+
+void NonBlockingDallas::requestTemperature()
+{
+    NBD_LockGuard guard(_lock);
+    _startConversionMillis = millis();
+    if (serializeConversions())
+    {
+        _currentState = waitingSerialConversion;
+        _serialIndex = 0;
+        trace(NBD_TRACE_CONVERSION_START, 0);
+        _bus->requestTemperatureByAddress(_sdv[0].sensorAddress); // The others follow one by one
+        _DS18B20_PL(F("DS18B20: requested new serialized reading."));
+        return;
+    }
+    _currentState = waitingConversionAndRead;
+    trace(NBD_TRACE_CONVERSION_START, NBD_TRACE_ALL);
+    _bus->requestTemperatures(); // Requests a temperature conversion for all the sensors on the bus
+
+    _DS18B20_PL(F("DS18B20: requested new reading."));
+}
+
+/**
+ * Tells how long update() has nothing to do, so an event loop can sleep until then.
+ *
+ * @return milliseconds until update() should be called, 0 if it should be called now,
+ *         NBD_NO_DEADLINE if there are no sensors on the wire
+ */
+unsigned long NonBlockingDallas::getMillisToNextUpdate()
+{
+    NBD_LockGuard guard(_lock);
+    unsigned long elapsed;
+    switch (_currentState)
+    {
+    case waitingNextReading:
+        elapsed = millis() - _lastReadingMillis;
+        if (_lastReadingMillis == 0 || elapsed >= _tempInterval)
+            return 0;
+        return _tempInterval - elapsed;
+    case waitingConversionAndRead:
+    case waitingPriorityConversion:
+    case waitingSerialConversion:
+        elapsed = millis() - _startConversionMillis;
+        if (elapsed < _bus->millisToWaitForConversion(_res))
+            return _bus->millisToWaitForConversion(_res) - elapsed;
+        return timedConversion() ? 0 : NBD_CONVERSION_POLL_MILLIS;
+    default:
+        return NBD_NO_DEADLINE;
+    }
+}
+
+/**
+ * Returns the number of completed read cycles, a cycle ends when the readings of every sensor
+ * are published.
+ *
+ * @return the count, it wraps around
+ */
+uint32_t NonBlockingDallas::getCycleCount()
+{
+    NBD_LockGuard guard(_lock);
+    return _cycles;
+}
+
+#if defined(NBD_HAS_COROUTINES)
+/**
+ * Awaitable completing after the next read cycle of the wire, starting it if the wire is idle.
+ * The coroutine must run on an NBD_Executor.
+ *
+ * @return the awaiter
+ */
+NBD_ReadAllAwaiter NonBlockingDallas::readAll()
+{
+    return NBD_ReadAllAwaiter(this);
+}
+
+/**
+ * Awaitable priority read of a sensor, see requestPriorityReadByIndex(). The coroutine must run
+ * on an NBD_Executor.
+ *
+ * @param handle the sensor
+ *
+ * @return the awaiter, co_await gives an NBD_ReadResult
+ */
+NBD_SensorReadAwaiter NonBlockingDallas::readSensor(NBD_handle_t handle)
+{
+    return NBD_SensorReadAwaiter(this, handle);
+}
+#endif
+
+/**
+ * Sets the object receiving every stored reading of the wire. NonBlockingDallasArray registers
+ * itself here.
+ *
+ * @param observer the observer or nullptr
+ */
+void NonBlockingDallas::setReadingObserver(NBD_ReadingObserver *observer)
+{
+    NBD_LockGuard guard(_lock);
+    _observer = observer;
+}
+
+/**
+ * Sets the buffer recording the timing of the bus activity and of the callbacks.
+ * Several wires can share one buffer.
+ *
+ * @param trace the buffer or nullptr
+ */
+void NonBlockingDallas::setTrace(NBD_TraceBuffer *trace)
+{
+    NBD_LockGuard guard(_lock);
+    _trace = trace;
+}
+
+void NonBlockingDallas::trace(uint8_t event, uint16_t arg)
+{
+    if (_trace)
+        _trace->record(event, _wireSlot, arg);
+}
+
+/**
+ * Reserves the sensor storage for a known number of sensors, so rescans don't grow the storage
+ * sensor by sensor and don't give it back.
+ *
+ * @param sensors expected number of sensors, 0 = fit the storage to the sensors found
+ */
+void NonBlockingDallas::reserveSensors(unsigned char sensors)
+{
+    NBD_LockGuard guard(_lock);
+    _reservedSensors = sensors;
+    _slots.reserve(sensors);
+}
+
+/**
+ * Sets a function called when the sensors of the wire (rescanWire()) or their names change,
+ * so an owner can refresh its lookup tables. It must not block.
+ *
+ * @param notify the function or nullptr
+ * @param ctx passed to the function
+ */
+void NonBlockingDallas::setIndexNotifier(void (*notify)(void *ctx), void *ctx)
+{
+    NBD_LockGuard guard(_lock);
+    _indexNotify = notify;
+    _indexNotifyCtx = ctx;
+}
+
+/**
+ * Tells if parasite powered sensors were found on the wire. In parasite mode conversions are
+ * timed instead of polled, see setParasiteMaxParallel() too.
+ *
+ * @return true in parasite mode
+ */
+bool NonBlockingDallas::isParasitePowerMode()
+{
+    NBD_LockGuard guard(_lock);
+    return _parasite;
+}
+
+/**
+ * Tells if a conversion is in progress on the wire.
+ *
+ * @return true while the sensors convert
+ */
+bool NonBlockingDallas::isConverting()
+{
+    NBD_LockGuard guard(_lock);
+    return _currentState == waitingConversionAndRead || _currentState == waitingPriorityConversion ||
+           _currentState == waitingSerialConversion;
+}
+
+/**
+ * Sets how many parasite powered sensors may convert at once. With more sensors on the wire each
+ * one gets its own addressed conversion in turn, so a cycle lasts sensors * conversion time.
+ *
+ * @param sensors the limit, 0 = never serialize
+ */
+void NonBlockingDallas::setParasiteMaxParallel(uint8_t sensors)
+{
+    NBD_LockGuard guard(_lock);
+    _parasiteMaxParallel = sensors;
+}
+
+/**
+ * Sets a function called every time new readings are published (see getSnapshot()).
+ * It is called from the task driving the wire and must not block.
+ *
+ * @param notify the function or nullptr
+ * @param ctx passed to the function
+ */
+void NonBlockingDallas::setPublishNotifier(void (*notify)(void *ctx), void *ctx)
+{
+    NBD_LockGuard guard(_lock);
+    _publishNotify = notify;
+    _publishNotifyCtx = ctx;
+}
+
+/**
+ * Requests a fresh reading of a single sensor ahead of the periodic schedule. If the bus is idle an
+ * addressed conversion of that sensor starts right away; if a conversion of the whole wire is in
+ * progress, the sensor is read first when it completes. The result is stored as usual, then
+ * onPriorityReadComplete is called and isPriorityReadComplete() turns true for the ticket.
+ *
+ * @param index the index of the sensor
+ * @param ticket receives the ticket of the request
+ *
+ * @return NBD_INDEX_IS_OUT_OF_RANGE, NBD_REQUEST_PENDING if another priority read is pending, or NBD_NO_ERROR
+ */
+ENUM_NBD_ERROR NonBlockingDallas::requestPriorityReadByIndex(unsigned char index, NBD_PriorityTicket &ticket)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+        return NBD_INDEX_IS_OUT_OF_RANGE;
+    if (_priorityPending)
+        return NBD_REQUEST_PENDING;
+
+    memcpy(_priorityAddress, _sdv.at(index).sensorAddress, sizeof(DeviceAddress));
+    _priorityPending = true;
+    _priorityRequested++;
+    ticket.wireSlot = _wireSlot;
+    ticket.id = _priorityRequested;
+
+    if (_currentState == waitingNextReading)
+    {
+        _currentState = waitingPriorityConversion;
+        _startConversionMillis = millis();
+        trace(NBD_TRACE_CONVERSION_START, index);
+        _bus->requestTemperatureByAddress(_priorityAddress);
+        _DS18B20_PL(F("DS18B20: requested priority reading."));
+    }
+    return NBD_NO_ERROR;
+}
+
+/**
+ * Requests a fresh reading of the named sensor, see requestPriorityReadByIndex().
+ *
+ * @param name the name of the sensor
+ * @param ticket receives the ticket of the request
+ *
+ * @return NBD_NAME_NOT_FOUND, NBD_REQUEST_PENDING or NBD_NO_ERROR
+ */
+ENUM_NBD_ERROR NonBlockingDallas::requestPriorityReadByName(String name, NBD_PriorityTicket &ticket)
+{
+    NBD_LockGuard guard(_lock);
+    unsigned char index;
+    ENUM_NBD_ERROR err = getIndexBySensorName(name, index);
+    if (err != NBD_NO_ERROR)
+        return err;
+    return requestPriorityReadByIndex(index, ticket);
+}
+
+/**
+ * Requests a fresh reading of the addressed sensor, see requestPriorityReadByIndex().
+ *
+ * @param addr the address of the sensor
+ * @param ticket receives the ticket of the request
+ *
+ * @return NBD_ADDRESS_IS_NOT_FOUND, NBD_REQUEST_PENDING or NBD_NO_ERROR
+ */
+ENUM_NBD_ERROR NonBlockingDallas::requestPriorityReadByAddress(const DeviceAddress addr, NBD_PriorityTicket &ticket)
+{
+    NBD_LockGuard guard(_lock);
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        if (sameAddress(_sdv[i].sensorAddress, addr))
+            return requestPriorityReadByIndex(i, ticket);
+    }
+    return NBD_ADDRESS_IS_NOT_FOUND;
+}
+
+/**
+ * Polls a priority read.
+ *
+ * @param ticket the ticket returned by the request
+ *
+ * @return true once the reading is stored (or the request failed because of a rescan)
+ */
+bool NonBlockingDallas::isPriorityReadComplete(const NBD_PriorityTicket &ticket)
+{
+    NBD_LockGuard guard(_lock);
+    return (int16_t)(_priorityCompleted - ticket.id) >= 0;
+}
+
+void NonBlockingDallas::rescanWire()
+{
+    NBD_LockGuard guard(_lock);
+    if (_priorityPending)
+        completePriorityRead(-1); // the sensor may be gone, report the request as failed
+    trace(NBD_TRACE_RESCAN_START, 0);
+    _bus->begin(); // The transport never blocks waiting for the sensors conversion
+    _currentState = notFound;
+    
+    DeviceAddress newaddress;
+    std::vector<SensorData> previous; //keeps the history of sensors still on the wire
+    previous.swap(_sdv);
+    std::vector<unsigned char> fresh; //sensors new on the wire, they get a handle slot at the end
+    _sdv.reserve(_reservedSensors);
+
+    _currentState = waitingNextReading;
+    _bus->setResolution((uint8_t)_res);
+    _parasite = getSensorsCount() > 0 && _bus->isParasitePowerMode();
+
+    _DS18B20_PL(String(__FUNCTION__)+" sensors count:"+String(getSensorsCount()));
+    
+    for (int i = 0; i < getSensorsCount(); i++)
+    {  
+        _sdv.emplace_back();
+        _sdv.at(i).filterConfig = _filterConfig;
+        if (_bus->getAddress(&newaddress[0], i))
+        {
+            for (size_t a = 0; a < 8; a++)
+            {
+                _sdv.at(i).sensorAddress[a] = newaddress[a];
+            }
+            auto sameSensor = [&](const SensorData &sd)
+            { return sameAddress(sd.sensorAddress, newaddress); };
+            auto old = std::find_if(previous.begin(), previous.end(), sameSensor);
+            if (old != previous.end())
+            {
+                _sdv.at(i).slot = old->slot;
+                _sdv.at(i).history = std::move(old->history);
+                _sdv.at(i).compressed = std::move(old->compressed);
+                _sdv.at(i).health = old->health;
+                _sdv.at(i).calibration = old->calibration;
+            }
+            else
+            {
+                fresh.push_back(i);
+                if (_historySamples > 0 || _historyTierCount > 0)
+                    _sdv.at(i).history.begin(_historySamples, _historyTiers, _historyTierCount);
+                if (_compressedBlocks > 0)
+                    _sdv.at(i).compressed.begin(_compressedBlocks, _compressedResolution);
+            }
+            if(_pathofsensornames!= "")
+            {
+            ENUM_NBD_ERROR err = NBD_NO_ERROR;
+            setSensorNameByAddress(_sdv.at(i).sensorAddress,
+                                   _sjsonp.getValueByKeyFromFile(_pathofsensornames,
+                                                                 addressToString(_sdv.at(i).sensorAddress)),
+                                   err);
+            if(err!=NBD_NO_ERROR)
+            {
+             _nameErrors++;
+             _lastNameError = err;
+             _DS18B20_PL(String(__FUNCTION__)+F(" Error setting sensor name by address. NBD error code:")+String(err));
+            }
+            loadCalibration(_sdv.at(i));
+            }
+        }
+        else
+        {
+            fresh.push_back(i);
+        }
+    }
+    if (_reservedSensors == 0)
+        _sdv.shrink_to_fit();
+    assignSlots(previous, fresh);
+    _calibrationChanged = true;
+    trace(NBD_TRACE_RESCAN_END, getSensorsCount());
+    publishSnapshot();
+    notifyIndexChanged();
+}
+
+ENUM_NBD_ERROR NonBlockingDallas::getAddressByIndex(unsigned char index, DeviceAddress &address)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        return NBD_INDEX_IS_OUT_OF_RANGE;
+    }
+    for (size_t i = 0; i < 8; i++)
+    {
+        address[i] = _sdv.at(index).sensorAddress[i];
+    }
+    return NBD_NO_ERROR;
+}
+
+const unsigned char NonBlockingDallas::getSensorsCount()
+{
+    NBD_LockGuard guard(_lock);
+    return _bus->getDeviceCount();
+}
+
+float NonBlockingDallas::getTempByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return (_unitsOM==unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+    }
+    err = _sdv.at(index).health.quarantined ? NBD_SENSOR_QUARANTINED : NBD_NO_ERROR;
+    return _sdv.at(index).temperature;
+}
+
+unsigned char NonBlockingDallas::getGPIO()
+{
+    return _gpiopin;
+}
+
+/**
+ * Returns the transport of the wire.
+ *
+ * @return the transport, NBD_DallasTransport if constructed with a DallasTemperature
+ */
+NBD_Transport *NonBlockingDallas::getTransport()
+{
+    return _bus;
+}
+
+
+float NonBlockingDallas::getTempByName(String name, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    int index = findName(name);
+    if (index < 0)
+    {
+        err = NBD_NAME_NOT_FOUND;
+        return (_unitsOM==unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+    }
+    err=NBD_NO_ERROR;
+    return _sdv[index].temperature;
+}
+
+unsigned long NonBlockingDallas::getLastTimeOfValidTempByName(const String name, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    int index = findName(name);
+    if (index < 0)
+    {
+        err = NBD_NAME_NOT_FOUND;
+        return (_unitsOM==unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+    }
+    err=NBD_NO_ERROR;
+    return _sdv[index].lastTimeOfValidTemp;
+}
+
+unsigned long NonBlockingDallas::getLastTimeOfValidTempByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return 0UL;
+    }
+    err=NBD_NO_ERROR;
+    return _sdv.at(index).lastTimeOfValidTemp;
+}
+
+bool NonBlockingDallas::setSensorNameByIndex(unsigned char index, String name, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    if (!_sdv.at(index).sensorName.set(name.c_str(), name.length(), err))
+        return false;
+    notifyIndexChanged();
+    return true;
+}
+
+unsigned char NonBlockingDallas::getIndexBySensorName(String name, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    int index = findName(name);
+    if (index < 0)
+    {
+        err = NBD_NAME_NOT_FOUND;
+        return 0;
+    }
+    err=NBD_NO_ERROR;
+    return (unsigned char)index;
+}
+
+ENUM_NBD_ERROR NonBlockingDallas::getIndexBySensorName(String name, unsigned char &index)
+{
+    NBD_LockGuard guard(_lock);
+    int found = findName(name);
+    if (found < 0)
+    {
+        return NBD_NAME_NOT_FOUND;
+    }
+    index = (unsigned char)found;
+    return NBD_NO_ERROR;
+}
+
+String NonBlockingDallas::getSensorNameByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return String("");
+    }
+    err=NBD_NO_ERROR;
+    return String(_sdv.at(index).sensorName.c_str());
+}
+
+/**
+ * Returns the name of a sensor without copying it. The text stays valid until the sensor is
+ * renamed or leaves the wire.
+ *
+ * @param index the index of the sensor
+ * @param length receives the length of the name
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return the terminated name, "" if the sensor has no name or on error
+ */
+const char *NonBlockingDallas::getSensorNameByIndex(unsigned char index, uint8_t &length, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    length = 0;
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return "";
+    }
+    err=NBD_NO_ERROR;
+    length = _sdv.at(index).sensorName.length();
+    return _sdv.at(index).sensorName.c_str();
+}
+
+/**
+ * Returns the interned id of the name of a sensor: two sensors have the same name if they
+ * have the same id.
+ *
+ * @param index the index of the sensor
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return the id, NBD_NO_NAME if the sensor has no name or on error
+ */
+NBD_name_t NonBlockingDallas::getSensorNameIdByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return NBD_NO_NAME;
+    }
+    err=NBD_NO_ERROR;
+    return _sdv.at(index).sensorName.id();
+}
+
+int NonBlockingDallas::findName(const String &name)
+{
+    NBD_name_t id = NBD_NameTable::instance().find(name.c_str(), name.length());
+    if (id == NBD_NAME_UNKNOWN)
+        return -1;
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        if (_sdv[i].sensorName.id() == id)
+            return i;
+    }
+    return -1;
+}
+
+bool NonBlockingDallas::sameAddress(const uint8_t *a, const uint8_t *b)
+{
+    return memcmp(a, b, sizeof(DeviceAddress)) == 0;
+}
+
+bool NonBlockingDallas::setSensorNameByAddress(const DeviceAddress addr, String name, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    bool found;
+    int i = 0;
+    for ( i ; i < getSensorsCount(); i++)
+    {
+        found=true;
+        for (auto t = 0; t < 8; t++)
+        {
+            if (_sdv.at(i).sensorAddress[t] != addr[t])
+            {
+                found = false;
+                break;
+            }
+        }
+        if (found)
+        {
+            if (!_sdv.at(i).sensorName.set(name.c_str(), name.length(), err))
+                return false;
+            notifyIndexChanged();
+            return true;
+        }
+    }
+    err = NBD_ADDRESS_IS_NOT_FOUND;
+    return false;
+}
+
+
+void NonBlockingDallas::setPathOfSensorNames(String path)
+{
+    NBD_LockGuard guard(_lock);
+    _pathofsensornames = path;
+}
+
+/**
+ * Selects how the scratchpad is read. With the CRC check the whole 9 byte scratchpad is read and
+ * verified; without it only the 2 temperature bytes are read, about 4 times less bus time.
+ * Wires with a single sensor always use Skip ROM instead of sending the 64 bit address.
+ * The fast paths need the 1-Wire primitives of the transport (NBD_DallasTransport with a OneWire).
+ *
+ * @param verifyCrc read the whole scratchpad and check its CRC
+ * @param retries extra attempts after a failed read, only spent on failures
+ */
+void NonBlockingDallas::setReadOptions(bool verifyCrc, uint8_t retries)
+{
+    NBD_LockGuard guard(_lock);
+    _readOptions.verifyCrc = verifyCrc;
+    _readOptions.retries = retries;
+}
+
+/**
+ * Sets the quarantine policy. A sensor failing failuresToQuarantine reads in a row (disconnected,
+ * CRC error or a rejected power-on reset value, not the spike filter rejects) is quarantined: it is skipped for 1, 2, 4 ... up to maxBackoffCycles
+ * cycles between read attempts, until a read succeeds. Skipped sensors don't call the callbacks.
+ *
+ * @param failuresToQuarantine consecutive failures before the quarantine, 0 disables it
+ * @param maxBackoffCycles longest pause between two attempts [cycles]
+ */
+void NonBlockingDallas::setQuarantinePolicy(uint8_t failuresToQuarantine, uint8_t maxBackoffCycles)
+{
+    NBD_LockGuard guard(_lock);
+    _quarantineAfter = failuresToQuarantine;
+    _maxBackoffCycles = (maxBackoffCycles == 0) ? 1 : maxBackoffCycles;
+    if (_quarantineAfter == 0)
+    {
+        for (size_t i = 0; i < _sdv.size(); i++)
+        {
+            _sdv[i].health.quarantined = false;
+            _sdv[i].health.cyclesToSkip = 0;
+        }
+    }
+}
+
+/**
+ * Returns the error statistics and the quarantine state of a sensor.
+ *
+ * @param index the index of the sensor
+ * @param health receives the statistics
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::getHealthByIndex(unsigned char index, NBD_SensorHealth &health, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    err = NBD_NO_ERROR;
+    health = _sdv.at(index).health;
+    return true;
+}
+
+/**
+ * Sets the filter settings of every sensor on the wire. Sensors found by a later
+ * rescanWire() get the same settings. The filter state of the sensors is restarted.
+ *
+ * @param config the filter settings
+ */
+void NonBlockingDallas::setFilterConfig(const NBD_FilterConfig &config)
+{
+    NBD_LockGuard guard(_lock);
+    _filterConfig = config;
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        _sdv[i].filterConfig = config;
+        _sdv[i].filter.reset();
+    }
+}
+
+/**
+ * Returns the filter settings of the wire.
+ *
+ * @return the filter settings applied to the sensors found by rescanWire()
+ */
+NBD_FilterConfig NonBlockingDallas::getFilterConfig()
+{
+    NBD_LockGuard guard(_lock);
+    return _filterConfig;
+}
+
+/**
+ * Overrides the filter settings of a single sensor until the next rescanWire().
+ *
+ * @param index the index of the sensor
+ * @param config the filter settings
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::setFilterConfigByIndex(unsigned char index, const NBD_FilterConfig &config, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    err = NBD_NO_ERROR;
+    _sdv.at(index).filterConfig = config;
+    _sdv.at(index).filter.reset();
+    return true;
+}
+
+/**
+ * Sets the calibration of a sensor: the stored readings become slope * measured + offset.
+ * It follows the sensor (by ROM) across rescans and is saved by saveSensorNames().
+ *
+ * @param index the index of the sensor
+ * @param calibration offset [°C] and slope
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::setCalibrationByIndex(unsigned char index, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    err = NBD_NO_ERROR;
+    _sdv.at(index).calibration = calibration;
+    _calibrationChanged = true;
+    return true;
+}
+
+/**
+ * Sets the calibration of the addressed sensor, see setCalibrationByIndex().
+ *
+ * @param addr the address of the sensor
+ * @param calibration offset [°C] and slope
+ * @param err NBD_ADDRESS_IS_NOT_FOUND if the sensor is not on the wire
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::setCalibrationByAddress(const DeviceAddress addr, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        if (sameAddress(_sdv[i].sensorAddress, addr))
+            return setCalibrationByIndex(i, calibration, err);
+    }
+    err = NBD_ADDRESS_IS_NOT_FOUND;
+    return false;
+}
+
+/**
+ * Returns the calibration of a sensor.
+ *
+ * @param index the index of the sensor
+ * @param calibration receives the calibration
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::getCalibrationByIndex(unsigned char index, NBD_Calibration &calibration, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    err = NBD_NO_ERROR;
+    calibration = _sdv.at(index).calibration;
+    return true;
+}
+
+/**
+ * Formats the calibration entries of a sensor for the names file: "<address>_offset" and
+ * "<address>_slope" next to the name, nothing for an identity calibration.
+ *
+ * @param address the address as returned by addressToString()
+ * @param calibration the calibration
+ *
+ * @return the entries with a leading comma, or an empty string
+ */
+String NonBlockingDallas::calibrationToJson(const String &address, const NBD_Calibration &calibration)
+{
+    if (calibration.isIdentity())
+        return String();
+    String json = ",\"";
+    json += address;
+    json += "_offset\":\"";
+    json += String(calibration.offset, 4);
+    json += "\",\"";
+    json += address;
+    json += "_slope\":\"";
+    json += String(calibration.slope, 6);
+    json += "\"";
+    return json;
+}
+
+void NonBlockingDallas::loadCalibration(SensorData &sd)
+{
+    String address = addressToString(sd.sensorAddress);
+    String offset = _sjsonp.getValueByKeyFromFile(_pathofsensornames, address + "_offset");
+    String slope = _sjsonp.getValueByKeyFromFile(_pathofsensornames, address + "_slope");
+    if (offset.length() > 0)
+        sd.calibration.offset = offset.toFloat();
+    if (slope.length() > 0)
+        sd.calibration.slope = slope.toFloat();
+}
+
+/**
+ * Enables the per-sensor history. Memory for every sensor is allocated here and when
+ * rescanWire() finds a new sensor, never while reading. Calling it again drops the recorded history.
+ *
+ * @param samples number of raw samples kept per sensor (0 = only rollups)
+ * @param tiers rollup tiers, e.g. {{60000UL, 60}, {900000UL, 96}, {3600000UL, 48}}
+ * @param tierCount number of tiers, at most NBD_HISTORY_MAX_TIERS
+ */
+void NonBlockingDallas::enableHistory(uint16_t samples, const NBD_HistoryTier *tiers, uint8_t tierCount)
+{
+    NBD_LockGuard guard(_lock);
+    _historySamples = samples;
+    _historyTierCount = (tiers == nullptr) ? 0 : std::min<uint8_t>(tierCount, NBD_HISTORY_MAX_TIERS);
+    for (uint8_t i = 0; i < _historyTierCount; i++)
+    {
+        _historyTiers[i] = tiers[i];
+    }
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        _sdv[i].history.begin(_historySamples, _historyTiers, _historyTierCount);
+    }
+}
+
+/**
+ * Copies the raw samples of a sensor recorded between from and to into a caller provided buffer.
+ *
+ * @param index the index of the sensor
+ * @param from millis() of the first sample of interest
+ * @param to millis() of the last sample of interest
+ * @param out the buffer
+ * @param max capacity of the buffer
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return the number of samples copied, oldest first
+ */
+uint16_t NonBlockingDallas::getHistoryByIndex(unsigned char index, unsigned long from, unsigned long to,
+                                              NBD_HistorySample *out, uint16_t max, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return 0;
+    }
+    err = NBD_NO_ERROR;
+    return _sdv.at(index).history.getSamples(from, to, out, max);
+}
+
+/**
+ * Copies the min/max/mean rollups of a sensor for one tier into a caller provided buffer.
+ *
+ * @param index the index of the sensor
+ * @param tier the index of the tier as passed to enableHistory()
+ * @param from millis() of interest
+ * @param to millis() of interest
+ * @param out the buffer
+ * @param max capacity of the buffer
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return the number of rollups copied, oldest first
+ */
+uint16_t NonBlockingDallas::getHistoryRollupsByIndex(unsigned char index, uint8_t tier, unsigned long from, unsigned long to,
+                                                     NBD_HistoryRollup *out, uint16_t max, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return 0;
+    }
+    err = NBD_NO_ERROR;
+    return _sdv.at(index).history.getRollups(tier, from, to, out, max);
+}
+
+/**
+ * Sets the queue every reading is pushed into, after filtering, from inside update().
+ * update() is the only producer of the queue, the consumer may run on another task or core.
+ *
+ * @param queue the queue or nullptr to stop pushing
+ */
+void NonBlockingDallas::setReadingQueue(NBD_ReadingQueue *queue)
+{
+    NBD_LockGuard guard(_lock);
+    _readingQueue = queue;
+}
+
+/**
+ * Sets the wire slot encoded in the handles of the sensors. Called by NonBlockingDallasArray.
+ *
+ * @param slot position of the wire in the array
+ */
+void NonBlockingDallas::setWireSlot(uint8_t slot)
+{
+    _wireSlot = slot;
+}
+
+uint8_t NonBlockingDallas::getWireSlot()
+{
+    return _wireSlot;
+}
+
+/**
+ * Returns the handle of a sensor, as found in the readings of the queue.
+ *
+ * @param index the index of the sensor
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return the handle or NBD_INVALID_HANDLE
+ */
+NBD_handle_t NonBlockingDallas::getHandleByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= _sdv.size())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return NBD_INVALID_HANDLE;
+    }
+    err = NBD_NO_ERROR;
+    return handleOf(index);
+}
+
+/**
+ * Returns the handle of the named sensor. Resolve it once, the handle stays valid across
+ * rescanWire() as long as the sensor is on the wire.
+ *
+ * @param name the name of the sensor
+ * @param err NBD_NAME_NOT_FOUND if there is no sensor with the name
+ *
+ * @return the handle or NBD_INVALID_HANDLE
+ */
+NBD_handle_t NonBlockingDallas::getHandleByName(String name, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    unsigned char index = getIndexBySensorName(name, err);
+    if (err != NBD_NO_ERROR)
+        return NBD_INVALID_HANDLE;
+    return handleOf(index);
+}
+
+/**
+ * Returns the handle of the addressed sensor.
+ *
+ * @param addr the address of the sensor
+ * @param err NBD_ADDRESS_IS_NOT_FOUND if the sensor is not on the wire
+ *
+ * @return the handle or NBD_INVALID_HANDLE
+ */
+NBD_handle_t NonBlockingDallas::getHandleByAddress(const DeviceAddress addr, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        if (sameAddress(_sdv[i].sensorAddress, addr))
+        {
+            err = NBD_NO_ERROR;
+            return handleOf(i);
+        }
+    }
+    err = NBD_ADDRESS_IS_NOT_FOUND;
+    return NBD_INVALID_HANDLE;
+}
+
+/**
+ * Tells if the sensor of a handle is still on the wire.
+ *
+ * @param handle the handle
+ *
+ * @return false if the sensor left the wire at a rescan or the handle belongs to another wire
+ */
+bool NonBlockingDallas::isHandleValid(NBD_handle_t handle)
+{
+    NBD_LockGuard guard(_lock);
+    return resolveHandle(handle) >= 0;
+}
+
+/**
+ * Returns the current index of the sensor of a handle.
+ *
+ * @param handle the handle
+ * @param index receives the index
+ *
+ * @return NBD_HANDLE_IS_NOT_VALID or NBD_NO_ERROR
+ */
+ENUM_NBD_ERROR NonBlockingDallas::getIndexByHandle(NBD_handle_t handle, unsigned char &index)
+{
+    NBD_LockGuard guard(_lock);
+    int i = resolveHandle(handle);
+    if (i < 0)
+        return NBD_HANDLE_IS_NOT_VALID;
+    index = (unsigned char)i;
+    return NBD_NO_ERROR;
+}
+
+/**
+ * Returns the temperature of the sensor of a handle, see getTempByIndex().
+ *
+ * @param handle the handle
+ * @param err NBD_HANDLE_IS_NOT_VALID, NBD_SENSOR_QUARANTINED or NBD_NO_ERROR
+ *
+ * @return the temperature or DEVICE_DISCONNECTED_C / DEVICE_DISCONNECTED_F
+ */
+float NonBlockingDallas::getTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    int i = resolveHandle(handle);
+    if (i < 0)
+    {
+        err = NBD_HANDLE_IS_NOT_VALID;
+        return (_unitsOM == unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+    }
+    return getTempByIndex(i, err);
+}
+
+/**
+ * Returns the time of the last valid reading of the sensor of a handle.
+ *
+ * @param handle the handle
+ * @param err NBD_HANDLE_IS_NOT_VALID or NBD_NO_ERROR
+ *
+ * @return millis() of the last valid reading
+ */
+unsigned long NonBlockingDallas::getLastTimeOfValidTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    int i = resolveHandle(handle);
+    if (i < 0)
+    {
+        err = NBD_HANDLE_IS_NOT_VALID;
+        return 0UL;
+    }
+    return getLastTimeOfValidTempByIndex(i, err);
+}
+
+NBD_handle_t NonBlockingDallas::handleOf(unsigned char index)
+{
+    uint8_t slot = _sdv[index].slot;
+    return NBD_makeHandle(_wireSlot, slot, _slots[slot].generation);
+}
+
+int NonBlockingDallas::resolveHandle(NBD_handle_t handle)
+{
+    uint8_t slot = NBD_handleSensor(handle);
+    if (handle == NBD_INVALID_HANDLE || NBD_handleWire(handle) != _wireSlot || slot >= _slots.size())
+        return -1;
+    if (_slots[slot].generation != NBD_handleGeneration(handle))
+        return -1;
+    return _slots[slot].index;
+}
+
+/**
+ * Gives every sensor found by rescanWire() a handle slot. Sensors still on the wire keep their
+ * slot, the slots of the sensors gone get a new generation so their handles turn invalid.
+ *
+ * @param previous the sensors before the rescan, with the slots they held
+ * @param fresh the indices of the sensors new on the wire
+ */
+void NonBlockingDallas::assignSlots(std::vector<SensorData> &previous, const std::vector<unsigned char> &fresh)
+{
+    for (size_t i = 0; i < _slots.size(); i++)
+    {
+        _slots[i].index = -1;
+    }
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        bool isFresh = std::find(fresh.begin(), fresh.end(), i) != fresh.end();
+        if (!isFresh)
+            _slots[_sdv[i].slot].index = i;
+    }
+    for (size_t i = 0; i < previous.size(); i++)
+    {
+        if (_slots[previous[i].slot].index < 0)
+        {
+            uint8_t slot = previous[i].slot;
+            if (_observer)
+                _observer->onSensorLeft(NBD_makeHandle(_wireSlot, slot, _slots[slot].generation));
+            _slots[slot].generation++; // the sensor left the wire
+        }
+    }
+    size_t free = 0;
+    for (size_t i = 0; i < fresh.size(); i++)
+    {
+        while (free < _slots.size() && _slots[free].index >= 0)
+            free++;
+        if (free == _slots.size())
+            _slots.push_back({0, -1});
+        _slots[free].index = fresh[i];
+        _sdv[fresh[i]].slot = (uint8_t)free;
+    }
+}
+
+/**
+ * Copies the current readings of every sensor on the wire into a caller provided buffer
+ * in a single pass, in index order. No String is created.
+ *
+ * @param out the buffer
+ * @param max capacity of the buffer
+ *
+ * @return the number of sensors copied
+ */
+uint8_t NonBlockingDallas::copyReadings(NBD_SensorSnapshot *out, uint8_t max)
+{
+    NBD_LockGuard guard(_lock);
+    return fillReadings(out, max);
+}
+
+/**
+ * Copies the readings published at the end of the last cycle. Does not wait for the bus
+ * driver, so it can be called from any task or core, also while update() or rescanWire() runs.
+ * The table holds every sensor of the wire.
+ *
+ * @param out caller provided buffer
+ * @param max capacity of the buffer
+ * @param sequence receives the sequence of the copy if not nullptr, see getSnapshotSequence()
+ *
+ * @return the number of sensors copied
+ */
+uint8_t NonBlockingDallas::getSnapshot(NBD_SensorSnapshot *out, uint8_t max, uint32_t *sequence)
+{
+    return _snapshot.read(out, max, sequence);
+}
+
+/**
+ * Copies the published reading of one sensor, see getSnapshot().
+ *
+ * @param index the index of the sensor
+ * @param out receives the reading
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::getSnapshotByIndex(unsigned char index, NBD_SensorSnapshot &out, ENUM_NBD_ERROR &err)
+{
+    if (!_snapshot.readOne(index, out))
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    err = NBD_NO_ERROR;
+    return true;
+}
+
+/**
+ * Returns a number that changes every time new readings are published.
+ *
+ * @return the sequence of the published table
+ */
+uint32_t NonBlockingDallas::getSnapshotSequence()
+{
+    return _snapshot.getSequence();
+}
+
+/**
+ * Enables the compressed long term history of every sensor. Each sensor gets a fixed ring of
+ * blocks of NBD_COMPRESSED_BLOCK_BYTES, when it is full the oldest block is reused.
+ * Calling it again drops the recorded history.
+ *
+ * @param blocks number of blocks per sensor
+ * @param resolutionMillis time resolution of the stored samples [milliseconds]
+ */
+void NonBlockingDallas::enableCompressedHistory(uint16_t blocks, unsigned long resolutionMillis)
+{
+    NBD_LockGuard guard(_lock);
+    _compressedBlocks = blocks;
+    _compressedResolution = resolutionMillis;
+    for (size_t i = 0; i < _sdv.size(); i++)
+    {
+        _sdv[i].compressed.begin(_compressedBlocks, _compressedResolution);
+    }
+}
+
+/**
+ * Returns the compressed history of a sensor without copying it. The pointer is only valid until
+ * the next update() or rescanWire() call: read it with NBD_CompressedReader or export its blocks
+ * before that, and not while the wire runs in its own task. The copying overload has no such limit.
+ *
+ * @param index the index of the sensor
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return the series or nullptr
+ */
+const NBD_CompressedSeries *NonBlockingDallas::getCompressedHistoryByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return nullptr;
+    }
+    err = NBD_NO_ERROR;
+    return &_sdv.at(index).compressed;
+}
+
+/**
+ * Copies the compressed history of a sensor, safe while the wire runs in its own task.
+ *
+ * @param index the index of the sensor
+ * @param out receives the series, read it with NBD_CompressedReader
+ * @param err NBD_INDEX_IS_OUT_OF_RANGE if there is no sensor at the index
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::getCompressedHistoryByIndex(unsigned char index, NBD_CompressedSeries &out, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    if (index >= getSensorsCount())
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    err = NBD_NO_ERROR;
+    out = _sdv.at(index).compressed;
+    return true;
+}
 
 void NonBlockingDallas::setUnitsOfMeasure(NBD_unitsOfMeasure unit)
 {
@@ -454,17 +1830,77 @@ String NonBlockingDallas::addressToString(DeviceAddress sensorAddress)
  */
 String NonBlockingDallas::getWireName()
 {
-    return _wireName;
+    NBD_LockGuard guard(_lock);
+    return String(_wireName.c_str());
+}
+
+/**
+ * Returns the wire name without copying it. The text stays valid until the wire is renamed.
+ *
+ * @param length receives the length of the name
+ *
+ * @return the terminated name
+ */
+const char *NonBlockingDallas::getWireName(uint8_t &length)
+{
+    NBD_LockGuard guard(_lock);
+    length = _wireName.length();
+    return _wireName.c_str();
 }
 
 /**
- * Sets the wire name for the NonBlockingDallas object.
+ * Sets the wire name for the NonBlockingDallas object. A failure is counted, see getNameErrorCount().
  *
- * @param wirename the new wire name to set
+ * @param wirename the new wire name to set, cut to NBD_NAME_LIMIT characters
  */
 void NonBlockingDallas::setWireName(String wirename)
 {
-    _wireName = wirename;
+    ENUM_NBD_ERROR err;
+    setWireName(wirename, err);
+}
+
+/**
+ * Sets the wire name for the NonBlockingDallas object. On error the previous name is kept.
+ *
+ * @param wirename the new wire name to set, cut to NBD_NAME_LIMIT characters
+ * @param err NBD_NAME_TABLE_FULL if the name could not be stored
+ *
+ * @return true on success
+ */
+bool NonBlockingDallas::setWireName(String wirename, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_lock);
+    size_t length = wirename.length() > NBD_NAME_LIMIT ? NBD_NAME_LIMIT : wirename.length();
+    if (!_wireName.set(wirename.c_str(), length, err))
+    {
+        _nameErrors++;
+        _lastNameError = err;
+        _DS18B20_PL(String(__FUNCTION__) + F(" Error setting wire name. NBD error code:") + String(err));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Counts the names that could not be stored where no caller gets the error: the sensor names
+ * loaded from the file at a rescan and the wire names. Names fail only past NBD_NAME_LIMIT
+ * characters or when the memory runs out.
+ *
+ * @return the failures since the wire was created
+ */
+uint16_t NonBlockingDallas::getNameErrorCount()
+{
+    NBD_LockGuard guard(_lock);
+    return _nameErrors;
+}
+
+/**
+ * @return the error of the last failure counted by getNameErrorCount(), NBD_NO_ERROR if none
+ */
+ENUM_NBD_ERROR NonBlockingDallas::getLastNameError()
+{
+    NBD_LockGuard guard(_lock);
+    return _lastNameError;
 }
 
  
@@ -478,6 +1914,7 @@ void NonBlockingDallas::setWireName(String wirename)
  */
 void NonBlockingDallas::saveSensorNames()
 {
+    NBD_LockGuard guard(_lock);
     if (_pathofsensornames != "")
     {
         String json = "{";
@@ -488,8 +1925,9 @@ void NonBlockingDallas::saveSensorNames()
             json += "\"";
             json += addressToString(_sdv[i].sensorAddress);
             json += "\":\"";
-            json += _sdv[i].sensorName;
+            json += _sdv[i].sensorName.c_str();
             json += "\"";
+            json += calibrationToJson(addressToString(_sdv[i].sensorAddress), _sdv[i].calibration);
         }
         json += "}";
 
@@ -28,6 +28,16 @@
 #include <DallasTemperature.h>
 #include <SimpleJsonParser.h> //https://github.com/dzsoni/SimpleJsonParser
 #include "NBD_errorcodes.h"
+#include "NBD_transport.h"
+#include "NBD_filter.h"
+#include "NBD_history.h"
+#include "NBD_compressed.h"
+#include "NBD_queue.h"
+#include "NBD_platform.h"
+#include "NBD_snapshot.h"
+#include "NBD_trace.h"
+#include "NBD_calibration.h"
+#include "NBD_names.h"
 #include <vector>
 
 //#define DEBUG_DS18B20
@@ -42,14 +52,77 @@
 
 #define DEFAULT_INTERVAL 31000
 #define ONE_WIRE_MAX_DEV 15 //Maximum number of devices on the One wire bus
+#define NBD_CONVERSION_POLL_MILLIS 10 //Polling period of the conversion status once the conversion time elapsed
+#ifndef NBD_PARASITE_MAX_PARALLEL
+#define NBD_PARASITE_MAX_PARALLEL 0   //Parasite sensors converting at once before conversions are serialized, 0 = never
+#endif
+#define NBD_NO_DEADLINE 0xFFFFFFFFUL
+
+#if defined(NBD_HAS_COROUTINES)
+class NBD_ReadAllAwaiter;    //See NBD_coro.h
+class NBD_SensorReadAwaiter;
+#endif
+
+/*
+Receives every stored reading of a wire, e.g. NonBlockingDallasArray for its groups.
+Called from the task driving the wire with the wire locked, must not block.
+*/
+class NBD_ReadingObserver
+{
+public:
+    virtual ~NBD_ReadingObserver() {}
+    virtual void onReading(NBD_handle_t handle, int32_t raw, bool valid) = 0; //raw in 1/128 °C
+    virtual void onSensorLeft(NBD_handle_t handle) = 0;                      //The handle turned invalid at a rescan
+    virtual void onPublished(uint8_t wireSlot) = 0;                          //End of a cycle, see getSnapshot()
+};
+
+struct NBD_PriorityTicket
+{
+    uint8_t wireSlot = 0;   //Wire of the request, see NonBlockingDallas::getWireSlot()
+    uint16_t id = 0;        //Request number on the wire
+};
+
+struct NBD_SensorHealth
+{
+    unsigned long reads = 0;                //Read attempts
+    unsigned long failures = 0;             //Failed reads, see updateHealth()
+    unsigned long rejects = 0;              //Readings rejected by the spike filter, not failures
+    unsigned long crcErrors = 0;
+    unsigned long powerOnResets = 0;        //Readings of the 85 °C power-on value
+    uint16_t consecutiveFailures = 0;
+    ENUM_NBD_ERROR lastError = NBD_NO_ERROR;
+    bool quarantined = false;
+    uint8_t backoffCycles = 0;              //Cycles skipped after the next failure while quarantined
+    uint8_t cyclesToSkip = 0;               //Cycles left until the next read attempt
+
+    float errorRate() const { return reads ? (float)failures / reads : 0.0f; }
+};
+
+//Outcome of a scratchpad read waiting for the calibration pass
+enum NBD_PendingRead : uint8_t
+{
+    NBD_PENDING_NONE = 0,   //Not read in this cycle
+    NBD_PENDING_VALID,
+    NBD_PENDING_INVALID,    //Failed read, stored as disconnected
+    NBD_PENDING_REJECTED,   //Dropped by the filter, the last value is kept
+};
 
 struct SensorData
 {
     float temperature = DEVICE_DISCONNECTED_C;              //Last temperature value
+    int32_t rawTemperature = DEVICE_DISCONNECTED_RAW;       //Last temperature value in raw units (1/128 °C)
     DeviceAddress sensorAddress = {0, 0, 0, 0, 0, 0, 0, 0}; //Array of sensors' address
     unsigned long lastTimeOfValidTemp = 0;                 //Last valid reading time of a temp
     bool valid = false;
-    String sensorName = "";                                 //Name of the sensor
+    NBD_Name sensorName;                                    //Name of the sensor, interned
+    NBD_FilterConfig filterConfig;                          //Filter settings of the sensor
+    NBD_SignalFilter filter;                                //Filter state of the sensor
+    NBD_SensorHealth health;                                //Error statistics and quarantine state
+    NBD_SensorHistory history;                              //Recorded readings, empty unless enableHistory() was called
+    NBD_CompressedSeries compressed;                        //Long term history, empty unless enableCompressedHistory() was called
+    uint8_t slot = 0;                                       //Sensor slot of its handle, kept across rescans
+    NBD_Calibration calibration;                            //Applied to the stored readings, kept across rescans
+    uint8_t pending = 0;                                    //NBD_PendingRead of the current cycle
 };
 
 
@@ -70,20 +143,46 @@ public:
     };
     NonBlockingDallas(DallasTemperature *dallasTemp, unsigned char pin);
     NonBlockingDallas(DallasTemperature *dallasTemp, unsigned char pin, String pathofsensornames);
+    NonBlockingDallas(NBD_Transport *transport, unsigned char pin);
+    NonBlockingDallas(NBD_Transport *transport, unsigned char pin, String pathofsensornames);
 
     void                begin(NBD_resolution res, NBD_unitsOfMeasure uom, unsigned long tempInterval);
     void                update();
     void                rescanWire();
     void                requestTemperature();
+    unsigned long       getMillisToNextUpdate();
+    uint32_t            getCycleCount();
+#if defined(NBD_HAS_COROUTINES)
+    NBD_ReadAllAwaiter  readAll();
+    NBD_SensorReadAwaiter readSensor(NBD_handle_t handle);
+#endif
+
+    ENUM_NBD_ERROR      requestPriorityReadByIndex(unsigned char index, NBD_PriorityTicket &ticket);
+    ENUM_NBD_ERROR      requestPriorityReadByName(String name, NBD_PriorityTicket &ticket);
+    ENUM_NBD_ERROR      requestPriorityReadByAddress(const DeviceAddress addr, NBD_PriorityTicket &ticket);
+    bool                isPriorityReadComplete(const NBD_PriorityTicket &ticket);
+
+    bool                isParasitePowerMode();
+    bool                isConverting();
+    void                setParasiteMaxParallel(uint8_t sensors);
+    void                reserveSensors(unsigned char sensors);
+    void                setPublishNotifier(void (*notify)(void *ctx), void *ctx);
+    void                setIndexNotifier(void (*notify)(void *ctx), void *ctx);
+    void                setReadingObserver(NBD_ReadingObserver *observer);
     const unsigned char getSensorsCount();
     unsigned char       getGPIO();
+    NBD_Transport      *getTransport();
     void                setUnitsOfMeasure(NBD_unitsOfMeasure unit);
     NBD_unitsOfMeasure  getUnitsOfMeasure();
     String              getUnitsOfMeasureAsString();//'C' or 'F'
     String              addressToString(DeviceAddress sensorAddress);
 
     String              getWireName();
+    const char          *getWireName(uint8_t &length);
     void                setWireName(String wirename);
+    bool                setWireName(String wirename, ENUM_NBD_ERROR &err);
+    uint16_t            getNameErrorCount();
+    ENUM_NBD_ERROR      getLastNameError();
 
     void                saveSensorNames();
 
@@ -91,11 +190,52 @@ public:
     NBD_resolution      getResolution();
 
     void                setPathOfSensorNames(String path);
+
+    void                setReadOptions(bool verifyCrc, uint8_t retries);
+    void                setQuarantinePolicy(uint8_t failuresToQuarantine, uint8_t maxBackoffCycles);
+    bool                getHealthByIndex(unsigned char index, NBD_SensorHealth &health, ENUM_NBD_ERROR &err);
+
+    bool                setCalibrationByIndex(unsigned char index, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err);
+    bool                setCalibrationByAddress(const DeviceAddress addr, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err);
+    bool                getCalibrationByIndex(unsigned char index, NBD_Calibration &calibration, ENUM_NBD_ERROR &err);
+    static String       calibrationToJson(const String &address, const NBD_Calibration &calibration);
+    void                setFilterConfig(const NBD_FilterConfig &config);
+    NBD_FilterConfig    getFilterConfig();
+    bool                setFilterConfigByIndex(unsigned char index, const NBD_FilterConfig &config, ENUM_NBD_ERROR &err);
+
+    void                enableHistory(uint16_t samples, const NBD_HistoryTier *tiers, uint8_t tierCount);
+    uint16_t            getHistoryByIndex(unsigned char index, unsigned long from, unsigned long to,
+                                          NBD_HistorySample *out, uint16_t max, ENUM_NBD_ERROR &err);
+    uint16_t            getHistoryRollupsByIndex(unsigned char index, uint8_t tier, unsigned long from, unsigned long to,
+                                                 NBD_HistoryRollup *out, uint16_t max, ENUM_NBD_ERROR &err);
+
+    void                setReadingQueue(NBD_ReadingQueue *queue);
+    void                setTrace(NBD_TraceBuffer *trace);
+    void                setWireSlot(uint8_t slot);
+    uint8_t             getWireSlot();
+    NBD_handle_t        getHandleByIndex(unsigned char index, ENUM_NBD_ERROR &err);
+    NBD_handle_t        getHandleByName(String name, ENUM_NBD_ERROR &err);
+    NBD_handle_t        getHandleByAddress(const DeviceAddress addr, ENUM_NBD_ERROR &err);
+    bool                isHandleValid(NBD_handle_t handle);
+    ENUM_NBD_ERROR      getIndexByHandle(NBD_handle_t handle, unsigned char &index);
+    float               getTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err);
+    unsigned long       getLastTimeOfValidTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err);
+
+    uint8_t             copyReadings(NBD_SensorSnapshot *out, uint8_t max);
+    uint8_t             getSnapshot(NBD_SensorSnapshot *out, uint8_t max, uint32_t *sequence = nullptr);
+    bool                getSnapshotByIndex(unsigned char index, NBD_SensorSnapshot &out, ENUM_NBD_ERROR &err);
+    uint32_t            getSnapshotSequence();
+
+    void                enableCompressedHistory(uint16_t blocks, unsigned long resolutionMillis);
+    const NBD_CompressedSeries *getCompressedHistoryByIndex(unsigned char index, ENUM_NBD_ERROR &err);
+    bool                getCompressedHistoryByIndex(unsigned char index, NBD_CompressedSeries &out, ENUM_NBD_ERROR &err);
     
     float               getTempByIndex(unsigned char index, ENUM_NBD_ERROR &err);
     float               getTempByName(String name, ENUM_NBD_ERROR &err);
 
     String              getSensorNameByIndex(unsigned char index, ENUM_NBD_ERROR &err);
+    const char          *getSensorNameByIndex(unsigned char index, uint8_t &length, ENUM_NBD_ERROR &err);
+    NBD_name_t          getSensorNameIdByIndex(unsigned char index, ENUM_NBD_ERROR &err);
 
     unsigned char       getIndexBySensorName(String name, ENUM_NBD_ERROR &err);
     ENUM_NBD_ERROR      getIndexBySensorName(String name, unsigned char &index);
@@ -116,6 +256,10 @@ public:
     {
         cb_onTemperatureChange = callback;
     }
+    void onPriorityReadComplete(void (*callback)(float temperature, bool valid, String wname, unsigned char gpiopin, int deviceIndex))
+    {
+        cb_onPriorityReadComplete = callback;
+    }
 
 private:
     enum sensorState
@@ -123,27 +267,92 @@ private:
         notFound = 0,
         waitingNextReading,
         waitingConversionAndRead,
+        waitingPriorityConversion,
+        waitingSerialConversion,
     };
-    String              _wireName; //Name of the wire
+    NBD_Name            _wireName; //Name of the wire, interned
+    uint16_t            _nameErrors;            //Names that could not be stored without a caller to tell, see getNameErrorCount()
+    ENUM_NBD_ERROR      _lastNameError;
     SimpleJsonParser    _sjsonp;
     unsigned char       _gpiopin;
     NBD_resolution      _res;
-    DallasTemperature   *_dallasTemp;
+    NBD_DallasTransport _dallasTransport;       //Used when constructed with a DallasTemperature
+    NBD_Transport       *_bus;                  //The transport every bus operation goes through
     sensorState         _currentState;
     unsigned long       _lastReadingMillis;     //Time at last temperature sensor readout
     unsigned long       _startConversionMillis; //Time at start conversion of the sensor
     unsigned long       _conversionMillis;      //Sensor conversion time based on the resolution [milliseconds]
     unsigned long       _tempInterval;          //Interval among each sensor reading [milliseconds]
+    uint32_t            _cycles;                //Completed read cycles, see getCycleCount()
     NBD_unitsOfMeasure  _unitsOM;               //Unit of measurement
     String _pathofsensornames;
+    NBD_ReadOptions     _readOptions;           //Scratchpad read fast paths, see setReadOptions()
+    bool                _parasite;              //Parasite powered sensors found by rescanWire(), conversions are timed
+    uint8_t             _parasiteMaxParallel;   //Parasite sensors converting at once, 0 = no limit
+    unsigned char       _serialIndex;           //Sensor converting while conversions are serialized
+    bool                _priorityPending;       //A priority read waits for its conversion
+    DeviceAddress       _priorityAddress;       //Sensor of the pending priority read
+    uint16_t            _priorityRequested;     //Id of the last priority request
+    uint16_t            _priorityCompleted;     //Id of the last completed priority request
+    uint8_t             _quarantineAfter;       //Consecutive failures before a sensor is quarantined, 0 = never
+    uint8_t             _maxBackoffCycles;      //Longest pause of a quarantined sensor [cycles]
+    NBD_FilterConfig    _filterConfig;          //Filter settings applied to the sensors found by rescanWire()
+    uint16_t            _historySamples;        //Raw samples kept per sensor
+    NBD_HistoryTier     _historyTiers[NBD_HISTORY_MAX_TIERS];
+    uint8_t             _historyTierCount;
+    uint16_t            _compressedBlocks;      //Compressed blocks per sensor
+    unsigned long       _compressedResolution;  //Time resolution of the compressed history [milliseconds]
+    NBD_ReadingQueue    *_readingQueue;         //Every reading is pushed here if set
+    uint8_t             _wireSlot;              //Position of the wire in NonBlockingDallasArray
+    NBD_Mutex           _lock;                  //Serializes update() and the accessors when the wire runs in its own task
+    NBD_SnapshotTable   _snapshot;              //Readings published at the end of every cycle, readable without _lock
+    void                (*_publishNotify)(void *ctx); //Called after every publication, from the task of the wire
+    void                *_publishNotifyCtx;
+    void                (*_indexNotify)(void *ctx); //Called when the sensors or their names change
+    void                *_indexNotifyCtx;
+    NBD_ReadingObserver *_observer;             //Gets every stored reading if set
+    NBD_TraceBuffer     *_trace;                //Records the bus activity if set
+    NBD_CalibrationPass _calibration;           //Calibration and unit conversion of the readings of a cycle
+    bool                _calibrationChanged;    //The coefficients of _calibration must be rebuilt
 
     std::vector<SensorData> _sdv = std::vector<SensorData>(); //every sensors' data on this wire
+    struct HandleSlot
+    {
+        uint16_t generation;                //Bumped when the sensor of the slot leaves the wire
+        int16_t index;                      //Position of the sensor in _sdv, -1 if the slot is free
+    };
+    std::vector<HandleSlot> _slots;         //Indexed by the sensor slot of the handles
+    unsigned char       _reservedSensors;       //Storage reserved for this many sensors at every rescan, 0 = exact fit
 
     void waitNextReading();
     void waitConversionAndRead();
+    void waitPriorityConversion();
+    void waitSerialConversion();
+    bool conversionDone();
+    bool timedConversion();
+    bool serializeConversions();
+    void finishCycle();
+    void notifyIndexChanged();
+    void trace(uint8_t event, uint16_t arg);
+    void completePriorityRead(int deviceIndex);
     void readSensors();
-    void readTemperatures(int deviceIndex);
+    void readTemperatures(int deviceIndex, bool force = false);
+    bool acquireReading(int deviceIndex, bool force = false);
+    void convertReadings(int first, int count);
+    void storeReading(int deviceIndex);
+    void loadCalibration(SensorData &sd);
+    int findName(const String &name);
+    bool skipQuarantined(SensorData &sd);
+    void updateHealth(SensorData &sd, ENUM_NBD_ERROR error);
+    void init(unsigned char pin, String pathofsensornames);
+    void publishSnapshot();
+    uint8_t fillReadings(NBD_SensorSnapshot *out, uint8_t max);
+    static bool sameAddress(const uint8_t *a, const uint8_t *b);
+    NBD_handle_t handleOf(unsigned char index);
+    int resolveHandle(NBD_handle_t handle);
+    void assignSlots(std::vector<SensorData> &previous, const std::vector<unsigned char> &fresh);
     void (*cb_onIntervalElapsed)(float temperature, bool valid, String wname, unsigned char gpiopin,  int deviceIndex);
     void (*cb_onTemperatureChange)(float temperature, bool valid, String wname, unsigned char gpiopin,  int deviceIndex);
+    void (*cb_onPriorityReadComplete)(float temperature, bool valid, String wname, unsigned char gpiopin,  int deviceIndex);
 };
 #endif /* NONBLOCKINGDALLAS_H */
@@ -1,187 +1,1626 @@
 #include "NonBlockingDallasArray.h"
+#include "NBD_coro.h"
+#include <algorithm>
+#if defined(NBD_HAS_EPOLL)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
 
 NonBlockingDallasArray::NonBlockingDallasArray()
 {
+    _parasiteWiresMax = NBD_PARASITE_WIRES_PARALLEL;
+    _offsets.push_back(0);
+    _indexChanged = false;
+    cb_onGroupChange = NULL;
+    _freeGroupLink = -1;
+    cb_onSensorStale = NULL;
+    cb_onSensorRecovered = NULL;
+    _defaultStaleAfter = 0;
+    _trace = nullptr;
+    _readingQueue = nullptr;
+#if defined(NBD_HAS_EPOLL)
+    _epollFd = -1;
+    _timerFd = -1;
+    _eventFd = -1;
+    _publishedSum = 0;
+#endif
 }
 
 NonBlockingDallasArray::~NonBlockingDallasArray()
 {
+#if defined(NBD_HAS_TASKS)
+    stopTasks();
+#endif
+    // The wires may outlive the array, they must not call back into it
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setReadingObserver(nullptr);
+        _wires[i]->setIndexNotifier(nullptr, nullptr);
+#if defined(NBD_HAS_EPOLL)
+        _wires[i]->setPublishNotifier(nullptr, nullptr);
+#endif
+    }
+#if defined(NBD_HAS_EPOLL)
+    if (_epollFd >= 0)
+    {
+        close(_epollFd);
+        close(_timerFd);
+        close(_eventFd);
+    }
+#endif
+}
+
+
+/**
+ * Adds a NonBlockingDallas object to the NonBlockingDallasArray if it is not already present.
+ *
+ * @param NBDpt Pointer to the NonBlockingDallas object to be added.
+ *
+ * @throws None
+ */
+void NonBlockingDallasArray::addNonBlockingDallas(NonBlockingDallas *NBDpt)
+{
+    if (NBDpt == nullptr || isRunningTasks() || _wires.size() > 255)
+        return; // the wire slot is 8 bits
+    // Don't add same pointer
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        if (_wires[i] == NBDpt) //same memory address?
+            return;
+        uint8_t length;
+        if (strcmp(_wires[i]->getWireName(length), NBDpt->getWireName(length)) == 0) //same wire name?
+            return;
+        if (_wires[i]->getGPIO() == NBDpt->getGPIO()) //same GPIO?
+            return;
+    }
+    NBDpt->setWireSlot((uint8_t)_wires.size());
+    NBDpt->setIndexNotifier(notifyIndexChanged, this);
+    NBDpt->setReadingObserver(this);
+#if defined(NBD_HAS_EPOLL)
+    if (_epollFd >= 0)
+        NBDpt->setPublishNotifier(notifyPublished, this);
+#endif
+    _wires.push_back(NBDpt);
+    _wires.shrink_to_fit();
+    _indexChanged = true;
+}
+
+/**
+ * Updates all wires in the NonBlockingDallasArray.
+ *
+ * @param None
+ *
+ * @return void
+ *
+ */
+void NonBlockingDallasArray::update()
+{
+   processStale();
+   if (isRunningTasks())
+       return; // every wire is driven by its own task
+   uint8_t converting = parasiteConverting();
+   for (size_t i = 0; i < _wires.size(); i++)
+    {
+        if (parasiteGated(i, converting))
+            continue; // waits until a parasite wire finishes its conversion
+        bool idle = !_wires[i]->isConverting();
+        _wires[i]->update();
+        if (idle && _wires[i]->isConverting() && _wires[i]->isParasitePowerMode())
+            converting++;
+    } 
+}
+
+/**
+ * Tells how long update() has nothing to do, so an event loop can sleep until then. The wires
+ * running in their own tasks are not counted.
+ *
+ * @return milliseconds until update() should be called, 0 if it should be called now,
+ *         NBD_NO_DEADLINE if there is nothing to wait for
+ */
+unsigned long NonBlockingDallasArray::getMillisToNextUpdate()
+{
+    unsigned long next = NBD_NO_DEADLINE;
+    if (!isRunningTasks())
+    {
+        uint8_t converting = parasiteConverting();
+        for (size_t i = 0; i < _wires.size(); i++)
+        {
+            if (parasiteGated(i, converting))
+                continue; // woken up by the end of the running conversion
+            unsigned long ms = _wires[i]->getMillisToNextUpdate();
+            if (ms < next)
+                next = ms;
+        }
+    }
+    NBD_LockGuard guard(_staleLock);
+    unsigned long ms = _staleWheel.getMillisToNextExpiry(millis());
+    return ms < next ? ms : next;
+}
+
+#if defined(NBD_HAS_COROUTINES)
+/**
+ * Awaitable completing after the next read cycle of every wire, idle wires start it right away
+ * like requestTemperature(). The coroutine must run on an NBD_Executor.
+ *
+ * @return the awaiter
+ */
+NBD_ReadAllAwaiter NonBlockingDallasArray::readAll()
+{
+    return NBD_ReadAllAwaiter(_wires);
+}
+
+/**
+ * Awaitable priority read of a sensor, see requestPriorityReadByIndex(). The coroutine must run
+ * on an NBD_Executor.
+ *
+ * @param handle the sensor
+ *
+ * @return the awaiter, co_await gives an NBD_ReadResult
+ */
+NBD_SensorReadAwaiter NonBlockingDallasArray::readSensor(NBD_handle_t handle)
+{
+    uint8_t wire = NBD_handleWire(handle);
+    return NBD_SensorReadAwaiter(wire < _wires.size() ? _wires[wire] : nullptr, handle);
+}
+#endif
+
+/**
+ * Sets how many parasite powered wires may convert at the same time when driven by update() or
+ * processEvents(). A parasite wire draws the conversion current through its pull-up for the whole
+ * conversion, staggering them keeps a shared supply in spec. Wire tasks are not staggered.
+ *
+ * @param wires the limit, 0 = no limit
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::setParasiteWiresParallel(uint8_t wires)
+{
+    _parasiteWiresMax = wires;
+}
+
+/**
+ * Sets on every wire how many parasite powered sensors may convert at once, see
+ * NonBlockingDallas::setParasiteMaxParallel().
+ *
+ * @param sensors the limit, 0 = never serialize
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::setParasiteMaxParallel(uint8_t sensors)
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setParasiteMaxParallel(sensors);
+    }
+}
+
+uint8_t NonBlockingDallasArray::parasiteConverting()
+{
+    uint8_t converting = 0;
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        if (_wires[i]->isParasitePowerMode() && _wires[i]->isConverting())
+            converting++;
+    }
+    return converting;
+}
+
+bool NonBlockingDallasArray::parasiteGated(size_t wire, uint8_t converting)
+{
+    return _parasiteWiresMax > 0 && converting >= _parasiteWiresMax &&
+           _wires[wire]->isParasitePowerMode() && !_wires[wire]->isConverting();
+}
+
+void NonBlockingDallasArray::notifyIndexChanged(void *ctx)
+{
+    ((NonBlockingDallasArray *)ctx)->_indexChanged = true;
+}
+
+/**
+ * Rebuilds the prefix offsets of the wires and the name table after a wire was added, rescanned
+ * or a sensor renamed, so the lookups cost O(log n) instead of walking every wire and sensor.
+ * Called with _indexLock held, the wire tasks only raise _indexChanged.
+ */
+void NonBlockingDallasArray::refreshIndex()
+{
+    if (!_indexChanged.exchange(false)) // a change during the rebuild marks it again
+        return;
+    _offsets.resize(_wires.size() + 1);
+    _names.clear();
+    uint32_t total = 0;
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _offsets[i] = (NBD_index_t)total;
+        unsigned char count = _wires[i]->getSensorsCount();
+        for (unsigned char e = 0; e < count && total + e < NBD_INDEX_MAX; e++)
+        {
+            ENUM_NBD_ERROR err;
+            NBD_name_t id = _wires[i]->getSensorNameIdByIndex(e, err);
+            if (err == NBD_NO_ERROR && id != NBD_NO_NAME)
+                _names.push_back({id, (NBD_index_t)(total + e)});
+        }
+        total += count;
+        if (total > NBD_INDEX_MAX)
+            total = NBD_INDEX_MAX; // the sensors past the limit are not addressable
+    }
+    _offsets[_wires.size()] = (NBD_index_t)total;
+    // Equal names keep the lowest index first, like the wire by wire search did
+    std::sort(_names.begin(), _names.end(), [](const NameEntry &a, const NameEntry &b)
+              { return a.id < b.id || (a.id == b.id && a.index < b.index); });
+}
+
+bool NonBlockingDallasArray::locate(NBD_index_t index, size_t &wire, unsigned char &local)
+{
+    NBD_LockGuard guard(_indexLock);
+    refreshIndex();
+    if (index >= _offsets.back())
+        return false;
+    // Last wire starting at or before the index, empty wires share the offset of the next one
+    wire = std::upper_bound(_offsets.begin(), _offsets.end(), index) - _offsets.begin() - 1;
+    local = (unsigned char)(index - _offsets[wire]);
+    return true;
+}
+
+bool NonBlockingDallasArray::locateName(const String &name, NBD_index_t &index)
+{
+    // Interned names are equal if their ids are, no text is compared
+    NBD_name_t id = NBD_NameTable::instance().find(name.c_str(), name.length());
+    if (id == NBD_NO_NAME || id == NBD_NAME_UNKNOWN)
+        return false;
+    NBD_LockGuard guard(_indexLock);
+    refreshIndex();
+    auto it = std::lower_bound(_names.begin(), _names.end(), id, [](const NameEntry &e, NBD_name_t i)
+                               { return e.id < i; });
+    if (it == _names.end() || it->id != id)
+        return false;
+    index = it->index;
+    return true;
+}
+
+#if defined(NBD_HAS_TASKS)
+/**
+ * Starts one task per wire (FreeRTOS task on ESP32, std::thread on host builds), each calling
+ * update() of its wire. While the tasks run update() of the array does nothing, the accessors
+ * stay usable from any task. Callbacks are called from the task of the wire, and each wire is a
+ * separate producer: give every wire its own NBD_ReadingQueue instead of sharing one.
+ *
+ * @param idleMillis sleep of a task between two update() calls [milliseconds]
+ *
+ * @return false if the tasks are already running, a task could not be created or the wires share
+ *         the queue of setReadingQueue()
+ */
+bool NonBlockingDallasArray::startTasks(unsigned long idleMillis)
+{
+    if (isRunningTasks())
+        return false;
+    if (_readingQueue && _wires.size() > 1)
+    {
+        _NBDARRAY_PL(String(__FUNCTION__) + ": the wires share a reading queue, it has a single producer");
+        return false;
+    }
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        WireTask *task = new WireTask();
+        task->wire = _wires[i];
+        task->idleMillis = idleMillis;
+        task->run = true;
+#if defined(NBD_FREERTOS)
+        task->done = xSemaphoreCreateBinary();
+        String name = "NBD_" + _wires[i]->getWireName();
+        if (xTaskCreatePinnedToCore(wireTaskLoop, name.c_str(), NBD_TASK_STACK_SIZE, task, NBD_TASK_PRIORITY,
+                                    &task->handle, tskNO_AFFINITY) != pdPASS)
+        {
+            _NBDARRAY_PL(String(__FUNCTION__) + ": cannot create task for wire " + _wires[i]->getWireName());
+            vSemaphoreDelete(task->done);
+            delete task;
+            stopTasks();
+            return false;
+        }
+#else
+        task->thread = std::thread([task]()
+        {
+            while (task->run.load())
+            {
+                task->wire->update();
+                std::this_thread::sleep_for(std::chrono::milliseconds(task->idleMillis));
+            }
+        });
+#endif
+        _tasks.push_back(task);
+    }
+    return true;
+}
+
+/**
+ * Stops the wire tasks and waits until each of them has left update().
+ * After this update() of the array drives the wires again.
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::stopTasks()
+{
+    for (size_t i = 0; i < _tasks.size(); i++)
+    {
+        _tasks[i]->run = false;
+    }
+    for (size_t i = 0; i < _tasks.size(); i++)
+    {
+#if defined(NBD_FREERTOS)
+        xSemaphoreTake(_tasks[i]->done, portMAX_DELAY);
+        vSemaphoreDelete(_tasks[i]->done);
+#else
+        _tasks[i]->thread.join();
+#endif
+        delete _tasks[i];
+    }
+    _tasks.clear();
+}
+
+#if defined(NBD_FREERTOS)
+void NonBlockingDallasArray::wireTaskLoop(void *arg)
+{
+    WireTask *task = (WireTask *)arg;
+    TickType_t idle = pdMS_TO_TICKS(task->idleMillis);
+    while (task->run)
+    {
+        task->wire->update();
+        vTaskDelay(idle > 0 ? idle : 1);
+    }
+    xSemaphoreGive(task->done);
+    vTaskDelete(NULL);
+}
+#endif
+#endif
+
+#if defined(NBD_HAS_EPOLL)
+/**
+ * Returns a file descriptor for an epoll/poll/libuv loop. It becomes readable when update() has
+ * work to do (next reading interval, conversion done) or when a wire task published new readings;
+ * then call processEvents(). In between nothing needs to run. Add the wires before the first call.
+ *
+ * @return the file descriptor (an epoll instance), -1 on error
+ */
+int NonBlockingDallasArray::getPollFd()
+{
+    if (_epollFd >= 0)
+        return _epollFd;
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    _timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_epollFd < 0 || _timerFd < 0 || _eventFd < 0)
+    {
+        _NBDARRAY_PL(String(__FUNCTION__) + ": cannot create the file descriptors");
+        if (_epollFd >= 0) close(_epollFd);
+        if (_timerFd >= 0) close(_timerFd);
+        if (_eventFd >= 0) close(_eventFd);
+        _epollFd = _timerFd = _eventFd = -1;
+        return -1;
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = _timerFd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _timerFd, &ev);
+    ev.data.fd = _eventFd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _eventFd, &ev);
+
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setPublishNotifier(notifyPublished, this);
+    }
+    armTimer();
+    return _epollFd;
+}
+
+/**
+ * Handles the events of the file descriptor returned by getPollFd(): runs update() (unless the
+ * wires have their own tasks) and re-arms the timer for the next deadline.
+ *
+ * @return true if new readings were published since the previous call
+ */
+bool NonBlockingDallasArray::processEvents()
+{
+    uint64_t value;
+    if (_epollFd < 0)
+        return false;
+    while (read(_timerFd, &value, sizeof(value)) == sizeof(value))
+    {
+    }
+    while (read(_eventFd, &value, sizeof(value)) == sizeof(value))
+    {
+    }
+
+    update();
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        sum += _wires[i]->getSnapshotSequence();
+    }
+    bool published = (sum != _publishedSum);
+    _publishedSum = sum;
+    armTimer();
+    return published;
+}
+
+void NonBlockingDallasArray::notifyPublished(void *ctx)
+{
+    NonBlockingDallasArray *array = (NonBlockingDallasArray *)ctx;
+    uint64_t one = 1;
+    if (write(array->_eventFd, &one, sizeof(one)) < 0)
+    {
+        // counter saturated, the descriptor is readable anyway
+    }
+}
+
+void NonBlockingDallasArray::armTimer()
+{
+    unsigned long next = getMillisToNextUpdate();
+    struct itimerspec spec = {};
+    if (next != NBD_NO_DEADLINE)
+    {
+        spec.it_value.tv_sec = next / 1000;
+        spec.it_value.tv_nsec = (next % 1000) * 1000000L;
+        if (next == 0)
+            spec.it_value.tv_nsec = 1; // a zero value would disarm the timer
+    }
+    timerfd_settime(_timerFd, 0, &spec, nullptr);
+}
+#endif
+
+/**
+ * Tells whether the wires are driven by their own tasks.
+ *
+ * @return true between startTasks() and stopTasks()
+ */
+bool NonBlockingDallasArray::isRunningTasks()
+{
+#if defined(NBD_HAS_TASKS)
+    return !_tasks.empty();
+#else
+    return false;
+#endif
+}
+
+/**
+ * Rescans all the wires in the NonBlockingDallasArray.
+ *
+ * @param None
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::rescanWire()
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _NBDARRAY_PL(String(__FUNCTION__) + ": Rescanning wire "+_wires[i]->getWireName());
+        _wires[i]->rescanWire();
+    }
+}
+
+/**
+ * Request temperature for all sensors on all wires.
+ *
+ * @param None
+ *
+ * @return void
+
+ */
+void NonBlockingDallasArray::requestTemperature()
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->requestTemperature();
+    }
+}
+
+
+/**
+ * Return the number of sensors on all wires.
+ *
+ * @return the total number of sensors, at most NBD_INDEX_MAX
+ */
+const NBD_index_t NonBlockingDallasArray::getSensorsCount()
+{
+    NBD_LockGuard guard(_indexLock);
+    refreshIndex();
+    return _offsets.back();
+}
+
+/**
+ * Save sensor names to a file in JSON format.
+ *
+ * @return void
+ *
+ */
+void NonBlockingDallasArray::saveSensorNames()
+{
+     if (_pathofsensornames != "")
+    {
+        String json = "{";
+        for (unsigned int i = 0; i < _wires.size(); i++)
+        {
+            for (unsigned int e = 0; e < _wires[i]->getSensorsCount(); e++)
+            {
+                DeviceAddress address;
+                ENUM_NBD_ERROR err;
+                if ((e && i==0) || i>0 )
+                    json += ",";
+                json += "\"";
+                _wires[i]->getAddressByIndex(e,address);
+                json += _wires[i]->addressToString(address);
+                json += "\":\"";
+                uint8_t length;
+                json += _wires[i]->getSensorNameByIndex(e,length,err);
+                json += "\"";
+                NBD_Calibration calibration;
+                if (_wires[i]->getCalibrationByIndex(e,calibration,err))
+                {
+                    json += NonBlockingDallas::calibrationToJson(_wires[i]->addressToString(address),calibration);
+                }
+            }
+        }
+        json += "}";
+
+        File file = SPIFFS.open(_pathofsensornames, "w");
+        if (!file)
+        {
+            _DS18B20_PL(F("Error opening file for writing"));
+            return;
+        }
+        _DS18B20_PL(json);
+        file.print(json);
+        file.flush();
+        file.close();
+    }
+}
+
+String NonBlockingDallasArray::addressToString(DeviceAddress sensorAddress)
+{
+    String str = "";
+    for (int i = 0; i < 8; i++)
+    {
+        str += sensorAddress[i];
+        if (i != 7)
+            str += ".";
+    }
+    return str;
+}
+
+
+
+/**
+ * Sets the resolution for the NonBlockingDallasArray object and propagates the resolution to all associated wires.
+ * ('Wire' means a pin wich is used by NonBlockingDallas object)
+ *
+ * @param res the resolution to be set
+ *
+ * @return void
+ *
+ * @throws None
+ */
+void NonBlockingDallasArray::setResolution(NonBlockingDallas::NBD_resolution res)
+{
+    _res=res;
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setResolution(res);
+    }
+}
+
+/**
+ * Retrieves the resolution from the NonBlockingDallasArray.
+ *
+ * @return NBD_resolution the resolution value
+ *
+ */ 
+NonBlockingDallas::NBD_resolution NonBlockingDallasArray::getResolution()
+{
+    return _res;
+}
+
+/**
+ * Selects how the scratchpad is read on every wire, see NonBlockingDallas::setReadOptions().
+ *
+ * @param verifyCrc read the whole scratchpad and check its CRC
+ * @param retries extra attempts after a failed read
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::setReadOptions(bool verifyCrc, uint8_t retries)
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setReadOptions(verifyCrc, retries);
+    }
+}
+
+/**
+ * Sets the quarantine policy of every wire, see NonBlockingDallas::setQuarantinePolicy().
+ *
+ * @param failuresToQuarantine consecutive failures before the quarantine, 0 disables it
+ * @param maxBackoffCycles longest pause between two attempts [cycles]
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::setQuarantinePolicy(uint8_t failuresToQuarantine, uint8_t maxBackoffCycles)
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setQuarantinePolicy(failuresToQuarantine, maxBackoffCycles);
+    }
+}
+
+/**
+ * Returns the error statistics of the sensor selected by its index.
+ *
+ * @param index the index of the sensor
+ * @param health receives the statistics
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return a boolean indicating if the operation was successful or not
+ */
+bool NonBlockingDallasArray::getHealthByIndex(NBD_index_t index, NBD_SensorHealth &health, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->getHealthByIndex(local,health,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return false;
+}
+
+/**
+ * Requests a fresh reading of a single sensor on its wire, see NonBlockingDallas::requestPriorityReadByIndex().
+ * The result arrives through the onPriorityReadComplete callback of that wire.
+ *
+ * @param index the global index of the sensor
+ * @param ticket receives the ticket of the request
+ *
+ * @return NBD_INDEX_IS_OUT_OF_RANGE, NBD_REQUEST_PENDING or NBD_NO_ERROR
+ */
+ENUM_NBD_ERROR NonBlockingDallasArray::requestPriorityReadByIndex(NBD_index_t index, NBD_PriorityTicket &ticket)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->requestPriorityReadByIndex(local,ticket);
+    }
+    return NBD_INDEX_IS_OUT_OF_RANGE;
+}
+
+/**
+ * Requests a fresh reading of the named sensor on its wire.
+ *
+ * @param name the name of the sensor
+ * @param ticket receives the ticket of the request
+ *
+ * @return NBD_NAME_NOT_FOUND, NBD_REQUEST_PENDING or NBD_NO_ERROR
+ */
+ENUM_NBD_ERROR NonBlockingDallasArray::requestPriorityReadByName(String name, NBD_PriorityTicket &ticket)
+{
+    NBD_index_t index;
+    if(locateName(name,index))
+    {
+        return requestPriorityReadByIndex(index,ticket);
+    }
+    return NBD_NAME_NOT_FOUND;
+}
+
+/**
+ * Polls a priority read on the wire that issued the ticket.
+ *
+ * @param ticket the ticket returned by the request
+ *
+ * @return true once the reading is stored, false while pending or for an unknown wire
+ */
+bool NonBlockingDallasArray::isPriorityReadComplete(const NBD_PriorityTicket &ticket)
+{
+    if(ticket.wireSlot>=_wires.size())
+    {
+        return false;
+    }
+    return _wires.at(ticket.wireSlot)->isPriorityReadComplete(ticket);
+}
+
+/**
+ * Sets the filter settings of every sensor on every wire.
+ *
+ * @param config the filter settings
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::setFilterConfig(const NBD_FilterConfig &config)
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setFilterConfig(config);
+    }
+}
+
+/**
+ * Overrides the filter settings of the sensor selected by its index.
+ *
+ * @param index the index of the sensor
+ * @param config the filter settings
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return a boolean indicating if the operation was successful or not
+ */
+bool NonBlockingDallasArray::setFilterConfigByIndex(NBD_index_t index, const NBD_FilterConfig &config, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->setFilterConfigByIndex(local,config,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return false;
+}
+
+/**
+ * Sets the calibration of a sensor, see NonBlockingDallas::setCalibrationByIndex().
+ *
+ * @param index the global index of the sensor
+ * @param calibration offset [°C] and slope
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return true on success
+ */
+bool NonBlockingDallasArray::setCalibrationByIndex(NBD_index_t index, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->setCalibrationByIndex(local,calibration,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return false;
+}
+
+/**
+ * Sets the calibration of the addressed sensor on whichever wire it is.
+ *
+ * @param addr the address of the sensor
+ * @param calibration offset [°C] and slope
+ * @param err NBD_ADDRESS_IS_NOT_FOUND if no wire has the sensor
+ *
+ * @return true on success
+ */
+bool NonBlockingDallasArray::setCalibrationByAddress(const DeviceAddress addr, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err)
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        if (_wires[i]->setCalibrationByAddress(addr,calibration,err))
+        {
+            return true;
+        }
+    }
+    err = NBD_ADDRESS_IS_NOT_FOUND;
+    return false;
+}
+
+/**
+ * Returns the calibration of a sensor.
+ *
+ * @param index the global index of the sensor
+ * @param calibration receives the calibration
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return true on success
+ */
+bool NonBlockingDallasArray::getCalibrationByIndex(NBD_index_t index, NBD_Calibration &calibration, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->getCalibrationByIndex(local,calibration,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return false;
+}
+
+/**
+ * Enables the history on every wire, see NonBlockingDallas::enableHistory().
+ *
+ * @param samples number of raw samples kept per sensor
+ * @param tiers rollup tiers
+ * @param tierCount number of tiers
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::enableHistory(uint16_t samples, const NBD_HistoryTier *tiers, uint8_t tierCount)
+{
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->enableHistory(samples, tiers, tierCount);
+    }
+}
+
+/**
+ * Copies the raw samples of the sensor selected by its index into a caller provided buffer.
+ *
+ * @param index the index of the sensor
+ * @param from millis() of the first sample of interest
+ * @param to millis() of the last sample of interest
+ * @param out the buffer
+ * @param max capacity of the buffer
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return the number of samples copied
+ */
+uint16_t NonBlockingDallasArray::getHistoryByIndex(NBD_index_t index, unsigned long from, unsigned long to,
+                                                   NBD_HistorySample *out, uint16_t max, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->getHistoryByIndex(local,from,to,out,max,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return 0;
+}
+
+/**
+ * Copies the rollups of one tier of the sensor selected by its index into a caller provided buffer.
+ *
+ * @param index the index of the sensor
+ * @param tier the index of the tier
+ * @param from millis() of interest
+ * @param to millis() of interest
+ * @param out the buffer
+ * @param max capacity of the buffer
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return the number of rollups copied
+ */
+uint16_t NonBlockingDallasArray::getHistoryRollupsByIndex(NBD_index_t index, uint8_t tier, unsigned long from, unsigned long to,
+                                                          NBD_HistoryRollup *out, uint16_t max, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->getHistoryRollupsByIndex(local,tier,from,to,out,max,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return 0;
+}
+
+/**
+ * Sets the queue the readings of every wire are pushed into. All wires are updated
+ * from update(), so the array is the single producer of the queue. Wire tasks would be one
+ * producer each: a shared queue is refused while they run, and startTasks() is refused while a
+ * shared queue is set. Set a queue per wire with NonBlockingDallas::setReadingQueue() instead.
+ *
+ * @param queue the queue or nullptr to stop pushing
+ *
+ * @return false if the queue is refused because the wire tasks are running
+ */
+bool NonBlockingDallasArray::setReadingQueue(NBD_ReadingQueue *queue)
+{
+    if (queue && isRunningTasks() && _wires.size() > 1)
+    {
+        _NBDARRAY_PL(String(__FUNCTION__) + ": wire tasks are running, the queue has a single producer");
+        return false;
+    }
+    _readingQueue = queue;
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setReadingQueue(queue);
+    }
+    return true;
+}
+
+/**
+ * Sets the buffer recording the bus activity of every wire and the timing of the callbacks,
+ * see NBD_TraceBuffer.
+ *
+ * @param trace the buffer or nullptr to stop tracing
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::setTrace(NBD_TraceBuffer *trace)
+{
+    _trace = trace;
+    for (size_t i = 0; i < _wires.size(); i++)
+    {
+        _wires[i]->setTrace(trace);
+    }
+}
+
+/**
+ * Returns the handle of the sensor selected by its index, as found in the readings of the queue.
+ *
+ * @param index the index of the sensor
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return the handle or NBD_INVALID_HANDLE
+ */
+NBD_handle_t NonBlockingDallasArray::getHandleByIndex(NBD_index_t index, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->getHandleByIndex(local,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return NBD_INVALID_HANDLE;
+}
+
+/**
+ * Returns the handle of the named sensor. The handle stays valid across rescans as long as the
+ * sensor is on its wire, so the name has to be resolved only once.
+ *
+ * @param name the name of the sensor
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return the handle or NBD_INVALID_HANDLE
+ */
+NBD_handle_t NonBlockingDallasArray::getHandleByName(String name, ENUM_NBD_ERROR &err)
+{
+    NBD_index_t index;
+    if(locateName(name,index))
+    {
+        return getHandleByIndex(index,err);
+    }
+    err = NBD_NAME_NOT_FOUND;
+    return NBD_INVALID_HANDLE;
+}
+
+/**
+ * Tells if the sensor of a handle is still on its wire.
+ *
+ * @param handle the handle
+ *
+ * @return a boolean indicating if the handle is valid
+ */
+bool NonBlockingDallasArray::isHandleValid(NBD_handle_t handle)
+{
+    if(NBD_handleWire(handle)>=_wires.size())
+    {
+        return false;
+    }
+    return _wires[NBD_handleWire(handle)]->isHandleValid(handle);
+}
+
+/**
+ * Returns the current global index of the sensor of a handle.
+ *
+ * @param handle the handle
+ * @param index receives the index
+ *
+ * @return NBD_HANDLE_IS_NOT_VALID or NBD_NO_ERROR
+ */
+ENUM_NBD_ERROR NonBlockingDallasArray::getIndexByHandle(NBD_handle_t handle, NBD_index_t &index)
+{
+    if(NBD_handleWire(handle)>=_wires.size())
+    {
+        return NBD_HANDLE_IS_NOT_VALID;
+    }
+    unsigned char local;
+    ENUM_NBD_ERROR err = _wires[NBD_handleWire(handle)]->getIndexByHandle(handle,local);
+    if(err==NBD_NO_ERROR)
+    {
+        NBD_LockGuard guard(_indexLock);
+        refreshIndex();
+        index = _offsets[NBD_handleWire(handle)]+local;
+    }
+    return err;
+}
+
+/**
+ * Returns the temperature of the sensor of a handle.
+ *
+ * @param handle the handle
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return the temperature or DEVICE_DISCONNECTED_C / DEVICE_DISCONNECTED_F
+ */
+float NonBlockingDallasArray::getTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err)
+{
+    if(NBD_handleWire(handle)>=_wires.size())
+    {
+        err = NBD_HANDLE_IS_NOT_VALID;
+        return (_unitsOM==NonBlockingDallas::NBD_unitsOfMeasure::unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
+    }
+    return _wires[NBD_handleWire(handle)]->getTempByHandle(handle,err);
+}
+
+/**
+ * Returns the time of the last valid reading of the sensor of a handle.
+ *
+ * @param handle the handle
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return millis() of the last valid reading
+ */
+unsigned long NonBlockingDallasArray::getLastTimeOfValidTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err)
+{
+    if(NBD_handleWire(handle)>=_wires.size())
+    {
+        err = NBD_HANDLE_IS_NOT_VALID;
+        return 0;
+    }
+    return _wires[NBD_handleWire(handle)]->getLastTimeOfValidTempByHandle(handle,err);
+}
+
+/**
+ * Adds a sensor to a group, the group is created on its first member. A sensor may belong to
+ * several groups, the aggregates follow every stored reading. Adding a sensor to a group it
+ * already belongs to does nothing and succeeds.
+ *
+ * @param group the name of the group
+ * @param handle the handle of the sensor
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return a boolean indicating if the operation was successful or not
+ */
+bool NonBlockingDallasArray::addToGroup(String group, NBD_handle_t handle, ENUM_NBD_ERROR &err)
+{
+    NBD_index_t index;
+    err = getIndexByHandle(handle,index);
+    if(err!=NBD_NO_ERROR)
+    {
+        return false;
+    }
+    size_t w;
+    unsigned char local;
+    NBD_SensorSnapshot current;
+    locate(index,w,local);
+    _wires[w]->getSnapshotByIndex(local,current,err); // the member starts with the published reading
+
+    NBD_LockGuard guard(_groupLock);
+    if(_freeGroupLink<0 && _groupLinks.size()>=32767)
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    int g = findGroup(group);
+    if(g<0)
+    {
+        if(_groups.size()>=255)
+        {
+            err = NBD_INDEX_IS_OUT_OF_RANGE;
+            return false;
+        }
+        _groups.push_back(Group());
+        _groups.back().name = group;
+        _groups.back().changed = false;
+        g = _groups.size()-1;
+    }
+    uint8_t wire = NBD_handleWire(handle);
+    uint8_t slot = NBD_handleSensor(handle);
+    if(_groupHeads.size()<=wire)
+    {
+        _groupHeads.resize(wire+1);
+    }
+    if(_groupHeads[wire].size()<=slot)
+    {
+        _groupHeads[wire].resize(slot+1,-1);
+    }
+    for(int16_t l = _groupHeads[wire][slot]; l>=0; l = _groupLinks[l].next)
+    {
+        if(_groupLinks[l].group==g && _groups[g].sensors.getMember(_groupLinks[l].member)==handle)
+        {
+            err = NBD_NO_ERROR; // already a member, counting it twice would skew the aggregates
+            return true;
+        }
+    }
+    GroupLink link;
+    link.group = g;
+    link.member = _groups[g].sensors.addMember(handle);
+    link.next = _groupHeads[wire][slot];
+    int16_t l = _freeGroupLink;
+    if(l>=0)
+    {
+        _freeGroupLink = _groupLinks[l].next;
+        _groupLinks[l] = link;
+    }
+    else
+    {
+        _groupLinks.push_back(link);
+        l = _groupLinks.size()-1;
+    }
+    _groupHeads[wire][slot] = l;
+    if(err==NBD_NO_ERROR)
+    {
+        _groups[g].sensors.update(link.member,current.raw,current.valid);
+    }
+    _groups[g].changed = true;
+    err = NBD_NO_ERROR;
+    return true;
+}
+
+/**
+ * Adds the named sensor to a group, see addToGroup().
+ *
+ * @param group the name of the group
+ * @param sensorName the name of the sensor
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return a boolean indicating if the operation was successful or not
+ */
+bool NonBlockingDallasArray::addToGroupByName(String group, String sensorName, ENUM_NBD_ERROR &err)
+{
+    NBD_handle_t handle = getHandleByName(sensorName,err);
+    if(err!=NBD_NO_ERROR)
+    {
+        return false;
+    }
+    return addToGroup(group,handle,err);
+}
+
+/**
+ * Returns the aggregates of a group. They are maintained as the readings are stored, so this
+ * does not depend on the size of the group.
+ *
+ * @param group the name of the group
+ * @param stats receives the aggregates in the unit of measure of the array
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return a boolean indicating if the operation was successful or not
+ */
+bool NonBlockingDallasArray::getGroupStats(String group, NBD_GroupStats &stats, ENUM_NBD_ERROR &err)
+{
+    NBD_LockGuard guard(_groupLock);
+    int g = findGroup(group);
+    if(g<0)
+    {
+        err = NBD_GROUP_NOT_FOUND;
+        return false;
+    }
+    fillGroupStats(_groups[g].sensors,stats);
+    err = NBD_NO_ERROR;
+    return true;
+}
+
+int NonBlockingDallasArray::findGroup(const String &name)
+{
+    for(size_t i=0; i<_groups.size(); i++)
+    {
+        if(_groups[i].name==name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void NonBlockingDallasArray::fillGroupStats(const NBD_SensorGroup &group, NBD_GroupStats &stats)
+{
+    bool celsius = (_unitsOM==NonBlockingDallas::NBD_unitsOfMeasure::unit_C);
+    stats.validCount = group.getValidCount();
+    stats.memberCount = group.getMemberCount();
+    stats.min = celsius ? DallasTemperature::rawToCelsius(group.getMinRaw()) : DallasTemperature::rawToFahrenheit(group.getMinRaw());
+    stats.max = celsius ? DallasTemperature::rawToCelsius(group.getMaxRaw()) : DallasTemperature::rawToFahrenheit(group.getMaxRaw());
+    stats.mean = celsius ? DallasTemperature::rawToCelsius(group.getMeanRaw()) : DallasTemperature::rawToFahrenheit(group.getMeanRaw());
+}
+
+void NonBlockingDallasArray::onReading(NBD_handle_t handle, int32_t raw, bool valid)
+{
+    groupReading(handle,raw,valid);
+    if(valid)
+    {
+        staleReading(handle);
+    }
+}
+
+void NonBlockingDallasArray::groupReading(NBD_handle_t handle, int32_t raw, bool valid)
+{
+    NBD_LockGuard guard(_groupLock);
+    uint8_t wire = NBD_handleWire(handle);
+    uint8_t slot = NBD_handleSensor(handle);
+    if(wire>=_groupHeads.size() || slot>=_groupHeads[wire].size())
+    {
+        return;
+    }
+    for(int16_t l=_groupHeads[wire][slot]; l>=0; l=_groupLinks[l].next)
+    {
+        Group &g = _groups[_groupLinks[l].group];
+        if(g.sensors.getMember(_groupLinks[l].member)!=handle)
+        {
+            continue; // another sensor got the slot of a member that left
+        }
+        if(g.sensors.update(_groupLinks[l].member,raw,valid))
+        {
+            g.changed = true;
+        }
+    }
+}
+
+/**
+ * Removes a sensor that left the wire from its groups and recycles its links.
+ *
+ * @param handle the handle of the sensor
+ */
+void NonBlockingDallasArray::groupLeft(NBD_handle_t handle)
+{
+    NBD_LockGuard guard(_groupLock);
+    uint8_t wire = NBD_handleWire(handle);
+    uint8_t slot = NBD_handleSensor(handle);
+    if(wire>=_groupHeads.size() || slot>=_groupHeads[wire].size())
+    {
+        return;
+    }
+    int16_t *prev = &_groupHeads[wire][slot];
+    while(*prev>=0)
+    {
+        int16_t l = *prev;
+        GroupLink &link = _groupLinks[l];
+        NBD_SensorGroup &sensors = _groups[link.group].sensors;
+        if(sensors.getMember(link.member)!=handle)
+        {
+            prev = &link.next; // another sensor got the slot
+            continue;
+        }
+        uint16_t last = sensors.getMemberCount()-1;
+        NBD_handle_t moved = sensors.getMember(last);
+        sensors.removeMember(link.member);
+        if(link.member!=last)
+        {
+            renumberMember(link.group,moved,last,link.member);
+        }
+        _groups[link.group].changed = true; // the member count changed
+        *prev = link.next;
+        link.next = _freeGroupLink;
+        _freeGroupLink = l;
+    }
+}
+
+/**
+ * Points the link of a group member to its new index after removeMember() moved it.
+ *
+ * @param group the group
+ * @param handle the handle of the moved member
+ * @param from its former index
+ * @param to its new index
+ */
+void NonBlockingDallasArray::renumberMember(uint8_t group, NBD_handle_t handle, uint16_t from, uint16_t to)
+{
+    uint8_t wire = NBD_handleWire(handle);
+    uint8_t slot = NBD_handleSensor(handle);
+    for(int16_t l=_groupHeads[wire][slot]; l>=0; l=_groupLinks[l].next)
+    {
+        if(_groupLinks[l].group==group && _groupLinks[l].member==from)
+        {
+            _groupLinks[l].member = to;
+            return;
+        }
+    }
+}
+
+void NonBlockingDallasArray::onSensorLeft(NBD_handle_t handle)
+{
+    groupLeft(handle);
+    NBD_LockGuard guard(_staleLock);
+    uint16_t id = staleTimer(handle,false);
+    if(id!=NBD_WHEEL_NONE && _staleEntries[id].handle==handle)
+    {
+        _staleWheel.disarm(id); // a sensor gone is not reported as stale
+        _staleEntries[id].stale = false;
+    }
+}
+
+void NonBlockingDallasArray::onPublished(uint8_t wireSlot)
+{
+    (void)wireSlot;
+    if(!cb_onGroupChange)
+    {
+        return;
+    }
+    // The callbacks run without _groupLock, they may call back into the array
+    std::vector<std::pair<String, NBD_GroupStats> > changed;
+    {
+        NBD_LockGuard guard(_groupLock);
+        for(size_t i=0; i<_groups.size(); i++)
+        {
+            if(_groups[i].changed)
+            {
+                NBD_GroupStats stats;
+                fillGroupStats(_groups[i].sensors,stats);
+                changed.push_back(std::make_pair(_groups[i].name,stats));
+                _groups[i].changed = false;
+            }
+        }
+    }
+    for(size_t i=0; i<changed.size(); i++)
+    {
+        NBD_TraceScope scope(_trace,NBD_TRACE_CALLBACK_START,NBD_TRACE_NO_WIRE,NBD_TRACE_CB_GROUP_CHANGE);
+        (*cb_onGroupChange)(changed[i].first,changed[i].second);
+    }
 }
 
-
 /**
- * Adds a NonBlockingDallas object to the NonBlockingDallasArray if it is not already present.
+ * Watches the freshness of a sensor: if it has no valid reading for maxAgeMillis, onSensorStale
+ * is called, and onSensorRecovered at its next valid reading. The deadlines are kept in a timer
+ * wheel checked by update(), so the cost depends on the expiring sensors only.
  *
- * @param NBDpt Pointer to the NonBlockingDallas object to be added.
+ * @param handle the handle of the sensor
+ * @param maxAgeMillis the longest accepted time without a valid reading, 0 stops watching
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
  *
- * @throws None
+ * @return a boolean indicating if the operation was successful or not
  */
-void NonBlockingDallasArray::addNonBlockingDallas(NonBlockingDallas *NBDpt)
+bool NonBlockingDallasArray::setStaleAfter(NBD_handle_t handle, unsigned long maxAgeMillis, ENUM_NBD_ERROR &err)
 {
-    if (NBDpt == nullptr)
-        return;
-    // Don't add same pointer
-    for (size_t i = 0; i < _wires.size(); i++)
+    unsigned long lastValid = getLastTimeOfValidTempByHandle(handle,err);
+    if(err!=NBD_NO_ERROR)
     {
-        if (_wires[i] == NBDpt) //same memory address?
-            return;
-        if (_wires[i]->getWireName() == NBDpt->getWireName()) //same wire name?
-            return;
-        if (_wires[i]->getGPIO() == NBDpt->getGPIO()) //same GPIO?
-            return;
+        return false;
     }
-    _wires.push_back(NBDpt);
-    _wires.shrink_to_fit();
+    NBD_LockGuard guard(_staleLock);
+    uint16_t id = staleTimer(handle,true);
+    if(id==NBD_WHEEL_NONE)
+    {
+        err = NBD_INDEX_IS_OUT_OF_RANGE;
+        return false;
+    }
+    StaleEntry &e = _staleEntries[id];
+    e.handle = handle;
+    e.maxAge = maxAgeMillis;
+    e.stale = false;
+    if(maxAgeMillis==0)
+    {
+        _staleWheel.disarm(id);
+        return true;
+    }
+    // The age counts from the last valid reading, or from now for a sensor never read
+    unsigned long now = millis();
+    unsigned long age = (lastValid==0) ? 0 : now-lastValid;
+    _staleWheel.arm(id,now,(age>=maxAgeMillis) ? 0 : maxAgeMillis-age);
+    return true;
 }
 
 /**
- * Updates all wires in the NonBlockingDallasArray.
+ * Watches the freshness of every sensor, including the sensors found by later rescans,
+ * see setStaleAfter().
  *
- * @param None
+ * @param maxAgeMillis the longest accepted time without a valid reading, 0 stops watching
  *
  * @return void
- *
  */
-void NonBlockingDallasArray::update()
+void NonBlockingDallasArray::setStaleAfterAll(unsigned long maxAgeMillis)
 {
-   for (size_t i = 0; i < _wires.size(); i++)
     {
-        _wires[i]->update();
-    } 
+        NBD_LockGuard guard(_staleLock);
+        _defaultStaleAfter = maxAgeMillis;
+    }
+    ENUM_NBD_ERROR err;
+    NBD_index_t count = getSensorsCount();
+    for(NBD_index_t i=0; i<count; i++)
+    {
+        setStaleAfter(getHandleByIndex(i,err),maxAgeMillis,err);
+    }
 }
 
 /**
- * Rescans all the wires in the NonBlockingDallasArray.
+ * Tells if a watched sensor is stale.
  *
- * @param None
+ * @param handle the handle of the sensor
  *
- * @return void
+ * @return true between onSensorStale and onSensorRecovered
  */
-void NonBlockingDallasArray::rescanWire()
+bool NonBlockingDallasArray::isStale(NBD_handle_t handle)
 {
-    for (size_t i = 0; i < _wires.size(); i++)
+    NBD_LockGuard guard(_staleLock);
+    uint16_t id = staleTimer(handle,false);
+    return id!=NBD_WHEEL_NONE && _staleEntries[id].handle==handle && _staleEntries[id].stale;
+}
+
+uint16_t NonBlockingDallasArray::staleTimer(NBD_handle_t handle, bool create)
+{
+    uint8_t wire = NBD_handleWire(handle);
+    uint8_t slot = NBD_handleSensor(handle);
+    if(wire>=_staleTimers.size() || slot>=_staleTimers[wire].size() || _staleTimers[wire][slot]==NBD_WHEEL_NONE)
     {
-        _NBDARRAY_PL(String(__FUNCTION__) + ": Rescanning wire "+_wires[i]->getWireName());
-        _wires[i]->rescanWire();
+        if(!create)
+        {
+            return NBD_WHEEL_NONE;
+        }
+        uint16_t id = _staleWheel.add();
+        if(id==NBD_WHEEL_NONE)
+        {
+            return id;
+        }
+        if(_staleTimers.size()<=wire)
+        {
+            _staleTimers.resize(wire+1);
+        }
+        if(_staleTimers[wire].size()<=slot)
+        {
+            _staleTimers[wire].resize(slot+1,NBD_WHEEL_NONE);
+        }
+        StaleEntry e = {NBD_INVALID_HANDLE, 0, false};
+        _staleEntries.push_back(e);
+        _staleTimers[wire][slot] = id;
     }
+    return _staleTimers[wire][slot];
 }
 
-/**
- * Request temperature for all sensors on all wires.
- *
- * @param None
- *
- * @return void
-
- */
-void NonBlockingDallasArray::requestTemperature()
+void NonBlockingDallasArray::staleReading(NBD_handle_t handle)
 {
-    for (size_t i = 0; i < _wires.size(); i++)
+    bool recovered;
     {
-        _wires[i]->requestTemperature();
+        NBD_LockGuard guard(_staleLock);
+        uint16_t id = staleTimer(handle,_defaultStaleAfter>0);
+        if(id==NBD_WHEEL_NONE)
+        {
+            return;
+        }
+        StaleEntry &e = _staleEntries[id];
+        if(e.handle!=handle)
+        {
+            if(_defaultStaleAfter==0)
+            {
+                return; // the slot belonged to a sensor that left
+            }
+            e.handle = handle;
+            e.maxAge = _defaultStaleAfter;
+            e.stale = false;
+        }
+        if(e.maxAge==0)
+        {
+            return;
+        }
+        _staleWheel.arm(id,millis(),e.maxAge);
+        recovered = e.stale;
+        e.stale = false;
+    }
+    if(recovered && cb_onSensorRecovered)
+    {
+        NBD_TraceScope scope(_trace,NBD_TRACE_CALLBACK_START,NBD_handleWire(handle),NBD_TRACE_CB_SENSOR_RECOVERED);
+        (*cb_onSensorRecovered)(handle);
     }
 }
 
+void NonBlockingDallasArray::processStale()
+{
+    uint16_t ids[16];
+    NBD_handle_t handles[16];
+    uint16_t n;
+    do
+    {
+        {
+            NBD_LockGuard guard(_staleLock);
+            n = _staleWheel.expire(millis(),ids,16);
+            for(uint16_t i=0; i<n; i++)
+            {
+                _staleEntries[ids[i]].stale = true;
+                handles[i] = _staleEntries[ids[i]].handle;
+            }
+        }
+        for(uint16_t i=0; i<n && cb_onSensorStale; i++)
+        {
+            NBD_TraceScope scope(_trace,NBD_TRACE_CALLBACK_START,NBD_handleWire(handles[i]),NBD_TRACE_CB_SENSOR_STALE);
+            (*cb_onSensorStale)(handles[i]);
+        }
+    } while(n==16);
+}
 
 /**
- * Return the number of sensors on all wires.
+ * Copies the current readings of every sensor on every wire into a caller provided buffer
+ * in a single pass, in index order (handle, raw and converted value, valid flag, time, address).
+ *
+ * @param out the buffer
+ * @param max capacity of the buffer
  *
- * @return the total number of sensors
+ * @return the number of sensors copied
  */
-const unsigned char NonBlockingDallasArray::getSensorsCount()
+unsigned int NonBlockingDallasArray::copyReadings(NBD_SensorSnapshot *out, unsigned int max)
 {
-    unsigned char result=0;
-    for (size_t i = 0; i < _wires.size(); i++)
+    unsigned int n = 0;
+    for (size_t i = 0; i < _wires.size() && n < max; i++)
     {
-        result+=_wires[i]->getSensorsCount();
+        unsigned int room = max - n;
+        n += _wires[i]->copyReadings(out + n, room > 255 ? 255 : (uint8_t)room);
     }
-    return result;
+    return n;
 }
 
 /**
- * Save sensor names to a file in JSON format.
+ * Copies the published readings of every wire into a caller provided buffer, in index order.
+ * Never waits for the bus drivers. The copy is retried until no wire published new readings
+ * while it was taken, so it is one consistent view of the whole array.
  *
- * @return void
+ * @param out the buffer
+ * @param max capacity of the buffer
  *
+ * @return the number of sensors copied
  */
-void NonBlockingDallasArray::saveSensorNames()
+unsigned int NonBlockingDallasArray::getSnapshot(NBD_SensorSnapshot *out, unsigned int max)
 {
-     if (_pathofsensornames != "")
+    // Sequences only grow, so equal sums mean no wire published during the copy
+    uint32_t copied;
+    uint32_t current;
+    unsigned int n;
+    do
     {
-        String json = "{";
-        for (unsigned int i = 0; i < _wires.size(); i++)
+        n = 0;
+        copied = 0;
+        current = 0;
+        for (size_t i = 0; i < _wires.size(); i++)
         {
-            for (unsigned int e = 0; e < _wires[i]->getSensorsCount(); e++)
-            {
-                DeviceAddress address;
-                ENUM_NBD_ERROR err;
-                if ((e && i==0) || i>0 )
-                    json += ",";
-                json += "\"";
-                _wires[e]->getAddressByIndex(e,address);
-                json += _wires[e]->addressToString(address);
-                json += "\":\"";
-                json += _wires[e]->getSensorNameByIndex(e,err);
-                json += "\"";
-            }
+            uint32_t sequence;
+            unsigned int room = max - n;
+            n += _wires[i]->getSnapshot(out + n, room > 255 ? 255 : (uint8_t)room, &sequence);
+            copied += sequence;
         }
-        json += "}";
-
-        File file = SPIFFS.open(_pathofsensornames, "w");
-        if (!file)
+        for (size_t i = 0; i < _wires.size(); i++)
         {
-            _DS18B20_PL(F("Error opening file for writing"));
-            return;
+            current += _wires[i]->getSnapshotSequence();
         }
-        _DS18B20_PL(json);
-        file.print(json);
-        file.flush();
-        file.close();
-    }
+    } while (copied != current);
+    return n;
 }
 
-String NonBlockingDallasArray::addressToString(DeviceAddress sensorAddress)
+/**
+ * Enables the compressed history on every wire, see NonBlockingDallas::enableCompressedHistory().
+ *
+ * @param blocks number of blocks per sensor
+ * @param resolutionMillis time resolution of the stored samples [milliseconds]
+ *
+ * @return void
+ */
+void NonBlockingDallasArray::enableCompressedHistory(uint16_t blocks, unsigned long resolutionMillis)
 {
-    String str = "";
-    for (int i = 0; i < 8; i++)
+    for (size_t i = 0; i < _wires.size(); i++)
     {
-        str += sensorAddress[i];
-        if (i != 7)
-            str += ".";
+        _wires[i]->enableCompressedHistory(blocks, resolutionMillis);
     }
-    return str;
 }
 
-
-
 /**
- * Sets the resolution for the NonBlockingDallasArray object and propagates the resolution to all associated wires.
- * ('Wire' means a pin wich is used by NonBlockingDallas object)
- *
- * @param res the resolution to be set
+ * Returns the compressed history of the sensor selected by its index, without copying it, see
+ * NonBlockingDallas::getCompressedHistoryByIndex() for how long the pointer is valid.
  *
- * @return void
+ * @param index the index of the sensor
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
  *
- * @throws None
+ * @return the series or nullptr if the index is out of range
  */
-void NonBlockingDallasArray::setResolution(NonBlockingDallas::NBD_resolution res)
+const NBD_CompressedSeries *NonBlockingDallasArray::getCompressedHistoryByIndex(NBD_index_t index, ENUM_NBD_ERROR &err)
 {
-    _res=res;
-    for (size_t i = 0; i < _wires.size(); i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
     {
-        _wires[i]->setResolution(res);
+        return _wires[wire]->getCompressedHistoryByIndex(local,err);
     }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return nullptr;
 }
 
 /**
- * Retrieves the resolution from the NonBlockingDallasArray.
+ * Copies the compressed history of the sensor selected by its index, safe while the wires run
+ * in their own tasks.
  *
- * @return NBD_resolution the resolution value
+ * @param index the index of the sensor
+ * @param out receives the series
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
  *
- */ 
-NonBlockingDallas::NBD_resolution NonBlockingDallasArray::getResolution()
+ * @return a boolean indicating if the operation was successful or not
+ */
+bool NonBlockingDallasArray::getCompressedHistoryByIndex(NBD_index_t index, NBD_CompressedSeries &out, ENUM_NBD_ERROR &err)
 {
-    return _res;
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->getCompressedHistoryByIndex(local,out,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return false;
 }
 
 /**
@@ -228,20 +1667,14 @@ String NonBlockingDallasArray::getUnitsOfMeasureAsString()
  *
  * @throws None
  */
-unsigned char NonBlockingDallasArray::getGPIO(unsigned char indexofsensor,ENUM_NBD_ERROR &err)
+unsigned char NonBlockingDallasArray::getGPIO(NBD_index_t indexofsensor,ENUM_NBD_ERROR &err)
 {
-    unsigned int pointer=0;
-    for(unsigned int i=0; i<_wires.size();i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(indexofsensor,wire,local))
     {
-      if(pointer+_wires.at(i)->getSensorsCount()>indexofsensor)
-      {
         err=NBD_NO_ERROR;
-        return _wires.at(i)->getGPIO();
-      }
-      else
-      {
-        pointer+=_wires.at(i)->getSensorsCount();
-      }
+        return _wires[wire]->getGPIO();
     }
     err=NBD_INDEX_IS_OUT_OF_RANGE;
     return 0;
@@ -260,6 +1693,22 @@ String NonBlockingDallasArray::getWireName(unsigned char index)
     return _wires[index]->getWireName();
 }
 
+/**
+ * Gets the name of the wire at the specified index without copying it, see
+ * NonBlockingDallas::getWireName(uint8_t &).
+ *
+ * @param index the index of the wire
+ * @param length receives the length of the name
+ *
+ * @return the terminated name, "" if the index is out of bounds
+ */
+const char *NonBlockingDallasArray::getWireName(unsigned char index, uint8_t &length)
+{
+    length = 0;
+    if(index>=_wires.size())return "";
+    return _wires[index]->getWireName(length);
+}
+
 /**
  * Sets the wire name for a specific index in the NonBlockingDallasArray.
  *
@@ -272,6 +1721,22 @@ void NonBlockingDallasArray::setWireName(String wirename, unsigned char index)
     _wires[index]->setWireName(wirename);
 }
 
+/**
+ * Counts the names of all wires that could not be stored without a caller to tell, see
+ * NonBlockingDallas::getNameErrorCount().
+ *
+ * @return the failures of every wire
+ */
+uint16_t NonBlockingDallasArray::getNameErrorCount()
+{
+    uint32_t count = 0;
+    for(size_t i=0; i<_wires.size(); i++)
+    {
+        count += _wires[i]->getNameErrorCount();
+    }
+    return count>0xFFFF ? 0xFFFF : count;
+}
+
 /**
  * Get temperature by index in the NonBlockingDallasArray.
  *
@@ -282,20 +1747,14 @@ void NonBlockingDallasArray::setWireName(String wirename, unsigned char index)
  *
  * @throws NBD_INDEX_IS_OUT_OF_RANGE if the index is out of range
  */
-float NonBlockingDallasArray::getTempByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+float NonBlockingDallasArray::getTempByIndex(NBD_index_t index, ENUM_NBD_ERROR &err)
 {
-    unsigned int pointer =0;
     err=NBD_NO_ERROR;
-    for(unsigned int i=0; i<_wires.size();i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
     {
-      if(pointer+_wires.at(i)->getSensorsCount()>index)
-      {
-        return _wires.at(i)->getTempByIndex(index-pointer,err);
-      }
-      else
-      {
-          pointer+=_wires.at(i)->getSensorsCount();
-      }
+        return _wires[wire]->getTempByIndex(local,err);
     }
     err = NBD_INDEX_IS_OUT_OF_RANGE;
     return (_unitsOM==NonBlockingDallas::NBD_unitsOfMeasure::unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
@@ -307,20 +1766,13 @@ float NonBlockingDallasArray::getTempByIndex(unsigned char index, ENUM_NBD_ERROR
 /// @return temp or DEVICE_DISCONNECTED_C OR DEVICE_DISCONNECTED_F
 float NonBlockingDallasArray::getTempByName(String name, ENUM_NBD_ERROR &err)
 {
-    float temp=(_unitsOM==NonBlockingDallas::NBD_unitsOfMeasure::unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
-    
-    ENUM_NBD_ERROR er;
-    for(unsigned int i=0; i<_wires.size();i++)
+    NBD_index_t index;
+    if(locateName(name,index))
     {
-        er = NBD_NO_ERROR;
-        temp=_wires.at(i)->getTempByName(name,er);
-        if(er==NBD_NO_ERROR)
-        {
-            break;
-        }
+        return getTempByIndex(index,err);
     }
-    err=er;
-    return temp;
+    err=NBD_NAME_NOT_FOUND;
+    return (_unitsOM==NonBlockingDallas::NBD_unitsOfMeasure::unit_C) ? DEVICE_DISCONNECTED_C : DEVICE_DISCONNECTED_F;
 }
 
 /**
@@ -346,25 +1798,42 @@ float NonBlockingDallasArray::getTempByNameS(String name)
  *
  * @throws ENUM_NBD_ERROR if the index is out of range
  */
-String NonBlockingDallasArray::getSensorNameByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+String NonBlockingDallasArray::getSensorNameByIndex(NBD_index_t index, ENUM_NBD_ERROR &err)
 {
-    unsigned int pointer =0;
     err=NBD_NO_ERROR;
-    for(unsigned int i=0; i<_wires.size();i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
     {
-      if(pointer+_wires.at(i)->getSensorsCount()>index)
-      {
-        return _wires.at(i)->getSensorNameByIndex(index-pointer,err);
-      }
-      else
-      {
-          pointer+=_wires.at(i)->getSensorsCount();
-      }
+        return _wires[wire]->getSensorNameByIndex(local,err);
     }
     err = NBD_INDEX_IS_OUT_OF_RANGE;
     return String("");
 }
 
+/**
+ * Returns the name of a sensor without copying it, see
+ * NonBlockingDallas::getSensorNameByIndex(unsigned char, uint8_t &, ENUM_NBD_ERROR &).
+ *
+ * @param index the global index of the sensor
+ * @param length receives the length of the name
+ * @param err an ENUM_NBD_ERROR reference to store any error that occurs
+ *
+ * @return the terminated name, "" if the sensor has no name or on error
+ */
+const char *NonBlockingDallasArray::getSensorNameByIndex(NBD_index_t index, uint8_t &length, ENUM_NBD_ERROR &err)
+{
+    size_t wire;
+    unsigned char local;
+    length = 0;
+    if(locate(index,wire,local))
+    {
+        return _wires[wire]->getSensorNameByIndex(local,length,err);
+    }
+    err = NBD_INDEX_IS_OUT_OF_RANGE;
+    return "";
+}
+
 /**
  * Set the sensor name by index in the NonBlockingDallasArray.
  *
@@ -375,20 +1844,14 @@ String NonBlockingDallasArray::getSensorNameByIndex(unsigned char index, ENUM_NB
  * @return a boolean indicating if the operation was successful or not
  *
  */
-bool NonBlockingDallasArray::setSensorNameByIndex(unsigned char index, String name, ENUM_NBD_ERROR &err)
+bool NonBlockingDallasArray::setSensorNameByIndex(NBD_index_t index, String name, ENUM_NBD_ERROR &err)
 {
-    unsigned int pointer =0;
     err=NBD_NO_ERROR;
-    for(unsigned int i=0; i<_wires.size();i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
     {
-      if(pointer+_wires.at(i)->getSensorsCount()>index)
-      {
-        return _wires.at(i)->setSensorNameByIndex(index-pointer,name,err);
-      }
-      else
-      {
-          pointer+=_wires.at(i)->getSensorsCount();
-      }
+        return _wires[wire]->setSensorNameByIndex(local,name,err);
     }
     err = NBD_INDEX_IS_OUT_OF_RANGE;
     return false;
@@ -400,21 +1863,16 @@ bool NonBlockingDallasArray::setSensorNameByIndex(unsigned char index, String na
  * @param name the sensor name to search for
  * @param err an ENUM_NBD_ERROR reference to store any errors that occur
  *
- * @return an unsigned char representing the index found by sensor name
+ * @return the index found by sensor name
  *
  */
-unsigned char NonBlockingDallasArray::getIndexBySensorName(String name, ENUM_NBD_ERROR &err)
+NBD_index_t NonBlockingDallasArray::getIndexBySensorName(String name, ENUM_NBD_ERROR &err)
 {
-    unsigned int pointer =0;
-    err=NBD_NO_ERROR;
-    for(unsigned int i=0; i<_wires.size();i++)
+    NBD_index_t index;
+    if(locateName(name,index))
     {
-      pointer+=_wires.at(i)->getIndexBySensorName(name,err);
-      if(err==NBD_NO_ERROR)
-      {
-        return pointer;
-      }
-      pointer+=_wires.at(i)->getSensorsCount();
+        err=NBD_NO_ERROR;
+        return index;
     }
     err=NBD_NAME_NOT_FOUND;
     return 0;
@@ -429,22 +1887,36 @@ unsigned char NonBlockingDallasArray::getIndexBySensorName(String name, ENUM_NBD
  *
  * @return the error code ENUM_NBD_ERROR
  *  */
-ENUM_NBD_ERROR NonBlockingDallasArray::getIndexBySensorName(String name, unsigned char &index)
+ENUM_NBD_ERROR NonBlockingDallasArray::getIndexBySensorName(String name, NBD_index_t &index)
 {
-    unsigned char pointer =0;
-    ENUM_NBD_ERROR err = NBD_NO_ERROR;
-    for(unsigned int i=0; i<_wires.size();i++)
+    if(locateName(name,index))
     {
-      pointer+=_wires.at(i)->getIndexBySensorName(name,err);
-      if(err==NBD_NO_ERROR)
-      {
-        index=pointer;
-        return err;
-      }
-      pointer+=_wires.at(i)->getSensorsCount();
+        return NBD_NO_ERROR;
     }
     index=0;
-    err=NBD_NAME_NOT_FOUND;
+    return NBD_NAME_NOT_FOUND;
+}
+
+/**
+ * Get the index by sensor name in the NonBlockingDallasArray.
+ *
+ * Deprecated: kept for the sketches written before the 16 bit indexes, use the NBD_index_t overload.
+ *
+ * @param name the name of the sensor
+ * @param index the index to be updated
+ *
+ * @return the error code ENUM_NBD_ERROR, NBD_INDEX_IS_OUT_OF_RANGE if the index does not fit in an unsigned char
+ *  */
+ENUM_NBD_ERROR NonBlockingDallasArray::getIndexBySensorName(String name, unsigned char &index)
+{
+    NBD_index_t wide;
+    ENUM_NBD_ERROR err=getIndexBySensorName(name,wide);
+    if(err==NBD_NO_ERROR && wide>0xFF)
+    {
+        err=NBD_INDEX_IS_OUT_OF_RANGE;
+        wide=0;
+    }
+    index=(unsigned char)wide;
     return err;
 }
 
@@ -458,20 +1930,14 @@ ENUM_NBD_ERROR NonBlockingDallasArray::getIndexBySensorName(String name, unsigne
  *
  * @throws NBD_INDEX_IS_OUT_OF_RANGE if the index is out of range
  */
-unsigned long NonBlockingDallasArray::getLastTimeOfValidTempByIndex(unsigned char index, ENUM_NBD_ERROR &err)
+unsigned long NonBlockingDallasArray::getLastTimeOfValidTempByIndex(NBD_index_t index, ENUM_NBD_ERROR &err)
 {
-    unsigned int pointer =0;
     err=NBD_NO_ERROR;
-    for(unsigned int i=0; i<_wires.size();i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
     {
-      if(pointer+_wires.at(i)->getSensorsCount()>index)
-      {
-        return _wires.at(i)->getLastTimeOfValidTempByIndex(index-pointer,err);
-      }
-      else
-      {
-          pointer+=_wires.at(i)->getSensorsCount();
-      }
+        return _wires[wire]->getLastTimeOfValidTempByIndex(local,err);
     }
     err = NBD_INDEX_IS_OUT_OF_RANGE;
     return 0;
@@ -488,19 +1954,13 @@ unsigned long NonBlockingDallasArray::getLastTimeOfValidTempByIndex(unsigned cha
  */
 unsigned long NonBlockingDallasArray::getLastTimeOfValidTempByName(const String& name, ENUM_NBD_ERROR &err)
 {
-    ENUM_NBD_ERROR er;
-    unsigned long temp=DEVICE_DISCONNECTED_C;
-    for(unsigned int i=0; i<_wires.size();i++)
+    NBD_index_t index;
+    if(locateName(name,index))
     {
-        er = NBD_NO_ERROR;
-        temp=_wires.at(i)->getLastTimeOfValidTempByName(name,er);
-        if(er==NBD_NO_ERROR)
-        {
-            break;
-        }
+        return getLastTimeOfValidTempByIndex(index,err);
     }
-    err=er;
-    return temp;
+    err=NBD_NAME_NOT_FOUND;
+    return DEVICE_DISCONNECTED_C;
 }
 
 /**
@@ -511,36 +1971,26 @@ unsigned long NonBlockingDallasArray::getLastTimeOfValidTempByName(const String&
  *
  * @return an error code indicating the result of the operation
  */
-ENUM_NBD_ERROR NonBlockingDallasArray::getAddressByIndex(unsigned char index, DeviceAddress &address)
+ENUM_NBD_ERROR NonBlockingDallasArray::getAddressByIndex(NBD_index_t index, DeviceAddress &address)
 {
-    unsigned int pointer=0;
-    for(unsigned int i=0; i<_wires.size();i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
     {
-      if(pointer+_wires.at(i)->getSensorsCount()>index)
-      {
-        return _wires.at(i)->getAddressByIndex(index-pointer,address);
-      }
-      else{
-          pointer+=_wires.at(i)->getSensorsCount();
-      }
+        return _wires[wire]->getAddressByIndex(local,address);
     }
     return NBD_INDEX_IS_OUT_OF_RANGE;
 }
 
-String NonBlockingDallasArray::getAddressByIndexS(unsigned char index)
+String NonBlockingDallasArray::getAddressByIndexS(NBD_index_t index)
 {
     DeviceAddress address;
-    unsigned int pointer=0;
-    for(unsigned int i=0; i<_wires.size();i++)
+    size_t wire;
+    unsigned char local;
+    if(locate(index,wire,local))
     {
-      if(pointer+_wires.at(i)->getSensorsCount()>index)
-      {
-        _wires.at(i)->getAddressByIndex(index-pointer,address);
+        _wires[wire]->getAddressByIndex(local,address);
         return addressToString(address);
-      }
-      else{
-          pointer+=_wires.at(i)->getSensorsCount();
-      }
     }
     return String();
 }
@@ -583,13 +2033,14 @@ String NonBlockingDallasArray::getSensorNameByAddress(const DeviceAddress addr,
 {
     err=NBD_NO_ERROR;
     DeviceAddress addr2;
-    for(unsigned int i=0; i<getSensorsCount();i++)
+    NBD_index_t count=getSensorsCount();
+    for(NBD_index_t i=0; i<count;i++)
     {
         if(getAddressByIndex(i,addr2)==NBD_NO_ERROR)
         {
             if(addr2[0]==addr[0] && addr2[1]==addr[1] && addr2[2]==addr[2] && addr2[3]==addr[3] && addr2[4]==addr[4] && addr2[5]==addr[5] && addr2[6]==addr[6] && addr2[7]==addr[7])
             {
-                return getSensorNameByIndex((unsigned char)i,err);
+                return getSensorNameByIndex(i,err);
             }
         }       
     }
@@ -601,13 +2052,14 @@ String NonBlockingDallasArray::getSensorNameByAddressS(const DeviceAddress addr)
 {
     ENUM_NBD_ERROR err;
     DeviceAddress addr2;
-    for(unsigned int i=0; i<getSensorsCount();i++)
+    NBD_index_t count=getSensorsCount();
+    for(NBD_index_t i=0; i<count;i++)
     {
         if(getAddressByIndex(i,addr2)==NBD_NO_ERROR)
         {
             if(addr2[0]==addr[0] && addr2[1]==addr[1] && addr2[2]==addr[2] && addr2[3]==addr[3] && addr2[4]==addr[4] && addr2[5]==addr[5] && addr2[6]==addr[6] && addr2[7]==addr[7])
             {
-                return getSensorNameByIndex((unsigned char)i,err);
+                return getSensorNameByIndex(i,err);
             }
         }       
     }
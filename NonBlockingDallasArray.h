@@ -2,8 +2,18 @@
 #define NONBLOCKINGDALLASARRAY_H
 
 #include "NonBlockingDallas.h"
+#include "NBD_group.h"
+#include "NBD_timerwheel.h"
 #include <vector>
+#if defined(NBD_STD_THREAD)
+#include <atomic>
+#include <chrono>
+#endif
+
 
+#ifndef NBD_PARASITE_WIRES_PARALLEL
+#define NBD_PARASITE_WIRES_PARALLEL 0 //Parasite powered wires converting at once, 0 = no limit
+#endif
 
 //#define DEBUG_NBDARRAY                //comment out if you want debug output 
 
@@ -21,13 +31,100 @@ The key purpose of the class is to group multiple NonBlockingDallas objects toge
 and provide methods to interact with all of them collectively. This allows you to manage
 many temperature sensors over different wires efficiently.
 */
-class NonBlockingDallasArray
+class NonBlockingDallasArray : private NBD_ReadingObserver
 {
 private:
     NonBlockingDallas::NBD_unitsOfMeasure  _unitsOM;               //Unit of measurement
     NonBlockingDallas::NBD_resolution      _res;
     String              _pathofsensornames="";
     std::vector<NonBlockingDallas*> _wires;
+    std::vector<NBD_index_t> _offsets;     //Global index of the first sensor of each wire, the total at the end
+    struct NameEntry
+    {
+        NBD_name_t id;                      //Interned name
+        NBD_index_t index;
+    };
+    std::vector<NameEntry> _names;          //Named sensors sorted by name id
+    std::atomic<bool>   _indexChanged;      //_offsets and _names must be rebuilt, set from the wire tasks
+    NBD_Mutex           _indexLock;         //Guards _offsets and _names across a rebuild and the lookups
+    static void         notifyIndexChanged(void *ctx);
+    void                refreshIndex();
+    bool                locate(NBD_index_t index, size_t &wire, unsigned char &local);
+    bool                locateName(const String &name, NBD_index_t &index);
+    uint8_t             _parasiteWiresMax;  //Parasite wires converting at once, 0 = no limit
+    NBD_ReadingQueue    *_readingQueue;     //Queue shared by the wires, see setReadingQueue()
+    struct Group
+    {
+        String name;
+        NBD_SensorGroup sensors;
+        bool changed;                       //Aggregates changed since the last onGroupChange
+    };
+    struct GroupLink
+    {
+        uint8_t group;
+        uint16_t member;
+        int16_t next;                       //Next group of the same sensor, -1 at the end
+    };
+    std::vector<Group>  _groups;
+    std::vector<std::vector<int16_t> > _groupHeads; //[wire slot][sensor slot] first link of the sensor, -1 if none
+    std::vector<GroupLink> _groupLinks;
+    int16_t             _freeGroupLink;     //First link freed by a sensor that left, chained by next, -1 if none
+    NBD_Mutex           _groupLock;         //Readings arrive from the wire tasks
+    void                (*cb_onGroupChange)(String group, const NBD_GroupStats &stats);
+    struct StaleEntry
+    {
+        NBD_handle_t handle;                //Sensor of the timer, NBD_INVALID_HANDLE if not configured
+        unsigned long maxAge;               //0 = not watched
+        bool stale;
+    };
+    NBD_TimerWheel      _staleWheel;        //Freshness deadlines of the watched sensors
+    std::vector<StaleEntry> _staleEntries;  //By timer id
+    std::vector<std::vector<uint16_t> > _staleTimers; //[wire slot][sensor slot] timer id, NBD_WHEEL_NONE if none
+    unsigned long       _defaultStaleAfter; //Applied to sensors without their own setting, 0 = off
+    NBD_Mutex           _staleLock;
+    void                (*cb_onSensorStale)(NBD_handle_t handle);
+    void                (*cb_onSensorRecovered)(NBD_handle_t handle);
+    NBD_TraceBuffer     *_trace;            //Records the timing of the callbacks of the array if set
+    uint16_t            staleTimer(NBD_handle_t handle, bool create);
+    void                staleReading(NBD_handle_t handle);
+    void                processStale();
+    void                groupReading(NBD_handle_t handle, int32_t raw, bool valid);
+    void                groupLeft(NBD_handle_t handle);
+    void                renumberMember(uint8_t group, NBD_handle_t handle, uint16_t from, uint16_t to);
+    void                onReading(NBD_handle_t handle, int32_t raw, bool valid) override;
+    void                onSensorLeft(NBD_handle_t handle) override;
+    void                onPublished(uint8_t wireSlot) override;
+    int                 findGroup(const String &name);
+    void                fillGroupStats(const NBD_SensorGroup &group, NBD_GroupStats &stats);
+    uint8_t             parasiteConverting();
+    bool                parasiteGated(size_t wire, uint8_t converting);
+#if defined(NBD_HAS_EPOLL)
+    int                 _epollFd;           //Returned by getPollFd()
+    int                 _timerFd;           //Readable at the next deadline of the wires
+    int                 _eventFd;           //Readable when a wire published readings
+    uint32_t            _publishedSum;      //Sum of the snapshot sequences at the last processEvents()
+    static void         notifyPublished(void *ctx);
+    void                armTimer();
+#endif
+#if defined(NBD_HAS_TASKS)
+    struct WireTask
+    {
+        NonBlockingDallas *wire;
+        unsigned long idleMillis;       //Sleep between two update() calls of the task
+#if defined(NBD_FREERTOS)
+        volatile bool run;
+        TaskHandle_t handle;
+        SemaphoreHandle_t done;
+#else
+        std::atomic<bool> run;
+        std::thread thread;
+#endif
+    };
+    std::vector<WireTask*> _tasks;     //One per wire while the task mode is running
+#if defined(NBD_FREERTOS)
+    static void wireTaskLoop(void *arg);
+#endif
+#endif
 public:
     NonBlockingDallasArray();
     ~NonBlockingDallasArray();
@@ -37,39 +134,109 @@ public:
 
     void addNonBlockingDallas(NonBlockingDallas* NBDpt);
     void                update();
+    unsigned long       getMillisToNextUpdate();
+#if defined(NBD_HAS_COROUTINES)
+    NBD_ReadAllAwaiter  readAll();
+    NBD_SensorReadAwaiter readSensor(NBD_handle_t handle);
+#endif
+#if defined(NBD_HAS_TASKS)
+    bool                startTasks(unsigned long idleMillis = 1);
+    void                stopTasks();
+#endif
+    bool                isRunningTasks();
+#if defined(NBD_HAS_EPOLL)
+    int                 getPollFd();
+    bool                processEvents();
+#endif
     void                rescanWire();
     void                requestTemperature();
-    const unsigned char getSensorsCount();
+    const NBD_index_t   getSensorsCount();
     void                saveSensorNames();
     String              addressToString(DeviceAddress sensorAddress);
 
     void                setResolution(NonBlockingDallas::NBD_resolution res);
     NonBlockingDallas::NBD_resolution      getResolution();
 
+    void                setReadOptions(bool verifyCrc, uint8_t retries);
+    void                setParasiteWiresParallel(uint8_t wires);
+    void                setParasiteMaxParallel(uint8_t sensors);
+    void                setQuarantinePolicy(uint8_t failuresToQuarantine, uint8_t maxBackoffCycles);
+    bool                getHealthByIndex(NBD_index_t index, NBD_SensorHealth &health, ENUM_NBD_ERROR &err);
+    ENUM_NBD_ERROR      requestPriorityReadByIndex(NBD_index_t index, NBD_PriorityTicket &ticket);
+    ENUM_NBD_ERROR      requestPriorityReadByName(String name, NBD_PriorityTicket &ticket);
+    bool                isPriorityReadComplete(const NBD_PriorityTicket &ticket);
+    bool                setCalibrationByIndex(NBD_index_t index, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err);
+    bool                setCalibrationByAddress(const DeviceAddress addr, const NBD_Calibration &calibration, ENUM_NBD_ERROR &err);
+    bool                getCalibrationByIndex(NBD_index_t index, NBD_Calibration &calibration, ENUM_NBD_ERROR &err);
+    void                setFilterConfig(const NBD_FilterConfig &config);
+    bool                setFilterConfigByIndex(NBD_index_t index, const NBD_FilterConfig &config, ENUM_NBD_ERROR &err);
+
+    void                enableHistory(uint16_t samples, const NBD_HistoryTier *tiers, uint8_t tierCount);
+    uint16_t            getHistoryByIndex(NBD_index_t index, unsigned long from, unsigned long to,
+                                          NBD_HistorySample *out, uint16_t max, ENUM_NBD_ERROR &err);
+    uint16_t            getHistoryRollupsByIndex(NBD_index_t index, uint8_t tier, unsigned long from, unsigned long to,
+                                                 NBD_HistoryRollup *out, uint16_t max, ENUM_NBD_ERROR &err);
+    bool                setReadingQueue(NBD_ReadingQueue *queue);
+    void                setTrace(NBD_TraceBuffer *trace);
+    NBD_handle_t        getHandleByIndex(NBD_index_t index, ENUM_NBD_ERROR &err);
+    NBD_handle_t        getHandleByName(String name, ENUM_NBD_ERROR &err);
+    bool                isHandleValid(NBD_handle_t handle);
+    ENUM_NBD_ERROR      getIndexByHandle(NBD_handle_t handle, NBD_index_t &index);
+    float               getTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err);
+    unsigned long       getLastTimeOfValidTempByHandle(NBD_handle_t handle, ENUM_NBD_ERROR &err);
+    bool                addToGroup(String group, NBD_handle_t handle, ENUM_NBD_ERROR &err);
+    bool                addToGroupByName(String group, String sensorName, ENUM_NBD_ERROR &err);
+    bool                getGroupStats(String group, NBD_GroupStats &stats, ENUM_NBD_ERROR &err);
+    void onGroupChange(void (*callback)(String group, const NBD_GroupStats &stats))
+    {
+        cb_onGroupChange = callback;
+    }
+    bool                setStaleAfter(NBD_handle_t handle, unsigned long maxAgeMillis, ENUM_NBD_ERROR &err);
+    void                setStaleAfterAll(unsigned long maxAgeMillis);
+    bool                isStale(NBD_handle_t handle);
+    void onSensorStale(void (*callback)(NBD_handle_t handle))
+    {
+        cb_onSensorStale = callback;
+    }
+    void onSensorRecovered(void (*callback)(NBD_handle_t handle))
+    {
+        cb_onSensorRecovered = callback;
+    }
+    unsigned int        copyReadings(NBD_SensorSnapshot *out, unsigned int max);
+    unsigned int        getSnapshot(NBD_SensorSnapshot *out, unsigned int max);
+    void                enableCompressedHistory(uint16_t blocks, unsigned long resolutionMillis);
+    const NBD_CompressedSeries *getCompressedHistoryByIndex(NBD_index_t index, ENUM_NBD_ERROR &err);
+    bool                getCompressedHistoryByIndex(NBD_index_t index, NBD_CompressedSeries &out, ENUM_NBD_ERROR &err);
+
     void                setUnitsOfMeasure(NonBlockingDallas::NBD_unitsOfMeasure unit);
     NonBlockingDallas::NBD_unitsOfMeasure  getUnitsOfMeasure();
     String              getUnitsOfMeasureAsString();//'C' or 'F'
 
-    unsigned char       getGPIO(unsigned char index,ENUM_NBD_ERROR &err);
+    unsigned char       getGPIO(NBD_index_t index,ENUM_NBD_ERROR &err);
 
     String              getWireName(unsigned char index);
+    const char          *getWireName(unsigned char index, uint8_t &length);
     void                setWireName(String wirename, unsigned char indexofwire);
+    uint16_t            getNameErrorCount();
 
-    float               getTempByIndex(unsigned char index, ENUM_NBD_ERROR &err);
+    float               getTempByIndex(NBD_index_t index, ENUM_NBD_ERROR &err);
     float               getTempByName(String name, ENUM_NBD_ERROR &err);
     float               getTempByNameS(String name);
 
-    String              getSensorNameByIndex(unsigned char index, ENUM_NBD_ERROR &err);
-    bool                setSensorNameByIndex(unsigned char index, String name, ENUM_NBD_ERROR &err);
+    String              getSensorNameByIndex(NBD_index_t index, ENUM_NBD_ERROR &err);
+    const char          *getSensorNameByIndex(NBD_index_t index, uint8_t &length, ENUM_NBD_ERROR &err);
+    bool                setSensorNameByIndex(NBD_index_t index, String name, ENUM_NBD_ERROR &err);
 
-    unsigned char       getIndexBySensorName(String name, ENUM_NBD_ERROR &err);
+    NBD_index_t         getIndexBySensorName(String name, ENUM_NBD_ERROR &err);
+    ENUM_NBD_ERROR      getIndexBySensorName(String name, NBD_index_t &index);
+    __attribute__((deprecated("use the NBD_index_t overload, an unsigned char only holds the first 256 sensors")))
     ENUM_NBD_ERROR      getIndexBySensorName(String name, unsigned char &index);
 
-    unsigned long       getLastTimeOfValidTempByIndex(unsigned char index, ENUM_NBD_ERROR &err);
+    unsigned long       getLastTimeOfValidTempByIndex(NBD_index_t index, ENUM_NBD_ERROR &err);
     unsigned long       getLastTimeOfValidTempByName(const String& name, ENUM_NBD_ERROR &err);
 
-    ENUM_NBD_ERROR      getAddressByIndex(unsigned char index, DeviceAddress &address);
-    String              getAddressByIndexS(unsigned char index);
+    ENUM_NBD_ERROR      getAddressByIndex(NBD_index_t index, DeviceAddress &address);
+    String              getAddressByIndexS(NBD_index_t index);
 
     bool                setSensorNameByAddress(const DeviceAddress addr, String name, ENUM_NBD_ERROR &err);
     String              getSensorNameByAddress(const DeviceAddress addr, ENUM_NBD_ERROR &err);
@@ -0,0 +1,106 @@
+/*
+Runs the awaitable API on an NBD_Executor: records a scripted bus while a coroutine awaits
+readAll(), replays the recording with NBD_ReplayTransport under the same coroutine and checks
+the readings, then checks readSensor(), NBD_sleep() and an awaited NBD_Task<T>. Needs a C++20
+build (-std=gnu++20).
+*/
+
+#include "host_check.h"
+#include "NBD_coro.h"
+
+#if !defined(NBD_HAS_COROUTINES)
+int main()
+{
+    printf("coro_check: coroutines not available, build with -std=gnu++20\n");
+    return 1;
+}
+#else
+
+#define CHECK_CYCLES   5
+#define CHECK_INTERVAL 50   //Read interval of the wires [milliseconds]
+#define CHECK_SLEEP    30   //[milliseconds]
+
+static NBD_Task<> readCycles(NonBlockingDallas &wire, int cycles, std::vector<CycleReadings> &out)
+{
+    for (int i = 0; i < cycles; i++)
+    {
+        co_await wire.readAll();
+        out.push_back(takeReadings(wire));
+    }
+}
+
+static NBD_Task<NBD_ReadResult> readOne(NonBlockingDallas &wire, NBD_handle_t handle)
+{
+    NBD_ReadResult result = co_await wire.readSensor(handle);
+    co_return result;
+}
+
+static NBD_Task<> readTwo(NonBlockingDallas &wire, NBD_handle_t handle, NBD_handle_t gone,
+                          NBD_ReadResult &result, NBD_ReadResult &invalid)
+{
+    result = co_await readOne(wire, handle);
+    invalid = co_await readOne(wire, gone);
+}
+
+static NBD_Task<> sleeper(unsigned long &elapsed)
+{
+    unsigned long start = millis();
+    co_await NBD_sleep(CHECK_SLEEP);
+    elapsed = millis() - start;
+}
+
+int main()
+{
+    FakeBus bus;
+    MemoryPrint capture;
+    NBD_RecordingTransport recorder(&bus, &capture);
+    NonBlockingDallas live(&recorder, 4);
+    live.begin(NonBlockingDallas::resolution_12, NonBlockingDallas::unit_C, CHECK_INTERVAL);
+    std::vector<CycleReadings> recorded;
+    {
+        NBD_Executor executor(&live);
+        executor.spawn(readCycles(live, CHECK_CYCLES, recorded));
+        CHECK(executor.getTaskCount() == 1);
+        executor.run();
+        CHECK(executor.getTaskCount() == 0);
+    }
+    recorder.setRecording(false);
+    CHECK(recorded.size() == CHECK_CYCLES);
+
+    NBD_ReplayTransport replay;
+    CHECK(replay.load(capture.data.data(), capture.data.size()));
+    NonBlockingDallas replayed(&replay, 4);
+    replayed.begin(NonBlockingDallas::resolution_12, NonBlockingDallas::unit_C, CHECK_INTERVAL);
+    std::vector<CycleReadings> played;
+    NBD_Executor executor(&replayed);
+    executor.spawn(readCycles(replayed, CHECK_CYCLES, played));
+    executor.run();
+    CHECK(played.size() == recorded.size());
+    for (size_t c = 0; c < played.size() && c < recorded.size(); c++)
+    {
+        if (!sameReadings(played[c], recorded[c]))
+        {
+            printf("cycle %u differs\n", (unsigned)c);
+            checkFailures++;
+        }
+    }
+
+    // Past the end of the recording the last conversion is served again
+    ENUM_NBD_ERROR err;
+    NBD_handle_t handle = replayed.getHandleByIndex(0, err);
+    CHECK(err == NBD_NO_ERROR);
+    NBD_ReadResult result, invalid;
+    unsigned long elapsed = 0;
+    executor.spawn(readTwo(replayed, handle, NBD_makeHandle(0x7F, 0, 0), result, invalid));
+    executor.spawn(sleeper(elapsed));
+    CHECK(executor.getTaskCount() == 2);
+    executor.run();
+    CHECK(result.err == NBD_NO_ERROR);
+    CHECK(result.reading.valid && result.reading.handle == handle);
+    if (!recorded.empty())
+        CHECK(result.reading.raw == recorded.back().raw[0]);
+    CHECK(invalid.err == NBD_HANDLE_IS_NOT_VALID);
+    CHECK(elapsed >= CHECK_SLEEP);
+    return checkResult("coro_check");
+}
+#endif
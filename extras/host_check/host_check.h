@@ -0,0 +1,133 @@
+#ifndef NBD_HOST_CHECK_H
+#define NBD_HOST_CHECK_H
+
+/*
+Shared pieces of the host checks: a CHECK macro counting the failures, a Print collecting a
+recording in memory and a scripted bus. The checks build against the library sources and an
+Arduino emulation layer providing millis(), delay(), String and Print, see README.md.
+*/
+
+#include "NonBlockingDallas.h"
+#include "NBD_record.h"
+#include <stdio.h>
+#include <vector>
+
+static int checkFailures = 0;
+
+#define CHECK(cond)                                                                   \
+    do                                                                                \
+    {                                                                                 \
+        if (!(cond))                                                                  \
+        {                                                                             \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);           \
+            checkFailures++;                                                          \
+        }                                                                             \
+    } while (0)
+
+//Prints the summary, the exit code of the check
+inline int checkResult(const char *name)
+{
+    printf("%s: %s\n", name, checkFailures == 0 ? "OK" : "FAILED");
+    return checkFailures == 0 ? 0 : 1;
+}
+
+//Collects a recording of NBD_RecordingTransport in memory
+class MemoryPrint : public Print
+{
+public:
+    std::vector<uint8_t> data;
+
+    size_t write(uint8_t b) override
+    {
+        data.push_back(b);
+        return 1;
+    }
+};
+
+/*
+Bus of three sensors whose temperatures follow a script: conversion n reads
+20 °C + n/16 °C + sensor/2 °C, except the second sensor, which does not answer in the third
+conversion. A conversion takes FAKE_CONVERSION_MILLIS.
+*/
+#define FAKE_SENSORS           3
+#define FAKE_CONVERSION_MILLIS 20
+
+class FakeBus : public NBD_Transport
+{
+public:
+    FakeBus() : _conversions(0), _requestMillis(0) {}
+
+    void     begin() override {}
+    uint8_t  getDeviceCount() override { return FAKE_SENSORS; }
+    bool     getAddress(uint8_t *address, uint8_t index) override
+    {
+        if (index >= FAKE_SENSORS)
+            return false;
+        const uint8_t rom[7] = {0x28, (uint8_t)(0x10 + index), 0x22, 0x33, 0x44, 0x55, 0x66};
+        memcpy(address, rom, 7);
+        address[7] = crc8(address, 7);
+        return true;
+    }
+    void     setResolution(uint8_t bits) override { (void)bits; }
+    bool     isParasitePowerMode() override { return false; }
+    void     requestTemperatures() override { startConversion(); }
+    void     requestTemperatureByAddress(const uint8_t *address) override
+    {
+        (void)address;
+        startConversion();
+    }
+    bool     isConversionComplete() override { return millis() - _requestMillis >= FAKE_CONVERSION_MILLIS; }
+    uint16_t millisToWaitForConversion(uint8_t bits) override
+    {
+        (void)bits;
+        return FAKE_CONVERSION_MILLIS;
+    }
+    int32_t  getTempRaw(const uint8_t *address) override
+    {
+        uint8_t sensor = address[1] - 0x10;
+        if (sensor == 1 && _conversions == 3)
+            return DEVICE_DISCONNECTED_RAW;
+        return 20 * 128 + (int32_t)_conversions * 8 + sensor * 64;
+    }
+
+private:
+    uint32_t      _conversions;
+    unsigned long _requestMillis;
+
+    void startConversion()
+    {
+        _conversions++;
+        _requestMillis = millis();
+    }
+};
+
+//Reading of every sensor of a wire after a read cycle
+struct CycleReadings
+{
+    bool    valid[FAKE_SENSORS];
+    int32_t raw[FAKE_SENSORS];
+};
+
+inline CycleReadings takeReadings(NonBlockingDallas &wire)
+{
+    CycleReadings r;
+    for (unsigned char i = 0; i < FAKE_SENSORS; i++)
+    {
+        NBD_SensorSnapshot s;
+        ENUM_NBD_ERROR err;
+        r.valid[i] = wire.getSnapshotByIndex(i, s, err) && s.valid;
+        r.raw[i] = s.raw;
+    }
+    return r;
+}
+
+inline bool sameReadings(const CycleReadings &a, const CycleReadings &b)
+{
+    for (unsigned char i = 0; i < FAKE_SENSORS; i++)
+    {
+        if (a.valid[i] != b.valid[i] || (a.valid[i] && a.raw[i] != b.raw[i]))
+            return false;
+    }
+    return true;
+}
+#endif /* NBD_HOST_CHECK_H */
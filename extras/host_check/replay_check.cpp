@@ -0,0 +1,67 @@
+/*
+Records a scripted bus with NBD_RecordingTransport, plays the recording back with
+NBD_ReplayTransport and checks that the wire publishes the same readings, cycle by cycle,
+including the fault of the script.
+*/
+
+#include "host_check.h"
+
+#define CHECK_CYCLES   6
+#define CHECK_INTERVAL 50   //Read interval of the wires [milliseconds]
+#define CHECK_TIMEOUT  5000 //Longest run of a wire [milliseconds]
+
+//Runs the wire until it completed cycles read cycles or finished() is true
+template <typename Finished>
+static std::vector<CycleReadings> runWire(NonBlockingDallas &wire, uint32_t cycles, Finished finished)
+{
+    std::vector<CycleReadings> readings;
+    uint32_t seen = wire.getCycleCount();
+    unsigned long start = millis();
+    while (readings.size() < cycles && !finished() && millis() - start < CHECK_TIMEOUT)
+    {
+        wire.update();
+        if (wire.getCycleCount() != seen)
+        {
+            seen = wire.getCycleCount();
+            readings.push_back(takeReadings(wire));
+        }
+        delay(1);
+    }
+    return readings;
+}
+
+int main()
+{
+    FakeBus bus;
+    MemoryPrint capture;
+    NBD_RecordingTransport recorder(&bus, &capture);
+    NonBlockingDallas live(&recorder, 4);
+    live.begin(NonBlockingDallas::resolution_12, NonBlockingDallas::unit_C, CHECK_INTERVAL);
+    CHECK(live.getSensorsCount() == FAKE_SENSORS);
+    std::vector<CycleReadings> recorded = runWire(live, CHECK_CYCLES, []() { return false; });
+    recorder.setRecording(false);
+    CHECK(recorded.size() == CHECK_CYCLES);
+    CHECK(recorder.getRecordCount() > 0);
+    if (recorded.size() >= 3)
+        CHECK(!recorded[2].valid[1]); // the scripted fault was seen live
+
+    NBD_ReplayTransport replay;
+    CHECK(replay.load(capture.data.data(), capture.data.size()));
+    CHECK(replay.getConversionCount() >= CHECK_CYCLES);
+    NonBlockingDallas replayed(&replay, 4);
+    replayed.begin(NonBlockingDallas::resolution_12, NonBlockingDallas::unit_C, CHECK_INTERVAL);
+    CHECK(replayed.getSensorsCount() == FAKE_SENSORS);
+    std::vector<CycleReadings> played = runWire(replayed, recorded.size(), [&]() { return replay.isFinished(); });
+
+    CHECK(played.size() == recorded.size());
+    for (size_t c = 0; c < played.size() && c < recorded.size(); c++)
+    {
+        if (!sameReadings(played[c], recorded[c]))
+        {
+            printf("cycle %u differs\n", (unsigned)c);
+            checkFailures++;
+        }
+    }
+    CHECK(replay.getMissCount() == 0);
+    return checkResult("replay_check");
+}
@@ -0,0 +1,99 @@
+/*
+Reads a fake w1 sysfs tree with NBD_W1SysfsTransport: sensors with the temperature attribute
+and with the w1_slave file only, a w1_slave read with a CRC error, a device of another family
+and a bus master with therm_bulk_read. Linux only.
+*/
+
+#include "host_check.h"
+
+#if !defined(__linux__)
+int main()
+{
+    printf("w1_check: Linux only\n");
+    return 1;
+}
+#else
+#include "NBD_w1sysfs.h"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#define CHECK_INTERVAL 800  //Read interval of the wire, at least the 12 bit conversion time [milliseconds]
+#define CHECK_TIMEOUT  5000 //[milliseconds]
+
+static void writeFile(const std::filesystem::path &path, const std::string &content)
+{
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path) << content;
+}
+
+static std::string readFile(const std::filesystem::path &path)
+{
+    std::ifstream file(path);
+    std::string content;
+    std::getline(file, content);
+    return content;
+}
+
+//Reading of the sensor with the w1 id, false if it is not valid
+static bool readingOf(NonBlockingDallas &wire, const char *id, int32_t &raw)
+{
+    DeviceAddress address;
+    NBD_W1SysfsTransport::idToAddress(id, address);
+    for (unsigned char i = 0; i < wire.getSensorsCount(); i++)
+    {
+        NBD_SensorSnapshot s;
+        ENUM_NBD_ERROR err;
+        if (wire.getSnapshotByIndex(i, s, err) && memcmp(s.address, address, 8) == 0)
+        {
+            raw = s.raw;
+            return s.valid;
+        }
+    }
+    return false;
+}
+
+int main()
+{
+    std::filesystem::path root = std::filesystem::temp_directory_path() / ("nbd-w1-check-" + std::to_string(millis()));
+    writeFile(root / "28-0316a279d8ff" / "temperature", "21375\n");
+    writeFile(root / "28-0316a279d8ff" / "ext_power", "1\n");
+    writeFile(root / "28-0316a279d900" / "w1_slave",
+              "72 01 4b 46 7f ff 0e 10 57 : crc=57 YES\n72 01 4b 46 7f ff 0e 10 57 t=-10125\n");
+    writeFile(root / "28-0316a279d900" / "ext_power", "1\n");
+    writeFile(root / "10-000802b4c2a1" / "w1_slave",
+              "32 00 4b 46 ff ff 02 10 00 : crc=00 NO\n32 00 4b 46 ff ff 02 10 00 t=25000\n");
+    writeFile(root / "10-000802b4c2a1" / "ext_power", "1\n");
+    writeFile(root / "3a-0000001a2b3c" / "state", "0\n"); // a switch, not a thermometer
+    writeFile(root / "w1_bus_master1" / "therm_bulk_read", "0\n");
+
+    DeviceAddress address;
+    CHECK(NBD_W1SysfsTransport::idToAddress("28-0316a279d8ff", address));
+    CHECK(address[0] == 0x28 && address[1] == 0xFF && address[6] == 0x03);
+    CHECK(!NBD_W1SysfsTransport::idToAddress("w1_bus_master1", address));
+
+    {
+        NBD_W1SysfsTransport w1(root.c_str());
+        NonBlockingDallas wire(&w1, 0);
+        wire.begin(NonBlockingDallas::resolution_12, NonBlockingDallas::unit_C, CHECK_INTERVAL);
+        CHECK(wire.getSensorsCount() == 3);
+        CHECK(!wire.isParasitePowerMode());
+        CHECK(readFile(root / "28-0316a279d8ff" / "resolution") == "12");
+
+        unsigned long start = millis();
+        while (wire.getCycleCount() < 2 && millis() - start < CHECK_TIMEOUT)
+        {
+            wire.update();
+            delay(1);
+        }
+        CHECK(wire.getCycleCount() >= 2);
+        int32_t raw = 0;
+        CHECK(readingOf(wire, "28-0316a279d8ff", raw) && raw == 2736);   // 21.375 °C
+        CHECK(readingOf(wire, "28-0316a279d900", raw) && raw == -1296);  // -10.125 °C
+        CHECK(!readingOf(wire, "10-000802b4c2a1", raw));                  // CRC error
+        CHECK(readFile(root / "w1_bus_master1" / "therm_bulk_read") == "trigger");
+    }
+    std::filesystem::remove_all(root);
+    return checkResult("w1_check");
+}
+#endif
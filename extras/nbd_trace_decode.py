@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Converts a dump of NBD_TraceBuffer::dump() into Chrome trace JSON.
+
+Open the result in https://ui.perfetto.dev or chrome://tracing. Every wire gets its own track;
+the events of NonBlockingDallasArray and the sketch markers go to the "array" track.
+
+    python3 nbd_trace_decode.py capture.bin > trace.json
+
+The capture may contain other serial output before the dump, the decoder looks for the magic.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"NBDT"
+NO_WIRE = 0xFF
+ALL = 0xFFFF
+
+CONVERSION_START = 1
+CONVERSION_END = 2
+READ_START = 3
+READ_END = 4
+CRC_ERROR = 5
+RESCAN_START = 6
+RESCAN_END = 7
+CALLBACK_START = 8
+CALLBACK_END = 9
+MARK = 10
+
+CALLBACKS = [
+    "onIntervalElapsed",
+    "onTemperatureChange",
+    "onPriorityReadComplete",
+    "onGroupChange",
+    "onSensorStale",
+    "onSensorRecovered",
+]
+
+
+def parse(data):
+    start = data.find(MAGIC)
+    if start < 0:
+        raise ValueError("no NBD trace found")
+    version, record_size, count, overwritten = struct.unpack_from("<HHII", data, start + 4)
+    if version != 1:
+        raise ValueError("unsupported trace version %d" % version)
+    offset = start + 16
+    if len(data) < offset + count * record_size:
+        raise ValueError("truncated trace: %d of %d events" % ((len(data) - offset) // record_size, count))
+    records = []
+    for i in range(count):
+        records.append(struct.unpack_from("<IBBH", data, offset + i * record_size))
+    return records, overwritten
+
+
+def unwrap(records):
+    """Makes micros() monotonic across its 32 bit wrap (every ~71 minutes)."""
+    base = 0
+    prev = None
+    for micros, event, wire, arg in records:
+        if prev is not None:
+            delta = (micros - prev) & 0xFFFFFFFF
+            if delta < 0x80000000 and micros < prev:
+                base += 1 << 32
+        prev = micros
+        yield base + micros, event, wire, arg
+
+
+def tid_of(wire):
+    return 1000 if wire == NO_WIRE else wire
+
+
+def convert(records, overwritten):
+    events = []
+    wires = set()
+    converting = {}
+    depth = {}  # open B events per track, the oldest ends may have lost their start
+    origin = None
+    for ts, event, wire, arg in unwrap(records):
+        if origin is None:
+            origin = ts
+        ts -= origin
+        wires.add(wire)
+        common = {"pid": 1, "tid": tid_of(wire), "ts": ts}
+        sensor = "all" if arg == ALL else str(arg)
+        if event in (READ_START, RESCAN_START, CALLBACK_START):
+            depth[wire] = depth.get(wire, 0) + 1
+        elif event in (READ_END, RESCAN_END, CALLBACK_END):
+            if depth.get(wire, 0) == 0:
+                continue
+            depth[wire] -= 1
+        if event == CONVERSION_START:
+            if wire in converting:  # never ended, e.g. cut by a rescan
+                events.append(dict(common, ph="e", name="conversion", cat="bus", id=wire))
+            converting[wire] = arg
+            events.append(dict(common, ph="b", name="conversion", cat="bus", id=wire, args={"sensor": sensor}))
+        elif event == CONVERSION_END:
+            if converting.pop(wire, None) is not None:
+                events.append(dict(common, ph="e", name="conversion", cat="bus", id=wire))
+        elif event == READ_START:
+            events.append(dict(common, ph="B", name="read %s" % sensor, cat="bus"))
+        elif event == READ_END:
+            events.append(dict(common, ph="E"))
+        elif event == CRC_ERROR:
+            events.append(dict(common, ph="i", s="t", name="CRC error %s" % sensor, cat="bus"))
+        elif event == RESCAN_START:
+            converting.pop(wire, None)
+            events.append(dict(common, ph="B", name="rescan", cat="bus"))
+        elif event == RESCAN_END:
+            events.append(dict(common, ph="E", args={"sensors": arg}))
+        elif event == CALLBACK_START:
+            name = CALLBACKS[arg] if arg < len(CALLBACKS) else "callback %d" % arg
+            events.append(dict(common, ph="B", name=name, cat="callback"))
+        elif event == CALLBACK_END:
+            events.append(dict(common, ph="E"))
+        elif event == MARK:
+            events.append(dict(common, ph="i", s="t", name="mark %d" % arg, cat="sketch"))
+    for wire in sorted(wires):
+        name = "array" if wire == NO_WIRE else "wire %d" % wire
+        events.append({"ph": "M", "pid": 1, "tid": tid_of(wire), "name": "thread_name", "args": {"name": name}})
+    events.append({"ph": "M", "pid": 1, "name": "process_name", "args": {"name": "NonBlockingDallas"}})
+    return {"traceEvents": events, "displayTimeUnit": "ms", "otherData": {"overwrittenEvents": overwritten}}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="binary dump, '-' for stdin")
+    parser.add_argument("-o", "--output", help="JSON file, stdout by default")
+    args = parser.parse_args()
+    if args.dump == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.dump, "rb") as f:
+            data = f.read()
+    records, overwritten = parse(data)
+    trace = convert(records, overwritten)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    if overwritten:
+        sys.stderr.write("%d events were overwritten before the dump\n" % overwritten)
+
+
+if __name__ == "__main__":
+    main()